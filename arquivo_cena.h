@@ -0,0 +1,224 @@
+/**
+ * ARQUIVO_CENA.H
+ * Instantâneo binário da cena (.cena): objetos, materiais, luzes, câmera e viewport.
+ * Cada vetor SoA da Cena é gravado como está na memória, em uma seção própria alinhada a 16 bytes.
+ * A carga mapeia o arquivo (mmap) e copia cada seção de uma vez para o vetor correspondente: não
+ * há interpretação por objeto, e o tempo de carga é limitado pela leitura do arquivo.
+ * Malhas indexadas e texturas são gravadas pelo caminho do seu arquivo (ver malha.h e textura.h),
+ * não pelo conteúdo.
+ */
+
+#ifndef ARQUIVO_CENA_H
+#define ARQUIVO_CENA_H
+
+#include "malha.h"
+#include "textura.h"
+#include <vector>
+#include <string>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+const uint32_t CENA_VERSAO = 2; // 2: texturas dos materiais
+
+// As seções são cópias diretas da memória: os tipos não podem ter ponteiros nem construtores de cópia
+static_assert(std::is_trivially_copyable<Vec4>::value && std::is_trivially_copyable<Material>::value &&
+              std::is_trivially_copyable<LuzPontual>::value, "tipos da cena devem ser copiáveis byte a byte");
+
+// Estado do frame que não mora na Cena (globais da aplicação)
+struct CameraCena {
+    Vec4 cam_pos, light_pos;
+    Vec3 light_color, ambient_color;
+    float fov;
+    int32_t vp_x, vp_y, vp_w, vp_h;   // Viewport, em pixels da janela
+};
+
+struct CabecalhoCena {
+    char magica[4];                   // "CEN1"
+    uint32_t versao;
+    uint32_t tam_vec4, tam_material, tam_luz; // sizeof de cada registro: arquivos de outro layout são recusados
+    uint32_t n_materiais, n_luzes, n_malhas, n_texturas;
+    uint64_t n_objetos;
+    CameraCena camera;
+    uint64_t off_posicoes, off_rotacoes, off_escalas, off_material_idx, off_malha_idx;
+    uint64_t off_materiais, off_luzes, off_malhas, off_texturas;
+    uint64_t tamanho;                 // Tamanho total do arquivo
+};
+
+// --- GRAVAÇÃO ---
+
+// Seção de nomes (malhas e texturas): (uint32 tamanho, caminho) por entrada
+template<class T>
+inline std::vector<char> secao_nomes(const std::vector<std::shared_ptr<const T>>& itens) {
+    std::vector<char> nomes;
+    for(const auto& m : itens) {
+        const std::string& nome = m ? m->nome : std::string();
+        uint32_t n = (uint32_t)nome.size();
+        nomes.insert(nomes.end(), (const char*)&n, (const char*)&n + sizeof(n));
+        nomes.insert(nomes.end(), nome.begin(), nome.end());
+    }
+    return nomes;
+}
+
+// Grava em um arquivo temporário e renomeia no fim: um instantâneo anterior com o mesmo nome nunca
+// fica pela metade. Retorna o número de bytes gravados (0 em caso de erro).
+inline uint64_t salvar_cena(const char* caminho, const Cena& cena, const CameraCena& camera) {
+    std::vector<char> nomes = secao_nomes(cena.malhas), nomes_texturas = secao_nomes(cena.texturas);
+
+    const uint64_t n = cena.size();
+    CabecalhoCena c;
+    std::memset((void*)&c, 0, sizeof(c)); // Zera também o preenchimento: o arquivo é determinístico
+    std::memcpy(c.magica, "CEN1", 4);
+    c.versao = CENA_VERSAO;
+    c.tam_vec4 = sizeof(Vec4); c.tam_material = sizeof(Material); c.tam_luz = sizeof(LuzPontual);
+    c.n_objetos = n;
+    c.n_materiais = (uint32_t)cena.materiais.size();
+    c.n_luzes = (uint32_t)cena.luzes.size();
+    c.n_malhas = (uint32_t)cena.malhas.size();
+    c.n_texturas = (uint32_t)cena.texturas.size();
+    c.camera = camera;
+    c.off_posicoes = alinhar16(sizeof(CabecalhoCena));
+    c.off_rotacoes = alinhar16(c.off_posicoes + n * sizeof(Vec4));
+    c.off_escalas = alinhar16(c.off_rotacoes + n * sizeof(Vec4));
+    c.off_material_idx = alinhar16(c.off_escalas + n * sizeof(float));
+    c.off_malha_idx = alinhar16(c.off_material_idx + n * sizeof(uint32_t));
+    c.off_materiais = alinhar16(c.off_malha_idx + n * sizeof(uint32_t));
+    c.off_luzes = alinhar16(c.off_materiais + c.n_materiais * sizeof(Material));
+    c.off_malhas = alinhar16(c.off_luzes + c.n_luzes * sizeof(LuzPontual));
+    c.off_texturas = c.off_malhas + nomes.size();
+    c.tamanho = c.off_texturas + nomes_texturas.size();
+
+    std::string temporario = std::string(caminho) + ".tmp";
+    FILE* f = std::fopen(temporario.c_str(), "wb");
+    if(!f) return 0;
+    uint64_t escritos = 0;
+    bool ok = true;
+    // Preenche com zeros até 'offset' e escreve a seção
+    auto secao = [&](uint64_t offset, const void* dados, size_t bytes) {
+        static const char zeros[16] = {};
+        if(offset > escritos) { ok = ok && std::fwrite(zeros, 1, offset - escritos, f) == offset - escritos; escritos = offset; }
+        if(bytes) ok = ok && std::fwrite(dados, 1, bytes, f) == bytes;
+        escritos += bytes;
+    };
+    secao(0, &c, sizeof(c));
+    secao(c.off_posicoes, cena.posicoes.data(), n * sizeof(Vec4));
+    secao(c.off_rotacoes, cena.rotacoes.data(), n * sizeof(Vec4));
+    secao(c.off_escalas, cena.escalas.data(), n * sizeof(float));
+    secao(c.off_material_idx, cena.material_idx.data(), n * sizeof(uint32_t));
+    secao(c.off_malha_idx, cena.malha_idx.data(), n * sizeof(uint32_t));
+    secao(c.off_materiais, cena.materiais.data(), c.n_materiais * sizeof(Material));
+    secao(c.off_luzes, cena.luzes.data(), c.n_luzes * sizeof(LuzPontual));
+    secao(c.off_malhas, nomes.data(), nomes.size());
+    secao(c.off_texturas, nomes_texturas.data(), nomes_texturas.size());
+    ok = (std::fclose(f) == 0) && ok;
+    if(!ok || std::rename(temporario.c_str(), caminho) != 0) { std::remove(temporario.c_str()); return 0; }
+    return c.tamanho;
+}
+
+// --- CARGA ---
+
+// Próximo nome de uma seção de nomes, a partir de 'o' (avançado); false se passar do fim do arquivo
+inline bool ler_nome(const uint8_t* base, uint64_t tamanho, uint64_t& o, std::string& nome) {
+    uint32_t n;
+    if(o > tamanho || sizeof(n) > tamanho - o) return false;
+    std::memcpy(&n, base + o, sizeof(n));
+    o += sizeof(n);
+    if(n > tamanho - o) return false;
+    nome.assign((const char*)base + o, n);
+    o += n;
+    return true;
+}
+
+// Seção [offset, offset + n registros) copiada para o vetor, se couber no arquivo e estiver no
+// alinhamento de 16 bytes que salvar_cena garante (o mapa começa em página, então o ponteiro também)
+template<class T>
+inline bool copiar_secao(const uint8_t* base, uint64_t tamanho, uint64_t offset, uint64_t n, std::vector<T>& destino) {
+    static_assert(alignof(T) <= 16, "seção com alinhamento maior que o do arquivo");
+    if(offset % 16 != 0 || offset < sizeof(CabecalhoCena)) return false;
+    if(offset > tamanho || n > (tamanho - offset) / sizeof(T)) return false;
+    const T* ini = (const T*)(base + offset);
+    destino.assign(ini, ini + n);
+    return true;
+}
+
+// Substitui a cena e a câmera pelo conteúdo do arquivo. Em caso de erro nada é alterado.
+// Malhas cujo arquivo não abre mais viram o cubo embutido, e texturas que não abrem mais deixam seus
+// materiais sem textura (com aviso).
+inline bool carregar_cena(const char* caminho, Cena& cena, CameraCena& camera) {
+    int fd = open(caminho, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CabecalhoCena)) { close(fd); return false; }
+    const uint64_t tamanho = (uint64_t)st.st_size;
+    // MAP_POPULATE lê o arquivo inteiro de uma vez, em vez de uma falta de página por página
+    void* mapa = mmap(nullptr, tamanho, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if(mapa == MAP_FAILED) return false;
+    madvise(mapa, tamanho, MADV_SEQUENTIAL);
+    const uint8_t* base = (const uint8_t*)mapa;
+
+    CabecalhoCena c;
+    std::memcpy((void*)&c, base, sizeof(c));
+    bool ok = std::memcmp(c.magica, "CEN1", 4) == 0 && c.versao == CENA_VERSAO && c.tamanho == tamanho &&
+              c.tam_vec4 == sizeof(Vec4) && c.tam_material == sizeof(Material) && c.tam_luz == sizeof(LuzPontual);
+    Cena nova;
+    ok = ok && copiar_secao(base, tamanho, c.off_posicoes, c.n_objetos, nova.posicoes)
+            && copiar_secao(base, tamanho, c.off_rotacoes, c.n_objetos, nova.rotacoes)
+            && copiar_secao(base, tamanho, c.off_escalas, c.n_objetos, nova.escalas)
+            && copiar_secao(base, tamanho, c.off_material_idx, c.n_objetos, nova.material_idx)
+            && copiar_secao(base, tamanho, c.off_malha_idx, c.n_objetos, nova.malha_idx)
+            && copiar_secao(base, tamanho, c.off_materiais, c.n_materiais, nova.materiais)
+            && copiar_secao(base, tamanho, c.off_luzes, c.n_luzes, nova.luzes);
+
+    // Caminhos das malhas e das texturas: poucos, lidos um a um
+    std::vector<uint32_t> remapear;  // Índice novo de cada malha do arquivo (MALHA_CUBO se falhou)
+    uint64_t o = c.off_malhas;
+    std::string nome;
+    for(uint32_t i = 0; ok && i < c.n_malhas; i++) {
+        if(!ler_nome(base, tamanho, o, nome)) { ok = false; break; }
+        std::shared_ptr<Malha> m = carregar_malha(nome);
+        if(m) remapear.push_back(nova.registrar_malha(m));
+        else {
+            std::printf("Malha %s nao encontrada: seus objetos viram cubos\n", nome.c_str());
+            remapear.push_back(MALHA_CUBO);
+        }
+    }
+    std::vector<uint32_t> remapear_texturas; // Índice novo de cada textura do arquivo (SEM_TEXTURA se falhou)
+    o = c.off_texturas;
+    for(uint32_t i = 0; ok && i < c.n_texturas; i++) {
+        if(!ler_nome(base, tamanho, o, nome)) { ok = false; break; }
+        std::shared_ptr<Textura> t = carregar_textura(nome);
+        if(t) remapear_texturas.push_back(nova.registrar_textura(t));
+        else {
+            std::printf("Textura %s nao encontrada: seus materiais ficam sem textura\n", nome.c_str());
+            remapear_texturas.push_back(SEM_TEXTURA);
+        }
+    }
+    munmap(mapa, tamanho);
+    if(!ok) return false;
+
+    for(Material& m : nova.materiais) {
+        if(m.textura == SEM_TEXTURA) continue;
+        if(m.textura >= remapear_texturas.size()) return false;
+        m.textura = remapear_texturas[m.textura];
+    }
+
+    // Índices fora das tabelas invalidariam o pipeline: recusa o arquivo
+    for(uint64_t i = 0; i < c.n_objetos; i++) {
+        uint32_t& mi = nova.malha_idx[i];
+        if(nova.material_idx[i] >= nova.materiais.size()) return false;
+        if(mi == MALHA_CUBO) continue;
+        if(mi >= remapear.size()) return false;
+        mi = remapear[mi];
+    }
+    cena = std::move(nova);
+    camera = c.camera;
+    return true;
+}
+
+#endif
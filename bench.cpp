@@ -0,0 +1,1015 @@
+/**
+ * BENCH.CPP
+ * Benchmark headless do pipeline (sem SDL).
+ * Renderiza cenas fixas de 2 até 100k cubos em um framebuffer em memória, seguindo
+ * um caminho de câmera roteirizado, e mede o tempo de cada frame nos modos Phong e Flat.
+ *
+ * Cada modo é medido em várias variantes do pipeline (rasterizador direto ou em tiles,
+ * núcleo scanline ou funções de aresta SIMD, forward ou deferred, framebuffer linear ou em tiles).
+ * Uma segunda tabela mede o custo das luzes pontuais conforme a quantidade cresce, com e sem
+ * o culling de luzes por tile. A terceira liga o controle de resolução dinâmica com orçamentos
+ * de tempo cada vez menores e mostra a resolução interna em que ele estabiliza. A quarta compara
+ * a produção sequencial de frames com a em pipeline (thread de render + anel de framebuffers),
+ * com uma apresentação simulada, em frames exibidos por segundo e latência entrada -> tela.
+ * A quinta converte um OBJ gerado para o formato binário (malha.h), compara a carga do OBJ com
+ * a do binário mapeado e desenha a malha com os vértices transformados uma vez por frame e um por canto.
+ * A sexta grava e recarrega instantâneos binários de cenas grandes (arquivo_cena.h) e compara a
+ * carga com a leitura pura do arquivo e com a montagem da cena em código. A sétima renderiza um
+ * roteiro offline (render_offline.h) para Y4M com 1 worker e com um por núcleo. A oitava compara o
+ * frame sem anti-aliasing com o MSAA 4x (FramebufferMSAA) e com o supersampling 4x. A nona liga as
+ * sombras da luz principal (sombras.h) com a luz e a cena paradas, com a luz em movimento e com um
+ * cubo movido por frame, e conta as faces do cube map refeitas. A décima aplica uma textura
+ * (textura.h) a um piso girado e aos cubos, com os texels em ordem linear e de Morton, com mipmaps
+ * e, no piso, também sempre no nível 0. A décima primeira publica frames no anel de memória
+ * compartilhada (exportacao_shm.h) sem leitor, com um leitor rápido e com um lento, e conta os
+ * frames lidos, os descartados pela leitura e os sobrescritos antes de lidos. A décima segunda
+ * conta, com um operator new global que registra as chamadas, as alocações no heap de frames em
+ * regime com 1 e 4 threads, que devem ser zero (o benchmark termina com erro se não forem).
+ * A última liga a instrumentação (instrumentacao.h) e mostra o tempo de cada etapa do pipeline.
+ *
+ * Uso: ./benchmark [--cena-1m] [frames_por_cena] [max_cubos] [threads] [largura altura]
+ * --cena-1m: mede também o instantâneo de 1 milhão de objetos, acima de max_cubos (~42 MB em disco).
+ */
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include "pipeline.h"
+#include "resolucao.h"
+#include "produtor_frames.h"
+#include "malha.h"
+#include "arquivo_cena.h"
+#include "render_offline.h"
+#include "exportacao_shm.h"
+
+// Contador de alocações no heap (tabela de alocações): o operator new global do programa é
+// substituído por um que conta as chamadas, de qualquer thread, e repassa ao malloc.
+static std::atomic<long long> g_alocacoes(0);
+
+void* operator new(std::size_t n) {
+    g_alocacoes.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t n, std::align_val_t alinhamento) {
+    g_alocacoes.fetch_add(1, std::memory_order_relaxed);
+    void* p = nullptr;
+    if(posix_memalign(&p, std::max((size_t)alinhamento, sizeof(void*)), n ? n : 1) == 0) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// Resolução do framebuffer (padrão: a da janela da aplicação)
+static int g_largura = SCREEN_W, g_altura = SCREEN_H;
+
+// Gerador pseudo-aleatório fixo: as cenas são idênticas em toda execução.
+static uint32_t g_semente = 12345;
+static float aleatorio01() {
+    g_semente = g_semente * 1664525u + 1013904223u;
+    return (g_semente >> 8) / 16777216.0f;
+}
+
+// Mesmos materiais da cena inicial de main.cpp
+static Material material_base(float shininess, Vec3 ka, Vec3 kd) {
+    Material m;
+    m.ka = ka; m.kd = kd; m.ks = Vec3(1.0,1.0,1.0);
+    m.shininess = shininess;
+    return m;
+}
+
+const int CORES_PALETA = 64; // Materiais distintos nas cenas grandes (compartilhados entre os cubos)
+
+// Monta uma cena com n cubos. Com n == 2 reproduz exatamente a cena inicial da aplicação;
+// acima disso os cubos são distribuídos em um bloco à frente da câmera.
+static Cena montar_cena(int n) {
+    Cena cena;
+    g_semente = 12345;
+    cena.adicionar(Vec4(-1.2,0,-5), Vec4(0.5,0.6,0), 1, cena.registrar_material(material_base(50,  Vec3(0.1,0.0,0.0), Vec3(0.8,0.0,0.0))));
+    cena.adicionar(Vec4(1.2,0,-5),  Vec4(0,-0.3,0),  1, cena.registrar_material(material_base(100, Vec3(0.0,0.1,0.0), Vec3(0.0,0.8,0.0))));
+    if(n <= 2) return cena;
+
+    uint32_t paleta[CORES_PALETA];
+    for(int i = 0; i < CORES_PALETA; i++) {
+        Vec3 kd(aleatorio01(), aleatorio01(), aleatorio01());
+        paleta[i] = cena.registrar_material(material_base(50, kd * 0.1f, kd));
+    }
+
+    int lado = (int)std::ceil(std::cbrt((double)n));
+    for(int i = 2; i < n; i++) {
+        int gx = i % lado, gy = (i / lado) % lado, gz = i / (lado * lado);
+        Vec4 pos((gx - lado*0.5f) * 3.0f, (gy - lado*0.5f) * 3.0f, -8.0f - gz * 3.0f);
+        Vec4 rot(aleatorio01() * 6.28f, aleatorio01() * 6.28f, 0);
+        cena.adicionar(pos, rot, 1, paleta[std::min((int)(aleatorio01() * CORES_PALETA), CORES_PALETA - 1)]);
+    }
+    return cena;
+}
+
+// Espalha n luzes pontuais (raio 4) no volume ocupado pelos cubos de montar_cena.
+static void montar_luzes(Cena& cena, int n) {
+    cena.luzes.clear();
+    g_semente = 777;
+    int lado = (int)std::ceil(std::cbrt((double)cena.size()));
+    for(int i = 0; i < n; i++) {
+        Vec4 pos((aleatorio01() - 0.5f) * lado * 3.0f, (aleatorio01() - 0.5f) * lado * 3.0f, -6.0f - aleatorio01() * lado * 3.0f);
+        Vec3 cor(aleatorio01() * 0.6f, aleatorio01() * 0.6f, aleatorio01() * 0.6f);
+        cena.adicionar_luz(pos, cor, 4.0f);
+    }
+}
+
+// Opções de uma variante fora do caminho comum (Forward, BVH, câmera em movimento, culling de
+// luzes e transformação única dos vértices das malhas), combinadas com '|'
+enum OpcaoVariante {
+    OPCAO_DEFERRED = 1 << 0,
+    OPCAO_SEM_BVH = 1 << 1,
+    OPCAO_HIZ = 1 << 2,
+    OPCAO_CAMERA_FIXA = 1 << 3,
+    OPCAO_SEM_CULLING_LUZES = 1 << 4,
+    OPCAO_FB_TILES = 1 << 5,
+    OPCAO_PROF16 = 1 << 6,
+    OPCAO_SEM_CACHE_VERTICES = 1 << 7,
+};
+
+// Variante do pipeline medida (combinação de modos de ParametrosFrame)
+struct Variante {
+    const char* nome;
+    bool phong;
+    bool tiles;
+    ModoRaster raster;
+    bool deferred;
+    bool bvh;
+    bool hiz;
+    bool camera_fixa;    // Câmera parada: mede o cache de transformações (cena estática)
+    bool culling_luzes;  // Culling de luzes por tile (tabela de luzes pontuais)
+    bool fb_tiles;       // Framebuffer em tiles (resolvido para linear dentro do tempo medido)
+    bool prof16;         // Profundidade de 16 bits no framebuffer em tiles
+    bool cache_vertices; // Malhas: vértices transformados uma vez por frame (senão, um por canto)
+    bool msaa = false;   // MSAA 4x (resolvido para linear dentro do tempo medido)
+    bool sombras = false; // Sombras da luz principal (só no Phong)
+
+    Variante(const char* nome, bool phong, bool tiles, ModoRaster raster, unsigned opcoes = 0)
+        : nome(nome), phong(phong), tiles(tiles), raster(raster),
+          deferred(opcoes & OPCAO_DEFERRED), bvh(!(opcoes & OPCAO_SEM_BVH)), hiz(opcoes & OPCAO_HIZ),
+          camera_fixa(opcoes & OPCAO_CAMERA_FIXA), culling_luzes(!(opcoes & OPCAO_SEM_CULLING_LUZES)),
+          fb_tiles(opcoes & OPCAO_FB_TILES), prof16(opcoes & OPCAO_PROF16),
+          cache_vertices(!(opcoes & OPCAO_SEM_CACHE_VERTICES)) {}
+};
+
+// Caminho de câmera roteirizado: uma volta lenta em torno da origem, avançando em Z.
+static ParametrosFrame parametros_caminho(int frame, int total, const Variante& v) {
+    float t = v.camera_fixa ? 0.0f : (float)frame / std::max(1, total);
+    ParametrosFrame p;
+    p.cam_pos = Vec4(std::sin(t * 6.28f) * 1.5f, std::cos(t * 6.28f) * 0.8f, -t * 2.0f);
+    p.light_pos = Vec4(2,3,-5);
+    p.light_color = Vec3(1.0f, 1.0f, 1.0f);
+    p.ambient_color = Vec3(0.2f, 0.2f, 0.2f);
+    p.fov = 1.04f;
+    p.use_phong = v.phong;
+    p.use_tiles = v.tiles;
+    p.raster = v.raster;
+    p.use_deferred = v.deferred;
+    p.use_bvh = v.bvh;
+    p.use_hiz = v.hiz;
+    p.use_culling_luzes = v.culling_luzes;
+    p.use_fb_tiles = v.fb_tiles;
+    p.use_prof16 = v.prof16;
+    p.use_cache_vertices = v.cache_vertices;
+    p.use_msaa = v.msaa;
+    p.use_sombras = v.sombras;
+    p.largura = g_largura; p.altura = g_altura;
+    p.vp_x = 0; p.vp_y = 0; p.vp_w = g_largura; p.vp_h = g_altura;
+    return p;
+}
+
+static double percentil(const std::vector<double>& ordenado, double q) {
+    size_t i = (size_t)std::ceil(q * ordenado.size()) - 1;
+    return ordenado[std::min(i, ordenado.size() - 1)];
+}
+
+// Hash FNV-1a do framebuffer: permite comparar a saída de caminhos diferentes do pipeline.
+static uint32_t hash_fb(const std::vector<uint32_t>& fb) {
+    uint32_t h = 2166136261u;
+    for(uint32_t px : fb) { h ^= px; h *= 16777619u; }
+    return h;
+}
+
+// Resultado agregado das medições de uma variante
+struct Medicao {
+    std::vector<double> tempos;   // Ordenados
+    double total_ms = 0;
+    long long tris = 0, pixels = 0, visiveis = 0, aprovados = 0, visitados = 0, ocluidos = 0, transformados = 0, pares_luz = 0;
+    long long testados = 0;
+    long long tris_malha = 0, vertices_malha = 0;
+    long long faces_sombra = 0, tris_sombra = 0;
+    double ms_etapa[N_ETAPAS] = {}; // Soma dos frames (só com instrumentação)
+};
+
+static Medicao executar_frames(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames,
+                               std::vector<uint32_t>& fb, std::vector<float>& zb, bool instrumentar = false) {
+    Medicao r;
+
+    for(int f = 0; f < frames; f++) {
+        ParametrosFrame p = parametros_caminho(f, frames, v);
+        p.instrumentar = instrumentar;
+        EstatisticasFrame st;
+
+        auto inicio = std::chrono::steady_clock::now();
+        ctx.instr.iniciar_frame(p.instrumentar, false);
+        if(!usa_framebuffer_contexto(p)) {
+            MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+            limpar_buffers(fb, zb);
+        }
+        renderizar_cena(ctx, cena, p, fb, zb, &st);
+        if(usa_framebuffer_contexto(p)) resolver_framebuffer(ctx, p, fb.data(), g_largura);
+        ctx.instr.fechar_frame(st.ms_etapa);
+        auto fim = std::chrono::steady_clock::now();
+
+        r.tempos.push_back(std::chrono::duration<double, std::milli>(fim - inicio).count());
+        r.tris += (long long)cena.size() * 12; // Triângulos da cena, inclusive os descartados pelo culling
+        r.pixels += st.pixels_sombreados;
+        r.visiveis += st.pixels_visiveis;
+        r.aprovados += st.fragmentos_aprovados;
+        r.visitados += st.objetos_visitados;
+        r.ocluidos += st.objetos_ocluidos;
+        r.transformados += st.objetos_transformados;
+        r.pares_luz += st.pares_tile_luz;
+        r.testados += st.fragmentos_testados;
+        r.tris_malha += st.triangulos_malha;
+        r.vertices_malha += st.vertices_malha;
+        r.faces_sombra += st.faces_sombra;
+        r.tris_sombra += st.triangulos_sombra;
+        for(int i = 0; i < N_ETAPAS; i++) r.ms_etapa[i] += st.ms_etapa[i];
+    }
+
+    for(double t : r.tempos) r.total_ms += t;
+    std::sort(r.tempos.begin(), r.tempos.end());
+    return r;
+}
+
+static void medir(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames,
+                  std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    Medicao r = executar_frames(ctx, cena, v, frames, fb, zb);
+    printf("%8zu  %-22s  %9.3f  %9.3f  %9.3f  %12.0f  %12.0f  %8.2f  %9lld  %8lld  %8lld  %08x\n",
+           cena.size(), v.nome,
+           r.tempos.front(), percentil(r.tempos, 0.5), percentil(r.tempos, 0.99),
+           r.tris / (r.total_ms / 1000.0), r.pixels / (r.total_ms / 1000.0),
+           r.visiveis ? (double)r.pixels / r.visiveis : 0.0, r.visitados / frames, r.ocluidos / frames, r.transformados / frames, hash_fb(fb));
+    fflush(stdout);
+}
+
+// Linha da tabela de luzes: tempo e média de luzes por tile (pares tile x luz / tiles da tela)
+static void medir_luzes(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames,
+                        std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    Medicao r = executar_frames(ctx, cena, v, frames, fb, zb);
+    const int tiles = ((g_largura + TILE_LUZ - 1) / TILE_LUZ) * ((g_altura + TILE_LUZ - 1) / TILE_LUZ);
+    printf("%8zu  %6zu  %-22s  %9.3f  %9.3f  %9.3f  %12.0f  %10.2f  %08x\n",
+           cena.size(), cena.luzes.size(), v.nome,
+           r.tempos.front(), percentil(r.tempos, 0.5), percentil(r.tempos, 0.99),
+           r.pixels / (r.total_ms / 1000.0), (double)r.pares_luz / frames / tiles, hash_fb(fb));
+    fflush(stdout);
+}
+
+// Linha da tabela de resolução dinâmica: o controle ajusta a resolução interna frame a frame
+// para caber no orçamento; o tempo medido inclui a ampliação para a resolução de saída.
+static void medir_resolucao(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames, float orcamento_ms,
+                            std::vector<uint32_t>& saida) {
+    ControleResolucao controle(g_largura, g_altura, orcamento_ms);
+    controle.ativo = orcamento_ms > 0;
+    Ampliador ampliador;
+    std::vector<uint32_t> fb;
+    std::vector<float> zb;
+    std::vector<double> tempos;
+    double ampliar_ms = 0;
+    int mudancas = 0;
+
+    for(int f = 0; f < frames; f++) {
+        ParametrosFrame p = parametros_caminho(f, frames, v);
+        p.largura = controle.largura(); p.altura = controle.altura();
+        p.vp_w = p.largura; p.vp_h = p.altura;
+        fb.resize(p.largura * p.altura);
+        zb.resize(p.largura * p.altura);
+
+        auto inicio = std::chrono::steady_clock::now();
+        limpar_buffers(fb, zb);
+        renderizar_cena(ctx, cena, p, fb, zb);
+        auto meio = std::chrono::steady_clock::now();
+        ampliador.ampliar(fb.data(), p.largura, p.altura, saida.data(), g_largura, g_altura, g_largura, ctx.pool);
+        auto fim = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(fim - inicio).count();
+        tempos.push_back(ms);
+        ampliar_ms += std::chrono::duration<double, std::milli>(fim - meio).count();
+        if(controle.registrar((float)ms)) mudancas++;
+    }
+
+    std::sort(tempos.begin(), tempos.end());
+    char orcamento[16];
+    if(controle.ativo) snprintf(orcamento, sizeof(orcamento), "%.2f", orcamento_ms);
+    else snprintf(orcamento, sizeof(orcamento), "-");
+    printf("%8zu  %-22s  %10s  %9.3f  %9.3f  %6.0f%%  %5dx%-5d  %8d  %11.3f\n",
+           cena.size(), v.nome, orcamento, percentil(tempos, 0.5), percentil(tempos, 0.99),
+           controle.ativo ? controle.escala * 100.0f : 100.0f,
+           controle.largura(), controle.altura(), mudancas, ampliar_ms / frames);
+    fflush(stdout);
+}
+
+// Produção de frames pela thread de render, com a thread principal fazendo o papel da janela:
+// a cada iteração registra uma entrada, publica o instantâneo e "apresenta" o frame pronto mais
+// recente (cópia para a textura + espera fixa, no lugar do envio ao driver e do vsync).
+// sequencial: espera o frame recém-publicado antes de apresentar (sem sobreposição).
+static void medir_producao(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames, int n_quadros,
+                           bool sequencial, double apresentar_ms) {
+    std::vector<uint32_t> textura(g_largura * g_altura);
+    std::vector<double> latencias;
+    int exibidos = 0;
+    uint64_t descartados;
+    double total_ms;
+    {
+        ProdutorFrames produtor(ctx, g_largura, g_altura, n_quadros);
+        produtor.marcar_reconstrucao();
+        auto inicio = Relogio::now();
+        for(int f = 0; f < frames; f++) {
+            ParametrosFrame p = parametros_caminho(f, frames, v);
+            produtor.marcar_entrada(Relogio::now());
+            uint64_t numero = produtor.publicar(cena, p);
+            if(sequencial) produtor.esperar(numero);
+
+            const QuadroAnel* q = produtor.adquirir();
+            Relogio::time_point t_entrada;
+            if(q) {
+                std::memcpy(textura.data(), q->imagem.data(), textura.size() * sizeof(uint32_t));
+                t_entrada = q->t_entrada;
+                produtor.liberar(q);
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(apresentar_ms));
+            if(q) {
+                exibidos++;
+                latencias.push_back(std::chrono::duration<double, std::milli>(Relogio::now() - t_entrada).count());
+            }
+        }
+        total_ms = std::chrono::duration<double, std::milli>(Relogio::now() - inicio).count();
+        descartados = produtor.descartados();
+    }
+
+    std::sort(latencias.begin(), latencias.end());
+    char modo[24];
+    if(sequencial) snprintf(modo, sizeof(modo), "sequencial");
+    else snprintf(modo, sizeof(modo), "pipeline %d quadros", n_quadros);
+    printf("%8zu  %-22s  %-20s  %10.1f  %9.3f  %9.3f  %11llu\n",
+           cena.size(), v.nome, modo, exibidos * 1000.0 / total_ms,
+           percentil(latencias, 0.5), percentil(latencias, 0.99), (unsigned long long)descartados);
+    fflush(stdout);
+}
+
+// Linha da tabela de etapas: a mesma variante sem e com instrumentação (o custo dela), o tempo
+// médio de cada etapa e os fragmentos testados/aprovados por frame. O hash deve ser o mesmo nas
+// duas execuções: medir não muda a imagem.
+static void medir_etapas(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames,
+                         std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    Medicao base = executar_frames(ctx, cena, v, frames, fb, zb);
+    uint32_t hash_base = hash_fb(fb);
+    Medicao r = executar_frames(ctx, cena, v, frames, fb, zb, true);
+    printf("%8zu  %-22s  %9.3f  %9.3f", cena.size(), v.nome, percentil(base.tempos, 0.5), percentil(r.tempos, 0.5));
+    for(int i = 0; i < ETAPA_APRESENTAR; i++) printf("  %8.3f", r.ms_etapa[i] / frames);
+    printf("  %10lld  %10lld  %s\n", r.testados / frames, r.aprovados / frames, hash_fb(fb) == hash_base ? "igual" : "DIFERENTE");
+    fflush(stdout);
+}
+
+// OBJ procedural da tabela de malhas: um toro de n x n quadriláteros (2n² triângulos) sem normais
+// (o conversor as calcula), com as faces na ordem das linhas da grade, como sai de um exportador.
+static void gerar_obj_toro(const char* caminho, int n) {
+    FILE* f = fopen(caminho, "w");
+    if(!f) return;
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < n; j++) {
+            float u = 6.2831853f * i / n, w = 6.2831853f * j / n;
+            float r = 0.4f + 0.03f * std::sin(7 * u) * std::cos(5 * w); // Relevo para as normais variarem
+            fprintf(f, "v %f %f %f\n", (1.0f + r * std::cos(w)) * std::cos(u), r * std::sin(w), (1.0f + r * std::cos(w)) * std::sin(u));
+        }
+    }
+    for(int i = 0; i < n; i++) {
+        for(int j = 0; j < n; j++) {
+            int a = i * n + j + 1, b = ((i + 1) % n) * n + j + 1;
+            int c = ((i + 1) % n) * n + (j + 1) % n + 1, d = i * n + (j + 1) % n + 1;
+            fprintf(f, "f %d %d %d %d\n", a, d, c, b); // Anti-horário visto de fora
+        }
+    }
+    fclose(f);
+}
+
+static double ms_desde(std::chrono::steady_clock::time_point inicio) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - inicio).count();
+}
+
+// Linha da tabela de malhas: tempo do frame e vértices transformados por triângulo (ACMR) medidos
+// no pipeline. Com e sem a transformação única a imagem é a mesma: só muda quantas vezes cada
+// vértice é transformado.
+static void medir_malha(ContextoRender& ctx, const Cena& cena, const char* ordem, const Variante& v, int frames,
+                        std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    Medicao r = executar_frames(ctx, cena, v, frames, fb, zb);
+    printf("%10lld  %-18s  %-22s  %9.3f  %9.3f  %12.0f  %9.3f  %08x\n",
+           r.tris_malha / frames, ordem, v.nome, percentil(r.tempos, 0.5), percentil(r.tempos, 0.99),
+           r.tris_malha / (r.total_ms / 1000.0), r.tris_malha ? (double)r.vertices_malha / r.tris_malha : 0.0, hash_fb(fb));
+    fflush(stdout);
+}
+
+// Linha da tabela de instantâneos: montar a cena em código, gravar, ler o arquivo sem interpretar
+// (read em um buffer, o limite de I/O) e carregar (mmap + cópia das seções). "igual" confirma que a
+// cena carregada é idêntica byte a byte à gravada.
+static void medir_arquivo_cena(int n) {
+    const char* caminho = "bench_cena.cena";
+    auto t0 = std::chrono::steady_clock::now();
+    Cena cena = montar_cena(n);
+    montar_luzes(cena, 64);
+    double montar_ms = ms_desde(t0);
+    CameraCena camera = {};
+    camera.cam_pos = Vec4(0, 0, 0); camera.fov = 1.04f;
+
+    t0 = std::chrono::steady_clock::now();
+    uint64_t bytes = salvar_cena(caminho, cena, camera);
+    double salvar_ms = ms_desde(t0);
+
+    t0 = std::chrono::steady_clock::now();
+    std::vector<char> buffer(bytes);
+    FILE* f = fopen(caminho, "rb");
+    size_t lidos = f ? fread(buffer.data(), 1, bytes, f) : 0;
+    if(f) fclose(f);
+    double ler_ms = ms_desde(t0);
+
+    Cena carregada;
+    CameraCena camera_lida;
+    t0 = std::chrono::steady_clock::now();
+    bool ok = carregar_cena(caminho, carregada, camera_lida);
+    double carregar_ms = ms_desde(t0);
+    ok = ok && lidos == bytes && carregada.size() == cena.size() && carregada.luzes.size() == cena.luzes.size() &&
+         std::memcmp(carregada.posicoes.data(), cena.posicoes.data(), cena.size() * sizeof(Vec4)) == 0 &&
+         std::memcmp(carregada.rotacoes.data(), cena.rotacoes.data(), cena.size() * sizeof(Vec4)) == 0 &&
+         carregada.escalas == cena.escalas && carregada.material_idx == cena.material_idx &&
+         carregada.malha_idx == cena.malha_idx && carregada.materiais == cena.materiais;
+    std::remove(caminho);
+
+    double mb = bytes / 1048576.0;
+    printf("%8zu  %9.1f  %10.2f  %10.2f  %10.2f  %10.2f  %10.0f  %s\n",
+           cena.size(), mb, montar_ms, salvar_ms, ler_ms, carregar_ms, mb / (carregar_ms / 1000.0), ok ? "igual" : "DIFERENTE");
+    fflush(stdout);
+}
+
+// Supersampling 4x, para comparação com o MSAA: o frame em 2x a largura e 2x a altura (um Pixel
+// Shader por amostra), reduzido pela média de cada 2x2 para fb dentro do tempo medido.
+static Medicao executar_ssaa(ContextoRender& ctx, const Cena& cena, const Variante& v, int frames, std::vector<uint32_t>& fb) {
+    const int w = g_largura * 2, h = g_altura * 2;
+    std::vector<uint32_t> fb2((size_t)w * h);
+    std::vector<float> zb2((size_t)w * h);
+    Medicao r;
+    for(int f = 0; f < frames; f++) {
+        ParametrosFrame p = parametros_caminho(f, frames, v);
+        p.largura = w; p.altura = h;
+        p.vp_w = w; p.vp_h = h;
+        EstatisticasFrame st;
+        auto inicio = std::chrono::steady_clock::now();
+        limpar_buffers(fb2, zb2);
+        renderizar_cena(ctx, cena, p, fb2, zb2, &st);
+        ctx.pool.executar(g_altura, [&](int y) {
+            const uint32_t* a = &fb2[(size_t)2 * y * w];
+            const uint32_t* b = a + w;
+            for(int x = 0; x < g_largura; x++) {
+                uint32_t c[4] = { a[2 * x], a[2 * x + 1], b[2 * x], b[2 * x + 1] };
+                uint32_t rb = 0x00020002u, ag = 0x00020002u;
+                for(uint32_t k : c) { rb += k & 0x00FF00FFu; ag += (k >> 8) & 0x00FF00FFu; }
+                fb[(size_t)y * g_largura + x] = (((ag >> 2) & 0x00FF00FFu) << 8) | ((rb >> 2) & 0x00FF00FFu);
+            }
+        });
+        r.tempos.push_back(ms_desde(inicio));
+        r.pixels += st.pixels_sombreados;
+    }
+    for(double t : r.tempos) r.total_ms += t;
+    std::sort(r.tempos.begin(), r.tempos.end());
+    return r;
+}
+
+// Linha da tabela de anti-aliasing: custo em relação ao frame sem AA ('base_ms'), Pixel Shaders por
+// frame, memória de cor e profundidade, e a fração dos pixels diferentes da imagem sem AA ('sem_aa'):
+// no MSAA, só os das bordas dos triângulos mudam.
+static void imprimir_aa(const Cena& cena, const char* nome, const Medicao& r, int frames, double base_ms, double mb,
+                        const std::vector<uint32_t>& fb, const std::vector<uint32_t>& sem_aa) {
+    size_t diferentes = 0;
+    for(size_t i = 0; i < fb.size(); i++) diferentes += fb[i] != sem_aa[i];
+    double med = percentil(r.tempos, 0.5);
+    printf("%8zu  %-22s  %9.3f  %9.3f  %7.2fx  %12lld  %8.1f  %9.2f%%  %08x\n", cena.size(), nome, med, percentil(r.tempos, 0.99),
+           med / base_ms, r.pixels / frames, mb, 100.0 * diferentes / fb.size(), hash_fb(fb));
+    fflush(stdout);
+}
+
+// Cenários da tabela de sombras: o que muda entre os frames além da câmera.
+enum CenarioSombras {
+    SOMBRAS_PARADAS,    // Luz e objetos parados: os mapas são feitos uma vez, antes da medição
+    SOMBRAS_LUZ_MOVEL,  // A luz principal anda a cada frame: as seis faces são refeitas
+    SOMBRAS_UM_OBJETO,  // Um cubo diferente sobe a cada frame: só as faces que o enxergam são refeitas
+};
+
+// Frames com sombras e a instrumentação ligada (para o tempo da etapa ETAPA_SOMBRAS). Os cubos movidos
+// no cenário SOMBRAS_UM_OBJETO voltam ao lugar no fim, e o índice é reconstruído.
+static Medicao executar_sombras(ContextoRender& ctx, Cena& cena, Variante v, CenarioSombras c, int frames,
+                                std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    v.sombras = true;
+    ctx.sombras.invalidar();
+    executar_frames(ctx, cena, v, 1, fb, zb); // Aquecimento: mapas da luz e da cena iniciais
+    Medicao r;
+    std::vector<int> movidos;
+    for(int f = 0; f < frames; f++) {
+        ParametrosFrame p = parametros_caminho(f, frames, v);
+        p.instrumentar = true;
+        if(c == SOMBRAS_LUZ_MOVEL) p.light_pos = Vec4(2.0f + std::sin((f + 1) * 0.3f) * 0.5f, 3, -5);
+        EstatisticasFrame st;
+        auto inicio = std::chrono::steady_clock::now();
+        if(c == SOMBRAS_UM_OBJETO) {
+            int i = (int)(((long long)f * 7919) % cena.size());
+            cena.posicoes[i].y += 0.5f;
+            atualizar_objeto(ctx, cena, i);
+            movidos.push_back(i);
+        }
+        ctx.instr.iniciar_frame(true, false);
+        {
+            MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+            limpar_buffers(fb, zb);
+        }
+        renderizar_cena(ctx, cena, p, fb, zb, &st);
+        ctx.instr.fechar_frame(st.ms_etapa);
+        r.tempos.push_back(ms_desde(inicio));
+        r.pixels += st.pixels_sombreados;
+        r.faces_sombra += st.faces_sombra;
+        r.tris_sombra += st.triangulos_sombra;
+        for(int i = 0; i < N_ETAPAS; i++) r.ms_etapa[i] += st.ms_etapa[i];
+    }
+    if(!movidos.empty()) {
+        for(int i : movidos) cena.posicoes[i].y -= 0.5f;
+        reconstruir_indice(ctx, cena);
+    }
+    for(double t : r.tempos) r.total_ms += t;
+    std::sort(r.tempos.begin(), r.tempos.end());
+    return r;
+}
+
+// Linha da tabela de texturas: a cena com todos os materiais usando 'tex' (nullptr: sem textura).
+// Retorna a mediana; 'base_ms' > 0 dá o custo relativo ao frame sem textura.
+static double medir_textura(ContextoRender& ctx, const Cena& cena, const char* nome, std::shared_ptr<const Textura> tex,
+                            int frames, double base_ms, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    Cena c = cena;
+    c.texturas.clear();
+    uint32_t t = tex ? c.registrar_textura(tex) : SEM_TEXTURA;
+    for(Material& m : c.materiais) m.textura = t;
+    reconstruir_indice(ctx, c);
+    const Variante v = { "Phong edge", true, false, RASTER_EDGE };
+    Medicao r = executar_frames(ctx, c, v, frames, fb, zb);
+    double med = percentil(r.tempos, 0.5);
+    printf("%8zu  %-28s  %9.3f  %9.3f  %7.2fx  %08x\n", c.size(), nome, med, percentil(r.tempos, 0.99),
+           base_ms > 0 ? med / base_ms : 1.0, hash_fb(fb));
+    fflush(stdout);
+    return med;
+}
+
+// Linha da tabela de memória compartilhada: publica 'quadros' frames a cada 'intervalo_ms' enquanto uma
+// thread leitora (o outro processo, aqui no mesmo) consome os frames em ordem, gastando 'leitor_ms' em
+// cada um (leitor_ms < 0: sem leitor). A leitura percorre os pixels direto do segmento, sem cópia.
+static void medir_exportacao_shm(const char* nome_leitor, double leitor_ms, int quadros, double intervalo_ms) {
+    const char* nome_shm = "/modelador_bench";
+    ExportadorShm exportador;
+    if(!exportador.abrir(nome_shm, g_largura, g_altura)) { printf("%-10s  shm_open falhou\n", nome_leitor); return; }
+    std::vector<uint32_t> fb((size_t)g_largura * g_altura);
+
+    std::atomic<bool> fim(false);
+    long long lidos = 0, rasgados = 0, pulados = 0;
+    double latencia_ms = 0.0;
+    uint32_t soma = 0;
+    LeitorShm leitor;
+    bool com_leitor = leitor_ms >= 0.0 && leitor.abrir(nome_shm);
+    std::thread t_leitor;
+    if(com_leitor) t_leitor = std::thread([&]() {
+        const uint64_t n_pos = leitor.cabecalho()->n_posicoes;
+        uint64_t proximo = 0;
+        while(true) {
+            int64_t recente = leitor.mais_recente();
+            if(recente < (int64_t)proximo) {
+                if(fim.load()) break;
+                std::this_thread::yield();
+                continue;
+            }
+            // Os mais antigos que o anel já sobrescreveu estão perdidos
+            if((uint64_t)recente >= proximo + n_pos) { pulados += recente + 1 - n_pos - proximo; proximo = recente + 1 - n_pos; }
+            int64_t instante = 0;
+            bool ok = leitor.ler(proximo, [&](const PosicaoShm& pos, const uint32_t* px) {
+                instante = pos.instante_ns;
+                uint32_t s = 0;
+                for(uint32_t i = 0; i < pos.bytes / 4; i++) s += px[i];
+                soma += s;
+            });
+            if(ok) { lidos++; latencia_ms += (relogio_ns() - instante) * 1e-6; }
+            else rasgados++;
+            proximo++;
+            if(leitor_ms > 0.0) std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(leitor_ms));
+        }
+    });
+
+    std::vector<double> tempos;
+    auto inicio = std::chrono::steady_clock::now();
+    for(int q = 0; q < quadros; q++) {
+        std::fill(fb.begin(), fb.end(), 0xFF000000u | (uint32_t)q);
+        auto t0 = std::chrono::steady_clock::now();
+        exportador.publicar(fb.data(), g_largura, g_altura, g_largura);
+        tempos.push_back(ms_desde(t0));
+        std::this_thread::sleep_until(inicio + std::chrono::duration<double, std::milli>(intervalo_ms * (q + 1)));
+    }
+    fim = true;
+    if(t_leitor.joinable()) t_leitor.join();
+
+    std::sort(tempos.begin(), tempos.end());
+    double med = percentil(tempos, 0.5);
+    printf("%-10s  %7d  %12.3f  %9.0f  %7lld  %8lld  %8lld  %10llu  %12.3f\n", nome_leitor, quadros, med,
+           fb.size() * 4 / 1048576.0 / (med / 1000.0), lidos, rasgados, pulados,
+           (unsigned long long)exportador.descartados(), lidos ? latencia_ms / lidos : 0.0);
+    fflush(stdout);
+    (void)soma;
+}
+
+// Linha da tabela de alocações: o mesmo trecho do caminho de câmera é desenhado duas vezes em um
+// contexto novo e só a segunda passada é contada, com os vetores do contexto já no tamanho de pico.
+// Em regime, o frame inteiro (geometria, raster e resolução) não deve alocar nada no heap.
+static bool medir_alocacoes(const Cena& cena, const Variante& v, int threads, int frames) {
+    ContextoRender ctx(threads);
+    std::vector<uint32_t> fb(g_largura * g_altura);
+    std::vector<float> zb(g_largura * g_altura);
+    reconstruir_indice(ctx, cena);
+    long long alocacoes = 0;
+    for(int passada = 0; passada < 2; passada++) {
+        long long antes = g_alocacoes.load();
+        for(int f = 0; f < frames; f++) {
+            ParametrosFrame p = parametros_caminho(f, frames, v);
+            if(!usa_framebuffer_contexto(p)) limpar_buffers(fb, zb);
+            renderizar_cena(ctx, cena, p, fb, zb);
+            if(usa_framebuffer_contexto(p)) resolver_framebuffer(ctx, p, fb.data(), g_largura);
+        }
+        alocacoes = g_alocacoes.load() - antes;
+    }
+    printf("%8zu  %7d  %-22s  %7d  %10lld  %s\n", cena.size(), ctx.pool.num_threads(), v.nome, frames, alocacoes,
+           alocacoes == 0 ? "ok" : "FALHOU");
+    fflush(stdout);
+    return alocacoes == 0;
+}
+
+// Tabela principal: cada variante do pipeline nas cenas de 2 até max_cubos cubos
+static void tabela_variantes(ContextoRender& ctx, int frames, int max_cubos,
+                             std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    printf("%8s  %-22s  %9s  %9s  %9s  %12s  %12s  %8s  %9s  %8s  %8s  %8s\n",
+           "cubos", "variante", "min(ms)", "med(ms)", "p99(ms)", "tri/s", "pixels/s", "overdraw", "visitados", "ocluidos", "transf", "hash");
+
+    const Variante variantes[] = {
+        { "Phong scan",            true,  false, RASTER_SCANLINE },
+        { "Phong scan tiles",      true,  true,  RASTER_SCANLINE },
+        { "Phong edge",            true,  false, RASTER_EDGE },
+        { "Phong edge tiles",      true,  true,  RASTER_EDGE },
+        { "Phong scan deferred",   true,  false, RASTER_SCANLINE, OPCAO_DEFERRED },
+        { "Phong edge deferred",   true,  false, RASTER_EDGE, OPCAO_DEFERRED },
+        { "Phong edge tiles def.", true,  true,  RASTER_EDGE, OPCAO_DEFERRED },
+        { "Phong edge Hi-Z",       true,  false, RASTER_EDGE, OPCAO_HIZ },
+        { "Phong scan fb tiles",   true,  false, RASTER_SCANLINE, OPCAO_FB_TILES },
+        { "Phong edge fb tiles",   true,  false, RASTER_EDGE, OPCAO_FB_TILES },
+        { "Phong edge tiles+fbt",  true,  true,  RASTER_EDGE, OPCAO_FB_TILES },
+        { "Phong edge fbt def.",   true,  false, RASTER_EDGE, OPCAO_DEFERRED | OPCAO_FB_TILES },
+        { "Phong edge fbt 16 bits", true, false, RASTER_EDGE, OPCAO_FB_TILES | OPCAO_PROF16 },
+        { "Flat scan",             false, false, RASTER_SCANLINE },
+        { "Flat scan tiles",       false, true,  RASTER_SCANLINE },
+        { "Flat edge",             false, false, RASTER_EDGE },
+        { "Flat edge tiles",       false, true,  RASTER_EDGE },
+        { "Flat edge sem BVH",     false, false, RASTER_EDGE, OPCAO_SEM_BVH },
+        { "Flat edge Hi-Z",        false, false, RASTER_EDGE, OPCAO_HIZ },
+        { "Flat edge camera fixa", false, false, RASTER_EDGE, OPCAO_CAMERA_FIXA },
+        { "Flat edge fb tiles",    false, false, RASTER_EDGE, OPCAO_FB_TILES },
+        { "Flat edge tiles+fbt",   false, true,  RASTER_EDGE, OPCAO_FB_TILES },
+    };
+
+    const int tamanhos[] = { 2, 100, 1000, 10000, 100000 };
+    for(int n : tamanhos) {
+        if(n > max_cubos) break;
+        Cena cena = montar_cena(n);
+        reconstruir_indice(ctx, cena);
+        for(const Variante& v : variantes) medir(ctx, cena, v, frames, fb, zb);
+    }
+}
+
+// Custo das luzes pontuais: a cena com cada vez mais luzes. Termina com a cena sem luzes.
+static void tabela_luzes(ContextoRender& ctx, Cena& cena, int frames, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    printf("\nLuzes pontuais (culling por tile de %dx%d pixels)\n", TILE_LUZ, TILE_LUZ);
+    printf("%8s  %6s  %-22s  %9s  %9s  %9s  %12s  %10s  %8s\n",
+           "cubos", "luzes", "variante", "min(ms)", "med(ms)", "p99(ms)", "pixels/s", "luzes/tile", "hash");
+    const Variante variantes_luzes[] = {
+        { "Phong edge",            true,  false, RASTER_EDGE },
+        { "Phong edge sem culling", true, false, RASTER_EDGE, OPCAO_SEM_CULLING_LUZES },
+        { "Phong edge deferred",   true,  false, RASTER_EDGE, OPCAO_DEFERRED },
+        { "Phong scan",            true,  false, RASTER_SCANLINE },
+        { "Flat edge",             false, false, RASTER_EDGE },
+    };
+    const int quantidades[] = { 0, 16, 64, 256, 1024 };
+    for(int n : quantidades) {
+        montar_luzes(cena, n);
+        for(const Variante& v : variantes_luzes) medir_luzes(ctx, cena, v, frames, fb, zb);
+    }
+    montar_luzes(cena, 0);
+}
+
+// Variante das tabelas de resolução dinâmica e de produção em pipeline
+static const Variante V_RESOLUCAO = { "Phong edge tiles", true, true, RASTER_EDGE };
+
+// Resolução dinâmica: orçamentos em frações do tempo na resolução cheia. Retorna esse tempo
+// (mediana), base também da tabela de produção.
+static double tabela_resolucao(ContextoRender& ctx, const Cena& cena, int frames_res,
+                               std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    Medicao cheia = executar_frames(ctx, cena, V_RESOLUCAO, frames_res, fb, zb);
+    double base_ms = percentil(cheia.tempos, 0.5);
+    printf("\nResolucao dinamica (saida %dx%d, ampliacao por vizinho mais proximo)\n", g_largura, g_altura);
+    printf("%8s  %-22s  %10s  %9s  %9s  %7s  %11s  %8s  %11s\n",
+           "cubos", "variante", "orcam.(ms)", "med(ms)", "p99(ms)", "escala", "resolucao", "mudancas", "ampliar(ms)");
+    const float fracoes[] = { 0.0f, 0.75f, 0.5f, 0.3f };
+    for(float fr : fracoes) medir_resolucao(ctx, cena, V_RESOLUCAO, frames_res, (float)(base_ms * fr), fb);
+    return base_ms;
+}
+
+// Pipeline: a apresentação simulada custa metade do tempo de render na resolução cheia, então
+// o sequencial fica em ~1/(1.5 render) e o pipeline, limitado pelo render, em ~1/render.
+static void tabela_producao(ContextoRender& ctx, const Cena& cena, int frames_res, double base_ms) {
+    const double apresentar_ms = base_ms * 0.5;
+    printf("\nProducao em pipeline (apresentacao simulada de %.2f ms por frame)\n", apresentar_ms);
+    printf("%8s  %-22s  %-20s  %10s  %9s  %9s  %11s\n",
+           "cubos", "variante", "modo", "exibidos/s", "lat.med", "lat.p99", "descartados");
+    medir_producao(ctx, cena, V_RESOLUCAO, frames_res, 3, true, apresentar_ms);
+    medir_producao(ctx, cena, V_RESOLUCAO, frames_res, 2, false, apresentar_ms);
+    medir_producao(ctx, cena, V_RESOLUCAO, frames_res, 3, false, apresentar_ms);
+}
+
+// Malha indexada: conversão do OBJ (uma vez) contra a carga do binário mapeado, e o frame com
+// e sem a transformação única dos vértices. "ordem do OBJ" converte sem a otimização de Forsyth.
+static void tabela_malha(ContextoRender& ctx, int frames, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    const int LADO_TORO = 320;
+    const char* obj = "bench_toro.obj";
+    const char* bin = "bench_toro.malha";
+    const char* bin_obj = "bench_toro_sem_otim.malha";
+    gerar_obj_toro(obj, LADO_TORO);
+    auto t0 = std::chrono::steady_clock::now();
+    DadosMalha dados;
+    ler_obj(obj, dados);
+    double ler_ms = ms_desde(t0);
+    double acmr_obj = acmr_fifo(dados.indices.data(), dados.indices.size());
+    t0 = std::chrono::steady_clock::now();
+    converter_obj(obj, bin);
+    double converter_ms = ms_desde(t0);
+    converter_obj(obj, bin_obj, false);
+    t0 = std::chrono::steady_clock::now();
+    std::shared_ptr<Malha> malha = carregar_malha(obj); // .malha já atual: só o mmap
+    double carregar_ms = ms_desde(t0);
+    std::shared_ptr<Malha> malha_obj = mapear_malha(bin_obj);
+    if(malha && malha_obj) {
+        printf("\nMalha indexada (toro de %u triangulos, %u vertices, .malha de %.1f MB)\n",
+               malha->n_triangulos(), malha->n_vertices, malha->tamanho_mapa / 1048576.0);
+        printf("  ler OBJ %.1f ms | converter OBJ -> .malha %.1f ms | carregar .malha (mmap) %.3f ms\n",
+               ler_ms, converter_ms, carregar_ms);
+        printf("  ACMR simulado (FIFO de %d): ordem do OBJ %.3f | otimizada %.3f\n", CACHE_FORSYTH,
+               acmr_obj, acmr_fifo(malha->indices, malha->n_indices));
+        printf("%10s  %-18s  %-22s  %9s  %9s  %12s  %9s  %8s\n",
+               "triangulos", "ordem", "variante", "med(ms)", "p99(ms)", "tri/s", "vert/tri", "hash");
+        const Variante v_malha = { "Phong edge",           true, false, RASTER_EDGE };
+        const Variante v_sem_cache = { "Phong edge sem cache", true, false, RASTER_EDGE, OPCAO_SEM_CACHE_VERTICES };
+        Cena cena_malha, cena_obj;
+        uint32_t mat = cena_malha.registrar_material(material_base(50, Vec3(0.1,0.1,0.0), Vec3(0.8,0.7,0.2)));
+        cena_malha.adicionar(Vec4(0,0,-5), Vec4(0.9,0.3,0), 1.5f, mat, cena_malha.registrar_malha(malha));
+        cena_obj = cena_malha;
+        cena_obj.malhas[0] = malha_obj;
+        reconstruir_indice(ctx, cena_malha);
+        medir_malha(ctx, cena_malha, "otimizada", v_malha, frames, fb, zb);
+        medir_malha(ctx, cena_malha, "otimizada", v_sem_cache, frames, fb, zb);
+        medir_malha(ctx, cena_obj, "ordem do OBJ", v_malha, frames, fb, zb);
+    }
+    malha.reset();
+    malha_obj.reset();
+    std::remove(obj); std::remove(bin); std::remove(bin_obj);
+}
+
+// Instantâneos binários: a cena de max_cubos e, só se pedida, uma de 1 milhão de objetos
+static void tabela_instantaneos(int max_cubos, bool cena_1m) {
+    printf("\nInstantaneo binario da cena (%zu bytes por objeto)\n", 2 * sizeof(Vec4) + sizeof(float) + 2 * sizeof(uint32_t));
+    printf("%8s  %9s  %10s  %10s  %10s  %10s  %10s  %s\n",
+           "objetos", "MB", "montar(ms)", "gravar(ms)", "ler(ms)", "carga(ms)", "carga MB/s", "cena");
+    medir_arquivo_cena(max_cubos);
+    if(cena_1m && max_cubos < 1000000) medir_arquivo_cena(1000000);
+}
+
+// Renderização offline: o caminho de câmera das outras tabelas como roteiro, gravado em Y4M
+static void tabela_offline(const Cena& cena, int frames_res) {
+    printf("\nRenderizacao offline (Y4M %dx%d)\n", g_largura, g_altura);
+    printf("%8s  %7s  %7s  %10s  %12s  %10s  %10s\n",
+           "cubos", "quadros", "workers", "quadros/s", "render(ms)", "MB/s", "esp.escrita");
+    Roteiro roteiro;
+    roteiro.largura = g_largura; roteiro.altura = g_altura;
+    roteiro.quadros = frames_res;
+    const Variante v_off = { "Phong edge", true, false, RASTER_EDGE };
+    for(int q : { 0, frames_res - 1 }) {
+        ParametrosFrame p = parametros_caminho(q, frames_res, v_off);
+        ChaveQuadro k = { q, { p.cam_pos.x, p.cam_pos.y, p.cam_pos.z, p.fov } };
+        roteiro.camera.inserir(k);
+    }
+    const int n_workers[] = { 1, (int)std::max(1u, std::thread::hardware_concurrency()) };
+    for(int w : n_workers) {
+        ResultadoOffline r = renderizar_offline(roteiro, cena, camera_inicial(), "bench_offline.y4m", w);
+        printf("%8zu  %7d  %7d  %10.2f  %12.3f  %10.0f  %9.0f%%\n", cena.size(), r.quadros, r.workers,
+               r.quadros_por_segundo(), r.render_ms / r.quadros, r.bytes / 1048576.0 / r.segundos,
+               r.espera_escrita_ms / (r.segundos * 10.0));
+        fflush(stdout);
+        if(w == n_workers[0] && n_workers[1] == 1) break;
+    }
+    std::remove("bench_offline.y4m");
+}
+
+// Anti-aliasing: sem AA, MSAA 4x (um Pixel Shader por pixel) e supersampling 4x (um por amostra)
+static void tabela_aa(ContextoRender& ctx, const Cena& cena, int frames, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    printf("\nAnti-aliasing (4 amostras por pixel)\n");
+    printf("%8s  %-22s  %9s  %9s  %8s  %12s  %8s  %10s  %8s\n",
+           "cubos", "variante", "med(ms)", "p99(ms)", "custo", "sombreados", "MB", "diferentes", "hash");
+    const double mb_linear = (double)g_largura * g_altura * 8 / 1048576.0;
+    for(bool phong : { true, false }) {
+        Variante v_aa = { phong ? "Phong edge" : "Flat edge", phong, false, RASTER_EDGE };
+        Medicao sem = executar_frames(ctx, cena, v_aa, frames, fb, zb);
+        std::vector<uint32_t> sem_aa = fb;
+        double base_ms = percentil(sem.tempos, 0.5);
+        imprimir_aa(cena, v_aa.nome, sem, frames, base_ms, mb_linear, fb, sem_aa);
+        v_aa.msaa = true;
+        for(bool tiles : { false, true }) {
+            v_aa.tiles = tiles;
+            v_aa.nome = phong ? (tiles ? "Phong edge tiles MSAA" : "Phong edge MSAA 4x") : (tiles ? "Flat edge tiles MSAA" : "Flat edge MSAA 4x");
+            Medicao r = executar_frames(ctx, cena, v_aa, frames, fb, zb);
+            imprimir_aa(cena, v_aa.nome, r, frames, base_ms, ctx.msaa.memoria() / 1048576.0, fb, sem_aa);
+        }
+        v_aa.msaa = false; v_aa.tiles = false;
+        v_aa.nome = phong ? "Phong edge SSAA 4x" : "Flat edge SSAA 4x";
+        Medicao r = executar_ssaa(ctx, cena, v_aa, frames, fb);
+        imprimir_aa(cena, v_aa.nome, r, frames, base_ms, 4 * mb_linear, fb, sem_aa);
+    }
+}
+
+// Sombras da luz principal (Phong): o custo sobre o frame sem sombras e quantas faces do cube map
+// são refeitas por frame conforme a luz e os objetos mudam
+static void tabela_sombras(ContextoRender& ctx, Cena& cena, int frames, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    printf("\nSombras da luz principal (cube map de 6 x %dx%d)\n", RESOLUCAO_SOMBRA, RESOLUCAO_SOMBRA);
+    printf("%8s  %-22s  %9s  %9s  %8s  %11s  %12s  %11s  %8s\n",
+           "cubos", "variante", "med(ms)", "p99(ms)", "custo", "faces/frame", "tris mapa", "sombras(ms)", "hash");
+    const Variante v_sombra = { "Phong edge", true, false, RASTER_EDGE };
+    Medicao sem = executar_frames(ctx, cena, v_sombra, frames, fb, zb);
+    double base_ms = percentil(sem.tempos, 0.5);
+    printf("%8zu  %-22s  %9.3f  %9.3f  %7.2fx  %11s  %12s  %11s  %08x\n", cena.size(), "sem sombras", base_ms,
+           percentil(sem.tempos, 0.99), 1.0, "-", "-", "-", hash_fb(fb));
+    const struct { const char* nome; CenarioSombras c; } cenarios[] = {
+        { "luz e cena paradas", SOMBRAS_PARADAS },
+        { "luz em movimento", SOMBRAS_LUZ_MOVEL },
+        { "um cubo por frame", SOMBRAS_UM_OBJETO },
+    };
+    for(const auto& cs : cenarios) {
+        Medicao r = executar_sombras(ctx, cena, v_sombra, cs.c, frames, fb, zb);
+        double med = percentil(r.tempos, 0.5);
+        printf("%8zu  %-22s  %9.3f  %9.3f  %7.2fx  %11.2f  %12lld  %11.3f  %08x\n", cena.size(), cs.nome, med,
+               percentil(r.tempos, 0.99), med / base_ms, (double)r.faces_sombra / frames, r.tris_sombra / frames,
+               r.ms_etapa[ETAPA_SOMBRAS] / frames, hash_fb(fb));
+        fflush(stdout);
+    }
+}
+
+// Texturas (Phong): custo sobre o frame sem textura e o layout dos texels. No piso, a rotação em Y
+// gira o xadrez na tela: em ordem linear, a 90 graus os pixels de uma linha andam pelas colunas
+// da textura; em Morton o acesso é o mesmo em qualquer ângulo. As imagens dos dois layouts são iguais.
+// Com mipmaps o nível lido cabe na cache e esconde o layout; as linhas "nivel 0" desligam os
+// mipmaps e leem sempre a textura cheia, bem maior que a cache, onde o layout pesa.
+static void tabela_texturas(ContextoRender& ctx, const Cena& cena, int frames, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    const int LADO_TEXTURA = 2048;
+    printf("\nTexturas (xadrez de %dx%d com mipmaps, bilinear, um nivel por bloco de pixels)\n", LADO_TEXTURA, LADO_TEXTURA);
+    printf("%8s  %-28s  %9s  %9s  %8s  %8s\n", "cubos", "variante", "med(ms)", "p99(ms)", "custo", "hash");
+    std::shared_ptr<const Textura> layouts[2], layouts_nivel0[2];
+    layouts[1] = montar_textura(TEXTURA_XADREZ, gerar_xadrez(LADO_TEXTURA), LADO_TEXTURA, LADO_TEXTURA, TEXTURA_MORTON);
+    layouts[0] = reorganizar_textura(*layouts[1], TEXTURA_LINEAR);
+    for(int l = 0; l < 2; l++) {
+        std::shared_ptr<Textura> t(new Textura(*layouts[l]));
+        t->mipmaps = false;
+        layouts_nivel0[l] = t;
+    }
+    const char* nomes_layout[2] = { "linear", "Morton" };
+    for(int graus : { 0, 45, 90 }) {
+        // Cubo achatado como piso: topo em y = -2, de z = -4 a z = -20
+        Cena piso;
+        piso.adicionar(Vec4(0,-10,-12), Vec4(0, graus * 0.0174533f, 0), 8, piso.registrar_material(material_base(50, Vec3(0.1,0.1,0.1), Vec3(0.8,0.8,0.8))));
+        char nome[32];
+        std::snprintf(nome, sizeof(nome), "piso %d graus", graus);
+        double base_ms = medir_textura(ctx, piso, nome, nullptr, frames, 0, fb, zb);
+        for(int l = 0; l < 2; l++) {
+            std::snprintf(nome, sizeof(nome), "piso %d graus %s", graus, nomes_layout[l]);
+            medir_textura(ctx, piso, nome, layouts[l], frames, base_ms, fb, zb);
+        }
+        for(int l = 0; l < 2; l++) {
+            std::snprintf(nome, sizeof(nome), "piso %d graus %s nivel 0", graus, nomes_layout[l]);
+            medir_textura(ctx, piso, nome, layouts_nivel0[l], frames, base_ms, fb, zb);
+        }
+    }
+    double base_ms = medir_textura(ctx, cena, "cubos sem textura", nullptr, frames, 0, fb, zb);
+    for(int l = 0; l < 2; l++) {
+        std::string nome = std::string("cubos ") + nomes_layout[l];
+        medir_textura(ctx, cena, nome.c_str(), layouts[l], frames, base_ms, fb, zb);
+    }
+    reconstruir_indice(ctx, cena);
+}
+
+// Exportação em memória compartilhada: um frame a cada 4 ms (250 fps), leitores de custos diferentes
+static void tabela_exportacao_shm() {
+    printf("\nExportacao em memoria compartilhada (%dx%d ARGB, anel de 4 posicoes, 1 frame a cada 4 ms)\n", g_largura, g_altura);
+    printf("%-10s  %7s  %12s  %9s  %7s  %8s  %8s  %10s  %12s\n",
+           "leitor", "quadros", "publicar(ms)", "MB/s", "lidos", "rasgados", "pulados", "perdidos", "latencia(ms)");
+    medir_exportacao_shm("nenhum", -1.0, 200, 4.0);
+    medir_exportacao_shm("rapido", 0.0, 200, 4.0);
+    medir_exportacao_shm("lento", 12.0, 200, 4.0);
+}
+
+// Alocações no heap em regime, com 1 e com 4 threads. Retorna false se alguma variante alocou.
+static bool tabela_alocacoes(const Cena& cena, int frames) {
+    printf("\nAlocacoes no heap em regime (frames ja desenhados uma vez no mesmo contexto)\n");
+    printf("%8s  %7s  %-22s  %7s  %10s  %s\n", "cubos", "threads", "variante", "quadros", "alocacoes", "resultado");
+    const Variante variantes_alocacoes[] = {
+        { "Phong edge",            true,  false, RASTER_EDGE },
+        { "Phong edge tiles",      true,  true,  RASTER_EDGE },
+        { "Phong edge tiles def.", true,  true,  RASTER_EDGE, OPCAO_DEFERRED },
+    };
+    bool sem_alocacoes = true;
+    for(int t : { 1, 4 })
+        for(const Variante& v : variantes_alocacoes) sem_alocacoes &= medir_alocacoes(cena, v, t, std::min(frames, 10));
+    return sem_alocacoes;
+}
+
+// Etapas do pipeline com a instrumentação ligada
+static void tabela_etapas(ContextoRender& ctx, const Cena& cena, int frames, std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    printf("\nEtapas do pipeline (ms por frame, somados entre as threads)\n");
+    printf("%8s  %-22s  %9s  %9s", "cubos", "variante", "med(ms)", "instr.(ms)");
+    for(int i = 0; i < ETAPA_APRESENTAR; i++) printf("  %8.8s", NOMES_ETAPAS[i]);
+    printf("  %10s  %10s  %s\n", "testados", "aprovados", "imagem");
+    const Variante variantes_etapas[] = {
+        { "Phong scan",            true,  false, RASTER_SCANLINE },
+        { "Phong edge",            true,  false, RASTER_EDGE },
+        { "Phong edge tiles",      true,  true,  RASTER_EDGE },
+        { "Phong edge deferred",   true,  false, RASTER_EDGE, OPCAO_DEFERRED },
+        { "Phong edge Hi-Z",       true,  false, RASTER_EDGE, OPCAO_HIZ },
+        { "Phong edge fb tiles",   true,  false, RASTER_EDGE, OPCAO_FB_TILES },
+        { "Flat edge",             false, false, RASTER_EDGE },
+    };
+    for(const Variante& v : variantes_etapas) medir_etapas(ctx, cena, v, frames, fb, zb);
+}
+
+int main(int argc, char* argv[]) {
+    bool cena_1m = argc > 1 && std::strcmp(argv[1], "--cena-1m") == 0;
+    if(cena_1m) { argc--; argv++; }
+    int frames = (argc > 1) ? std::atoi(argv[1]) : 30;
+    int max_cubos = (argc > 2) ? std::atoi(argv[2]) : 100000;
+    int threads = (argc > 3) ? std::atoi(argv[3]) : 0;
+    if(argc > 5) { g_largura = std::max(1, std::atoi(argv[4])); g_altura = std::max(1, std::atoi(argv[5])); }
+    if(frames < 1) frames = 1;
+
+    ContextoRender ctx(threads);
+
+    std::vector<uint32_t> fb(g_largura * g_altura);
+    std::vector<float> zb(g_largura * g_altura);
+
+    printf("Benchmark headless %dx%d | %d frames por cena | %d threads | SIMD %s\n",
+           g_largura, g_altura, frames, ctx.pool.num_threads(), SIMD_NOME);
+    tabela_variantes(ctx, frames, max_cubos, fb, zb);
+
+    // As demais tabelas usam a cena de 1000 cubos
+    const int CUBOS_LUZES = 1000;
+    if(max_cubos < CUBOS_LUZES) return 0;
+    Cena cena = montar_cena(CUBOS_LUZES);
+    reconstruir_indice(ctx, cena);
+    tabela_luzes(ctx, cena, frames, fb, zb);
+
+    // O controle de resolução precisa de alguns frames para convergir: pelo menos 60 por linha
+    const int frames_res = std::max(frames, 60);
+    double base_ms = tabela_resolucao(ctx, cena, frames_res, fb, zb);
+    tabela_producao(ctx, cena, frames_res, base_ms);
+    tabela_malha(ctx, frames, fb, zb);
+    tabela_instantaneos(max_cubos, cena_1m);
+    tabela_offline(cena, frames_res);
+    tabela_aa(ctx, cena, frames, fb, zb);
+    tabela_sombras(ctx, cena, frames, fb, zb);
+    tabela_texturas(ctx, cena, frames, fb, zb);
+    tabela_exportacao_shm();
+    bool sem_alocacoes = tabela_alocacoes(cena, frames);
+    if(INSTRUMENTACAO) tabela_etapas(ctx, cena, frames, fb, zb);
+    return sem_alocacoes ? 0 : 1;
+}
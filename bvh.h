@@ -0,0 +1,167 @@
+/**
+ * BVH.H
+ * Hierarquia de volumes envolventes (BVH) sobre os cubos da cena.
+ * Permite que o Frustum Culling visite apenas os cubos candidatos em vez de percorrer
+ * a cena inteira: o custo do frame passa a acompanhar o conjunto visível.
+ */
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "math_utils.h"
+#include <vector>
+#include <algorithm>
+
+// Caixa alinhada aos eixos (AABB) no espaço do mundo
+struct CaixaAABB {
+    float min[3], max[3];
+
+    void vazia() { for(int i=0; i<3; i++) { min[i] = 1e30f; max[i] = -1e30f; } }
+    void unir(const CaixaAABB& o) {
+        for(int i=0; i<3; i++) { min[i] = std::min(min[i], o.min[i]); max[i] = std::max(max[i], o.max[i]); }
+    }
+};
+
+// Caixa da esfera envolvente do cubo: invariante à rotação, então só posição e escala a alteram.
+inline CaixaAABB caixa_cubo(const Cena& cena, uint32_t idx) {
+    const Vec4& c = cena.posicoes[idx];
+    float r = 1.7320508f * std::fabs(cena.escalas[idx]);
+    CaixaAABB b;
+    b.min[0] = c.x - r; b.max[0] = c.x + r;
+    b.min[1] = c.y - r; b.max[1] = c.y + r;
+    b.min[2] = c.z - r; b.max[2] = c.z + r;
+    return b;
+}
+
+// Leva um plano do View Space para o espaço do mundo: p_mundo = p_view * View (vetor linha).
+inline Plano plano_para_mundo(const Plano& p, const Mat4& view) {
+    Plano r;
+    r.a = p.a*view.m[0][0] + p.b*view.m[1][0] + p.c*view.m[2][0] + p.d*view.m[3][0];
+    r.b = p.a*view.m[0][1] + p.b*view.m[1][1] + p.c*view.m[2][1] + p.d*view.m[3][1];
+    r.c = p.a*view.m[0][2] + p.b*view.m[1][2] + p.c*view.m[2][2] + p.d*view.m[3][2];
+    r.d = p.a*view.m[0][3] + p.b*view.m[1][3] + p.c*view.m[2][3] + p.d*view.m[3][3];
+    return r;
+}
+
+struct NoBVH {
+    CaixaAABB caixa;
+    int esquerda, direita; // Filhos (-1 nas folhas)
+    int pai;
+    int inicio, quantidade; // Faixa contígua em BVHCena::objetos coberta pela subárvore
+};
+
+struct BVHCena {
+    static const int MAX_FOLHA = 4;
+
+    std::vector<NoBVH> nos;
+    std::vector<uint32_t> objetos;     // Índices dos cubos, agrupados por folha
+    std::vector<int> folha_do_objeto;  // Cubo -> nó folha que o contém
+    std::vector<CaixaAABB> caixas;     // Caixa atual de cada cubo
+
+    size_t num_objetos() const { return folha_do_objeto.size(); }
+
+    // Construção top-down: divide pela mediana no maior eixo dos centros.
+    void construir(const Cena& cena) {
+        nos.clear();
+        objetos.resize(cena.size());
+        folha_do_objeto.assign(cena.size(), -1);
+        caixas.resize(cena.size());
+        for(size_t i = 0; i < cena.size(); i++) { objetos[i] = (uint32_t)i; caixas[i] = caixa_cubo(cena, (uint32_t)i); }
+        if(!cena.empty()) construir_no(0, (int)cena.size(), -1);
+    }
+
+    // Refit incremental: recalcula a caixa do cubo idx e propaga até a raiz (O(profundidade)).
+    void atualizar(const Cena& cena, int idx) {
+        if(idx < 0 || (size_t)idx >= num_objetos()) return;
+        caixas[idx] = caixa_cubo(cena, (uint32_t)idx);
+        int no = folha_do_objeto[idx];
+        NoBVH& folha = nos[no];
+        folha.caixa.vazia();
+        for(int i = folha.inicio; i < folha.inicio + folha.quantidade; i++) folha.caixa.unir(caixas[objetos[i]]);
+        for(no = folha.pai; no >= 0; no = nos[no].pai) {
+            nos[no].caixa = nos[nos[no].esquerda].caixa;
+            nos[no].caixa.unir(nos[nos[no].direita].caixa);
+        }
+    }
+
+    // Percorre a árvore contra os planos do frustum (no espaço do mundo) e acrescenta em
+    // candidatos os cubos cujas caixas não estão totalmente fora. Subárvores totalmente
+    // dentro de todos os planos são aceitas sem mais testes.
+    void consultar_frustum(const Plano planos[6], std::vector<uint32_t>& candidatos) const {
+        if(nos.empty()) return;
+        struct Item { int no, mascara; };
+        Item pilha[64];
+        int topo = 0;
+        pilha[topo++] = { 0, 0x3F };
+
+        while(topo > 0) {
+            Item it = pilha[--topo];
+            const NoBVH& no = nos[it.no];
+            int mascara = it.mascara;
+            bool fora = false;
+
+            for(int pl = 0; pl < 6 && !fora; pl++) {
+                if(!(mascara & (1 << pl))) continue;
+                const Plano& p = planos[pl];
+                // Vértice mais "para dentro" (p) e mais "para fora" (n) da caixa em relação ao plano
+                float dp = p.a*(p.a > 0 ? no.caixa.max[0] : no.caixa.min[0]) + p.b*(p.b > 0 ? no.caixa.max[1] : no.caixa.min[1])
+                         + p.c*(p.c > 0 ? no.caixa.max[2] : no.caixa.min[2]) + p.d;
+                if(dp < 0) { fora = true; break; }
+                float dn = p.a*(p.a > 0 ? no.caixa.min[0] : no.caixa.max[0]) + p.b*(p.b > 0 ? no.caixa.min[1] : no.caixa.max[1])
+                         + p.c*(p.c > 0 ? no.caixa.min[2] : no.caixa.max[2]) + p.d;
+                if(dn >= 0) mascara &= ~(1 << pl);
+            }
+            if(fora) continue;
+
+            if(mascara == 0 || no.esquerda < 0) {
+                candidatos.insert(candidatos.end(), objetos.begin() + no.inicio, objetos.begin() + no.inicio + no.quantidade);
+            } else {
+                pilha[topo++] = { no.direita, mascara };
+                pilha[topo++] = { no.esquerda, mascara };
+            }
+        }
+    }
+
+private:
+    int construir_no(int inicio, int quantidade, int pai) {
+        int id = (int)nos.size();
+        nos.push_back(NoBVH());
+        nos[id].pai = pai;
+        nos[id].inicio = inicio;
+        nos[id].quantidade = quantidade;
+        nos[id].caixa.vazia();
+        for(int i = inicio; i < inicio + quantidade; i++) nos[id].caixa.unir(caixas[objetos[i]]);
+
+        if(quantidade <= MAX_FOLHA) {
+            nos[id].esquerda = nos[id].direita = -1;
+            for(int i = inicio; i < inicio + quantidade; i++) folha_do_objeto[objetos[i]] = id;
+            return id;
+        }
+
+        // Eixo de maior extensão dos centros
+        float cmin[3] = { 1e30f, 1e30f, 1e30f }, cmax[3] = { -1e30f, -1e30f, -1e30f };
+        for(int i = inicio; i < inicio + quantidade; i++) {
+            const CaixaAABB& b = caixas[objetos[i]];
+            for(int k = 0; k < 3; k++) {
+                float c = (b.min[k] + b.max[k]) * 0.5f;
+                cmin[k] = std::min(cmin[k], c); cmax[k] = std::max(cmax[k], c);
+            }
+        }
+        int eixo = 0;
+        for(int k = 1; k < 3; k++) if(cmax[k] - cmin[k] > cmax[eixo] - cmin[eixo]) eixo = k;
+
+        int meio = quantidade / 2;
+        std::nth_element(objetos.begin() + inicio, objetos.begin() + inicio + meio, objetos.begin() + inicio + quantidade,
+                         [&](uint32_t a, uint32_t b) {
+                             return caixas[a].min[eixo] + caixas[a].max[eixo] < caixas[b].min[eixo] + caixas[b].max[eixo];
+                         });
+
+        int esq = construir_no(inicio, meio, id);
+        int dir = construir_no(inicio + meio, quantidade - meio, id);
+        nos[id].esquerda = esq;
+        nos[id].direita = dir;
+        return id;
+    }
+};
+
+#endif
@@ -0,0 +1,205 @@
+/**
+ * EXPORTACAO_SHM.H
+ * Exportação dos frames prontos para outros processos da máquina por memória compartilhada POSIX
+ * (shm_open + mmap). O segmento tem um cabeçalho e um anel de N posições, cada uma com o número do
+ * frame, dimensões, instante e os pixels ARGB8888. Leitores mapeiam o segmento e leem os pixels
+ * direto dele, sem cópia nem serialização.
+ *
+ * O renderizador nunca espera um leitor: cada frame vai para a posição seguinte, sobrescrevendo a
+ * mais antiga. Cada posição é protegida por um contador de sequência (seqlock): ímpar enquanto está
+ * sendo escrita; o leitor confere que ele não mudou durante a leitura. Com um leitor conectado, ele
+ * publica até onde já leu, e o renderizador conta os frames sobrescritos antes de o leitor chegar a eles.
+ */
+
+#ifndef EXPORTACAO_SHM_H
+#define EXPORTACAO_SHM_H
+
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "instrumentacao.h"
+
+const uint32_t SHM_VERSAO = 1;
+const char* const SHM_NOME_PADRAO = "/modelador_quadros";
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "o anel compartilhado precisa de atômicos sem trava");
+
+// Cabeçalho de cada posição do anel (uma linha de cache). Os pixels vêm logo depois, alinhados a 4096.
+struct PosicaoShm {
+    std::atomic<uint64_t> sequencia;  // 2 * numero + 1 durante a escrita, 2 * numero + 2 quando pronto
+    uint64_t numero;                  // Índice do frame (a partir de 0)
+    int64_t instante_ns;              // CLOCK_MONOTONIC do momento em que o frame ficou pronto
+    uint32_t largura, altura, passo;  // passo em pixels por linha
+    uint32_t bytes;                   // Bytes válidos de pixels
+    uint8_t reservado[24];
+};
+static_assert(sizeof(PosicaoShm) == 64, "cabeçalho de posição deve ocupar uma linha de cache");
+
+struct CabecalhoShm {
+    char magica[4];                   // "QSHM"
+    uint32_t versao;
+    uint32_t n_posicoes;
+    uint32_t largura_max, altura_max; // Capacidade de cada posição
+    uint32_t formato;                 // 0: ARGB8888 (uint32_t por pixel, como o fb)
+    uint64_t bytes_posicao;           // Distância entre posições (cabeçalho + pixels)
+    uint64_t offset_posicoes;
+    std::atomic<uint64_t> publicados; // Frames escritos; o mais recente é publicados - 1
+    std::atomic<uint64_t> descartados; // Frames sobrescritos antes de o leitor chegar a eles
+    std::atomic<uint64_t> proximo_leitura; // Primeiro frame que o leitor ainda não consumiu
+    std::atomic<uint32_t> leitores;   // Leitores conectados (um leitor que morre sem fechar fica contado)
+};
+
+inline size_t alinhar_pagina(size_t n) { return (n + 4095) & ~(size_t)4095; }
+
+// Mapeamento do segmento (comum ao exportador e ao leitor)
+struct SegmentoShm {
+    std::string nome;
+    uint8_t* base = nullptr;
+    size_t tamanho = 0;
+
+    CabecalhoShm* cabecalho() const { return (CabecalhoShm*)base; }
+    PosicaoShm* posicao(uint64_t i) const {
+        const CabecalhoShm* c = cabecalho();
+        return (PosicaoShm*)(base + c->offset_posicoes + (i % c->n_posicoes) * c->bytes_posicao);
+    }
+    uint32_t* pixels(PosicaoShm* p) const { return (uint32_t*)((uint8_t*)p + 4096); }
+
+    SegmentoShm() {}
+    ~SegmentoShm() { if(base) munmap(base, tamanho); }
+    SegmentoShm(const SegmentoShm&) = delete;
+    SegmentoShm& operator=(const SegmentoShm&) = delete;
+};
+
+// --- LADO DO RENDERIZADOR ---
+
+struct ExportadorShm : SegmentoShm {
+    // Cria (ou recria) o segmento com n_posicoes de até largura x altura pixels
+    bool abrir(const char* nome_shm, int largura, int altura, int n_posicoes = 4) {
+        fechar();
+        nome = nome_shm;
+        shm_unlink(nome_shm); // Um segmento velho pode ter outro tamanho
+        int fd = shm_open(nome_shm, O_CREAT | O_RDWR, 0644);
+        if(fd < 0) return false;
+        const uint64_t bytes_posicao = 4096 + alinhar_pagina((size_t)largura * altura * 4);
+        tamanho = 4096 + bytes_posicao * n_posicoes;
+        void* mapa = MAP_FAILED;
+        if(ftruncate(fd, (off_t)tamanho) == 0) mapa = mmap(nullptr, tamanho, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(mapa == MAP_FAILED) { shm_unlink(nome_shm); tamanho = 0; return false; }
+        base = (uint8_t*)mapa;
+
+        // O segmento novo vem zerado; a mágica é escrita por último, quando tudo está válido
+        CabecalhoShm* c = cabecalho();
+        c->versao = SHM_VERSAO;
+        c->n_posicoes = n_posicoes;
+        c->largura_max = largura; c->altura_max = altura;
+        c->formato = 0;
+        c->bytes_posicao = bytes_posicao;
+        c->offset_posicoes = 4096;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(c->magica, "QSHM", 4);
+        return true;
+    }
+
+    void fechar() {
+        if(!base) return;
+        munmap(base, tamanho);
+        shm_unlink(nome.c_str());
+        base = nullptr;
+        tamanho = 0;
+    }
+
+    ~ExportadorShm() { fechar(); }
+
+    bool ativo() const { return base != nullptr; }
+
+    // Copia o frame para a próxima posição do anel e retorna seu número. Nunca bloqueia.
+    uint64_t publicar(const uint32_t* pixels_frame, int largura, int altura, int passo) {
+        CabecalhoShm* c = cabecalho();
+        uint64_t n = c->publicados.load(std::memory_order_relaxed);
+        PosicaoShm* p = posicao(n);
+
+        // A posição guarda o frame n - N: se o leitor ainda não chegou nele, ele se perde
+        if(n >= c->n_posicoes && c->leitores.load(std::memory_order_relaxed) > 0 &&
+           c->proximo_leitura.load(std::memory_order_acquire) <= n - c->n_posicoes)
+            c->descartados.fetch_add(1, std::memory_order_relaxed);
+
+        int w = std::min<int>(largura, c->largura_max), h = std::min<int>(altura, c->altura_max);
+        p->sequencia.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // A marca de escrita antes dos pixels
+        uint32_t* destino = pixels(p);
+        for(int y = 0; y < h; y++) std::memcpy(destino + (size_t)y * w, pixels_frame + (size_t)y * passo, (size_t)w * 4);
+        p->numero = n;
+        p->instante_ns = relogio_ns();
+        p->largura = w; p->altura = h; p->passo = w;
+        p->bytes = (uint32_t)((size_t)w * h * 4);
+        p->sequencia.store(2 * n + 2, std::memory_order_release);
+        c->publicados.store(n + 1, std::memory_order_release);
+        return n;
+    }
+
+    uint64_t descartados() const { return ativo() ? cabecalho()->descartados.load() : 0; }
+};
+
+// --- LADO DO LEITOR (outro processo) ---
+
+struct LeitorShm : SegmentoShm {
+    bool abrir(const char* nome_shm) {
+        nome = nome_shm;
+        int fd = shm_open(nome_shm, O_RDWR, 0);
+        if(fd < 0) return false;
+        struct stat st;
+        void* mapa = MAP_FAILED;
+        if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CabecalhoShm))
+            mapa = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(mapa == MAP_FAILED) return false;
+        base = (uint8_t*)mapa;
+        tamanho = (size_t)st.st_size;
+        const CabecalhoShm* c = cabecalho();
+        // Cada posição precisa caber largura_max x altura_max pixels e o anel inteiro precisa
+        // caber no segmento (sem multiplicação que possa transbordar)
+        const uint64_t minimo_posicao = 4096 + (uint64_t)c->largura_max * c->altura_max * 4;
+        if(std::memcmp(c->magica, "QSHM", 4) != 0 || c->versao != SHM_VERSAO ||
+           c->n_posicoes == 0 || c->bytes_posicao < minimo_posicao ||
+           c->offset_posicoes < sizeof(CabecalhoShm) || c->offset_posicoes > tamanho ||
+           c->n_posicoes > (tamanho - c->offset_posicoes) / c->bytes_posicao) {
+            munmap(base, tamanho);
+            base = nullptr;
+            return false;
+        }
+        // Conecta a partir do frame atual: o que já estava no anel não conta como perdido
+        cabecalho()->proximo_leitura.store(cabecalho()->publicados.load());
+        cabecalho()->leitores++;
+        return true;
+    }
+
+    ~LeitorShm() { if(base) cabecalho()->leitores--; }
+
+    // Frame mais recente publicado (publicados - 1), ou -1 se nenhum
+    int64_t mais_recente() const { return (int64_t)cabecalho()->publicados.load(std::memory_order_acquire) - 1; }
+
+    // Entrega o frame 'numero' a 'usar(posicao, pixels)' direto da memória compartilhada, sem cópia.
+    // Retorna false se ele já foi sobrescrito ou foi sobrescrito durante a leitura (o que 'usar'
+    // viu deve então ser descartado). Ao ler com sucesso, anuncia os frames até ele como consumidos.
+    template<class F>
+    bool ler(uint64_t numero, F&& usar) {
+        PosicaoShm* p = posicao(numero);
+        uint64_t s1 = p->sequencia.load(std::memory_order_acquire);
+        if(s1 != 2 * numero + 2) return false;
+        usar(*p, (const uint32_t*)pixels(p));
+        std::atomic_thread_fence(std::memory_order_acquire); // Leituras dos pixels antes da reconferência
+        if(p->sequencia.load(std::memory_order_relaxed) != s1) return false;
+        std::atomic<uint64_t>& proximo = cabecalho()->proximo_leitura;
+        if(proximo.load(std::memory_order_relaxed) <= numero) proximo.store(numero + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif
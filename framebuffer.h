@@ -0,0 +1,303 @@
+/**
+ * FRAMEBUFFER.H
+ * Layout alternativo do framebuffer e do Z-Buffer em tiles (Tiled Framebuffer).
+ * Em vez de linhas da tela inteira, os pixels ficam em blocos de TILE_FB x TILE_FB guardados
+ * contíguos (linha a linha dentro do bloco): um tile de cor e o de profundidade cabem na L1.
+ * Cada tile tem uma flag de validade, então limpar o frame é zerar as flags; um tile só é
+ * preenchido com a cor de fundo e Z_LIMPO quando o rasterizador vai escrever nele.
+ * A imagem volta ao formato linear ARGB apenas na hora de enviar para a textura (resolver).
+ * A profundidade pode ser guardada em 16 bits (metade da banda do float).
+ *
+ * Também aqui o framebuffer com várias amostras por pixel do MSAA (FramebufferMSAA), com a mesma
+ * limpeza por flags e a resolução para ARGB linear, e cores por amostra só nos pixels de borda.
+ */
+
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "simd.h"
+#include "thread_pool.h"
+#include "instrumentacao.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+
+const uint32_t COR_FUNDO = 0xFF222222; // Fundo Cinza Escuro
+const float Z_LIMPO = 1000.0f;          // Valor inicial do Z-Buffer
+
+// Lado dos tiles do framebuffer: 32x32 pixels = 4 KB de cor + 4 KB (ou 2 KB) de profundidade
+const int TILE_FB_LOG = 5;
+const int TILE_FB = 1 << TILE_FB_LOG;
+const int PIXELS_TILE_FB = TILE_FB * TILE_FB;
+static_assert(TILE_FB >= SIMD_LARGURA, "bloco SIMD maior que o tile do framebuffer");
+
+// Profundidade em 16 bits: guarda 1 - W_MIN/W (como o Z da projeção), que concentra a precisão
+// perto da câmera. W_MIN é o menor W que sobra após o recorte (o Z_NEAR do pipeline).
+const float PROF16_W_MIN = 0.1f;
+const uint16_t PROF16_LIMPO = 0xFFFF;   // Nenhum fragmento codifica para esse valor
+
+inline uint16_t prof16_codificar(float w) {
+    float q = (1.0f - PROF16_W_MIN / w) * 65534.0f;
+    return (uint16_t)std::min(std::max(q, 0.0f), 65534.0f);
+}
+
+// Mesma conta em SIMD; o resultado são inteiros guardados em float (exatos até 2^24)
+inline vfloat prof16_codificar(vfloat w) {
+    vfloat q = vf_mul(vf_sub(vf_set(1.0f), vf_div(vf_set(PROF16_W_MIN), w)), vf_set(65534.0f));
+    q = vf_min(vf_max(q, vf_set(0.0f)), vf_set(65534.0f));
+    return vi_para_vf(vf_para_vi_trunc(q));
+}
+
+// Formatos do framebuffer, parâmetros de template dos núcleos de rasterização: a ordem dos
+// pixels na memória e o tipo da profundidade. O índice de um pixel vale para cor, profundidade
+// e Visibility Buffer.
+struct FormatoLinear {
+    static const bool TILES = false, PROF16 = false;
+    static int indice(int x, int y, int largura, int) { return y * largura + x; }
+};
+
+struct FormatoTiles {
+    static const bool TILES = true, PROF16 = false;
+    static int indice(int x, int y, int, int tiles_x) {
+        int tile = (y >> TILE_FB_LOG) * tiles_x + (x >> TILE_FB_LOG);
+        return (tile << (2 * TILE_FB_LOG)) | ((y & (TILE_FB - 1)) << TILE_FB_LOG) | (x & (TILE_FB - 1));
+    }
+};
+
+struct FormatoTiles16 : FormatoTiles {
+    static const bool PROF16 = true;
+};
+
+struct FramebufferTiles {
+    int largura = 0, altura = 0;
+    int tiles_x = 0, tiles_y = 0;
+    bool prof16 = false;
+    std::vector<uint32_t> cor;
+    std::vector<float> prof;
+    std::vector<uint16_t> prof_16;
+    std::vector<uint8_t> valido;    // 0: o conteúdo do tile é lixo (ainda não limpo neste frame)
+
+    // Ajusta a resolução e o tipo da profundidade; só realoca quando algo muda.
+    void configurar(int w, int h, bool usar_prof16) {
+        if(w == largura && h == altura && usar_prof16 == prof16 && !valido.empty()) return;
+        largura = w; altura = h; prof16 = usar_prof16;
+        tiles_x = (w + TILE_FB - 1) / TILE_FB;
+        tiles_y = (h + TILE_FB - 1) / TILE_FB;
+        size_t n = (size_t)tiles_x * tiles_y * PIXELS_TILE_FB;
+        cor.resize(n);
+        if(prof16) { prof_16.resize(n); prof.clear(); prof.shrink_to_fit(); }
+        else { prof.resize(n); prof_16.clear(); prof_16.shrink_to_fit(); }
+        valido.assign(tiles_x * tiles_y, 0);
+    }
+
+    // Limpeza do frame: só as flags
+    void limpar() { std::fill(valido.begin(), valido.end(), 0); }
+
+    bool tile_valido(int x, int y) const { return valido[(y >> TILE_FB_LOG) * tiles_x + (x >> TILE_FB_LOG)]; }
+
+    // Limpa de fato o tile t, se ainda não foi limpo neste frame
+    void preparar_tile(int t) {
+        if(valido[t]) return;
+        size_t base = (size_t)t * PIXELS_TILE_FB;
+        std::fill(cor.begin() + base, cor.begin() + base + PIXELS_TILE_FB, COR_FUNDO);
+        if(prof16) std::fill(prof_16.begin() + base, prof_16.begin() + base + PIXELS_TILE_FB, PROF16_LIMPO);
+        else std::fill(prof.begin() + base, prof.begin() + base + PIXELS_TILE_FB, Z_LIMPO);
+        valido[t] = 1;
+    }
+
+    // Prepara os tiles que o retângulo (inclusivo, em pixels, já dentro da tela) toca
+    void preparar_retangulo(int x0, int y0, int x1, int y1) {
+        for(int ty = y0 >> TILE_FB_LOG; ty <= (y1 >> TILE_FB_LOG); ty++)
+            for(int tx = x0 >> TILE_FB_LOG; tx <= (x1 >> TILE_FB_LOG); tx++) preparar_tile(ty * tiles_x + tx);
+    }
+
+    // Converte para ARGB linear em 'destino' (passo: distância entre linhas, em pixels).
+    // Tiles não tocados no frame viram a cor de fundo sem serem lidos.
+    void resolver(uint32_t* destino, int passo, PoolThreads& pool) const {
+        pool.executar(tiles_y, [&](int ty) {
+            int y0 = ty * TILE_FB, y1 = std::min(y0 + TILE_FB, altura);
+            for(int tx = 0; tx < tiles_x; tx++) {
+                int x0 = tx * TILE_FB, n = std::min(TILE_FB, largura - x0);
+                int t = ty * tiles_x + tx;
+                const uint32_t* src = cor.data() + (size_t)t * PIXELS_TILE_FB;
+                for(int y = y0; y < y1; y++) {
+                    uint32_t* linha = destino + (size_t)y * passo + x0;
+                    if(valido[t]) std::memcpy(linha, src + ((y - y0) << TILE_FB_LOG), n * sizeof(uint32_t));
+                    else std::fill(linha, linha + n, COR_FUNDO);
+                }
+            }
+        });
+    }
+};
+
+// ==========================================
+//   MSAA (MULTISAMPLE ANTI-ALIASING)
+// ==========================================
+// AMOSTRAS_MSAA posições de cobertura e profundidade por pixel, no padrão de grade rotacionada 4x
+// (em pixels, a partir do canto do pixel; todas múltiplas de 1/8). O Pixel Shader roda uma vez por
+// pixel e triângulo, e a cor vai para as amostras que o triângulo cobriu (ver fill_edge_msaa).
+const int AMOSTRAS_MSAA = 4;
+const float POSICOES_MSAA[AMOSTRAS_MSAA][2] = { {0.375f, 0.125f}, {0.875f, 0.375f}, {0.125f, 0.625f}, {0.625f, 0.875f} };
+
+const uint8_t AMOSTRAS_TODAS = (1 << AMOSTRAS_MSAA) - 1;
+
+// Por pixel, uma cor e uma máscara com as amostras que ela cobre (as demais são fundo), as
+// profundidades das amostras em 16 bits, codificadas como em FramebufferTiles com prof16, e a maior
+// delas: 15 bytes, contra 32 do supersampling 4x. Só um pixel que recebe uma segunda cor (a borda
+// entre dois triângulos) é expandido: as cores das suas amostras vão para o vetor de expansão da
+// thread que o desenha, e a cor do pixel passa a guardar o índice delas (thread nos bits altos).
+// Esses vetores só crescem, então em regime a expansão não aloca.
+// A profundidade fica em blocos de SIMD_LARGURA pixels consecutivos de uma linha: no bloco vêm as
+// SIMD_LARGURA profundidades da amostra 0, as da amostra 1, e assim por diante, de modo que cada
+// amostra de um bloco é um único vetor. As linhas são completadas até um múltiplo de SIMD_LARGURA,
+// então nenhum bloco passa do fim da linha. Como em FramebufferTiles, cada bloco tem uma flag de
+// validade: limpar é zerar as flags, e a resolução pinta o fundo nos blocos não tocados.
+// prof_max guarda a maior profundidade das amostras de cada pixel, que fill_edge_msaa usa para
+// rejeitar o bloco sem ler as amostras.
+struct FramebufferMSAA {
+    static const int VALORES_BLOCO = SIMD_LARGURA * AMOSTRAS_MSAA;
+    static const uint8_t EXPANDIDO = 0x80;  // Bit da máscara: a cor do pixel é um índice de expansão
+    static const int BITS_POSICAO = 24;     // Índice de expansão: thread << BITS_POSICAO | pixel expandido
+    int largura = 0, altura = 0;
+    int blocos_x = 0;
+    std::vector<uint32_t> cor;          // Um valor por pixel, no passo de blocos_x * SIMD_LARGURA
+    std::vector<uint8_t> mascara;       // Amostras cobertas de cada pixel (mais EXPANDIDO)
+    std::vector<uint16_t> prof;
+    std::vector<uint16_t> prof_max;
+    std::vector<std::vector<uint32_t>> expandidas; // Por thread: AMOSTRAS_MSAA cores por pixel expandido
+    std::vector<uint8_t> valido;
+
+    void configurar(int w, int h, int threads) {
+        if((int)expandidas.size() != threads) expandidas.resize(threads);
+        if(w == largura && h == altura && !valido.empty()) return;
+        largura = w; altura = h;
+        blocos_x = (w + SIMD_LARGURA - 1) / SIMD_LARGURA;
+        size_t blocos = (size_t)blocos_x * h;
+        cor.resize(blocos * SIMD_LARGURA);
+        mascara.resize(blocos * SIMD_LARGURA);
+        prof.resize(blocos * VALORES_BLOCO);
+        prof_max.resize(blocos * SIMD_LARGURA);
+        valido.assign(blocos, 0);
+    }
+
+    void limpar() {
+        std::fill(valido.begin(), valido.end(), 0);
+        for(std::vector<uint32_t>& v : expandidas) v.clear();
+    }
+
+    // Bytes ocupados, contando a capacidade dos vetores de expansão
+    size_t memoria() const {
+        size_t n = cor.size() * 4 + mascara.size() + (prof.size() + prof_max.size()) * 2 + valido.size();
+        for(const std::vector<uint32_t>& v : expandidas) n += v.capacity() * 4;
+        return n;
+    }
+
+    // Bloco que contém o pixel (x, y)
+    int bloco(int x, int y) const { return y * blocos_x + x / SIMD_LARGURA; }
+    uint16_t* prof_bloco(int b) { return prof.data() + (size_t)b * VALORES_BLOCO; }
+    uint16_t* prof_max_bloco(int b) { return prof_max.data() + (size_t)b * SIMD_LARGURA; }
+    uint32_t* cor_bloco(int b) { return cor.data() + (size_t)b * SIMD_LARGURA; }
+    uint8_t* mascara_bloco(int b) { return mascara.data() + (size_t)b * SIMD_LARGURA; }
+
+    // Limpa de fato o bloco b, se ainda não foi limpo neste frame. A cor não: com a máscara zerada,
+    // todas as amostras valem o fundo.
+    void preparar_bloco(int b) {
+        if(valido[b]) return;
+        std::fill(prof_bloco(b), prof_bloco(b) + VALORES_BLOCO, PROF16_LIMPO);
+        std::fill(prof_max_bloco(b), prof_max_bloco(b) + SIMD_LARGURA, PROF16_LIMPO);
+        std::fill(mascara_bloco(b), mascara_bloco(b) + SIMD_LARGURA, 0);
+        valido[b] = 1;
+    }
+
+    // Grava a cor c nas amostras 'amostras' do pixel i (índice em cor). Enquanto o pixel tem uma só
+    // cor além do fundo basta a máscara; uma cor diferente expande o pixel no vetor de 'thread'.
+    void gravar(size_t i, uint32_t c, unsigned amostras, int thread) {
+        uint8_t& m = mascara[i];
+        if(!(m & AMOSTRAS_TODAS & ~amostras)) {
+            // Nenhuma amostra coberta fica de fora (vale também para um pixel expandido)
+            cor[i] = c;
+            m = amostras;
+        } else if(m & EXPANDIDO) {
+            uint32_t* a = expandidas[cor[i] >> BITS_POSICAO].data() + posicao_expandida(cor[i]);
+            for(int s = 0; s < AMOSTRAS_MSAA; s++) if(amostras & (1 << s)) a[s] = c;
+            m |= amostras;
+        } else if(cor[i] == c) {
+            m |= amostras;
+        } else {
+            std::vector<uint32_t>& v = expandidas[thread];
+            uint32_t pixel = (uint32_t)(v.size() / AMOSTRAS_MSAA);
+            for(int s = 0; s < AMOSTRAS_MSAA; s++)
+                v.push_back((amostras & (1 << s)) ? c : (m & (1 << s)) ? cor[i] : COR_FUNDO);
+            cor[i] = ((uint32_t)thread << BITS_POSICAO) | pixel;
+            m |= amostras | EXPANDIDO;
+        }
+    }
+
+    // Posição das cores de um pixel expandido no vetor da sua thread
+    static size_t posicao_expandida(uint32_t indice) { return (size_t)(indice & ((1u << BITS_POSICAO) - 1)) * AMOSTRAS_MSAA; }
+
+    // Pixels do retângulo [x0,x1) x [y0,y1) com alguma amostra coberta
+    long long pixels_cobertos(int x0, int y0, int x1, int y1) const {
+        long long n = 0;
+        for(int y = y0; y < y1; y++) {
+            for(int x = x0; x < x1; x++) {
+                if(!valido[bloco(x, y)]) continue;
+                n += mascara[(size_t)y * blocos_x * SIMD_LARGURA + x] != 0;
+            }
+        }
+        return n;
+    }
+
+    // Média das amostras de cada pixel em ARGB linear (passo: distância entre linhas, em pixels).
+    // Amostras fora da máscara entram com a cor de fundo. Um bloco com as amostras de todos os
+    // pixels cobertas por uma só cor é copiado direto; nos demais, vermelho e azul, e alfa e verde,
+    // são somados aos pares em campos de 16 bits (4 x 255 cabe), com arredondamento: um pixel com
+    // as quatro amostras iguais mantém exatamente a cor.
+    // 'calor' (opcional, linear) troca os pixels com fragmentos aprovados pelo mapa de calor.
+    void resolver(uint32_t* destino, int passo, const uint8_t* calor, PoolThreads& pool) const {
+        const int W = SIMD_LARGURA, S = AMOSTRAS_MSAA, LINHAS_TAREFA = 8;
+        pool.executar((altura + LINHAS_TAREFA - 1) / LINHAS_TAREFA, [&](int t) {
+            const vint par = vi_set(0x00FF00FFu), arred = vi_set(0x00020002u);
+            uint32_t tmp[W], amostra[S][W];
+            for(int y = t * LINHAS_TAREFA; y < std::min(altura, (t + 1) * LINHAS_TAREFA); y++) {
+                uint32_t* linha = destino + (size_t)y * passo;
+                for(int bx = 0; bx < blocos_x; bx++) {
+                    int x = bx * W, n = std::min(W, largura - x);
+                    int b = y * blocos_x + bx;
+                    if(!valido[b]) { std::fill(linha + x, linha + x + n, COR_FUNDO); continue; }
+                    const uint32_t* c = cor.data() + (size_t)b * W;
+                    const uint8_t* m = mascara.data() + (size_t)b * W;
+                    bool cheio = true;
+                    for(int i = 0; i < W; i++) cheio &= m[i] == AMOSTRAS_TODAS;
+                    if(cheio) { std::memcpy(linha + x, c, n * sizeof(uint32_t)); continue; }
+                    for(int i = 0; i < W; i++) {
+                        if(m[i] & EXPANDIDO) {
+                            const uint32_t* a = expandidas[c[i] >> BITS_POSICAO].data() + posicao_expandida(c[i]);
+                            for(int s = 0; s < S; s++) amostra[s][i] = a[s];
+                        } else {
+                            for(int s = 0; s < S; s++) amostra[s][i] = (m[i] & (1 << s)) ? c[i] : COR_FUNDO;
+                        }
+                    }
+                    vint rb = vi_set(0), ag = vi_set(0);
+                    for(int s = 0; s < S; s++) {
+                        vint a = vi_load(amostra[s]);
+                        rb = vi_add(rb, vi_and(a, par));
+                        ag = vi_add(ag, vi_and(vi_shr<8>(a), par));
+                    }
+                    rb = vi_and(vi_shr<2>(vi_add(rb, arred)), par);
+                    ag = vi_and(vi_shr<2>(vi_add(ag, arred)), par);
+                    vint media = vi_or(vi_shl<8>(ag), rb);
+                    if(n == W) vi_store(linha + x, media);
+                    else { vi_store(tmp, media); std::memcpy(linha + x, tmp, n * sizeof(uint32_t)); }
+                }
+                if(calor) {
+                    const uint8_t* cl = calor + (size_t)y * largura;
+                    for(int x = 0; x < largura; x++) if(cl[x]) linha[x] = cor_calor(cl[x]);
+                }
+            }
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,93 @@
+/**
+ * HIZ.H
+ * Z-Buffer hierárquico (Hi-Z) para Occlusion Culling.
+ * Cada nível guarda a profundidade MÁXIMA (mais distante) de blocos 2x2 do nível anterior.
+ * Um objeto cuja profundidade mais próxima está atrás do máximo de todos os texels que
+ * cobrem seu retângulo de tela está garantidamente oculto e pode ser descartado.
+ */
+
+#ifndef HIZ_H
+#define HIZ_H
+
+#include "math_utils.h"
+#include <vector>
+#include <algorithm>
+
+struct PiramideZ {
+    std::vector<std::vector<float>> niveis; // niveis[0] tem a resolução da tela
+    std::vector<int> larguras, alturas;
+
+    // Constrói a pirâmide a partir de um Z-Buffer de resolução largura x altura.
+    void construir(const std::vector<float>& zb, int largura, int altura) {
+        int w = largura, h = altura;
+        if(niveis.empty() || larguras[0] != w || alturas[0] != h) {
+            // Aloca os níveis só quando a resolução muda
+            niveis.clear(); larguras.clear(); alturas.clear();
+            while(true) {
+                larguras.push_back(w); alturas.push_back(h);
+                niveis.push_back(std::vector<float>(w * h));
+                if(w == 1 && h == 1) break;
+                w = (w + 1) / 2; h = (h + 1) / 2;
+            }
+        }
+        niveis[0] = zb;
+
+        for(size_t n = 1; n < niveis.size(); n++) {
+            const std::vector<float>& ant = niveis[n-1];
+            std::vector<float>& atual = niveis[n];
+            int wa = larguras[n-1], ha = alturas[n-1];
+            for(int y = 0; y < alturas[n]; y++) {
+                int y0 = y*2, y1 = std::min(y*2 + 1, ha - 1);
+                for(int x = 0; x < larguras[n]; x++) {
+                    int x0 = x*2, x1 = std::min(x*2 + 1, wa - 1);
+                    atual[y * larguras[n] + x] = std::max(std::max(ant[y0*wa + x0], ant[y0*wa + x1]),
+                                                          std::max(ant[y1*wa + x0], ant[y1*wa + x1]));
+                }
+            }
+        }
+    }
+
+    // Retângulo inclusivo em pixels, já limitado à tela. Escolhe o nível em que o retângulo
+    // cobre no máximo ~4x4 texels e compara z_min com o máximo desses texels.
+    bool ocluido(int x0, int y0, int x1, int y1, float z_min) const {
+        if(niveis.empty()) return false;
+        int nivel = 0;
+        int extensao = std::max(x1 - x0, y1 - y0);
+        while(extensao > 4 && nivel + 1 < (int)niveis.size()) { extensao >>= 1; nivel++; }
+
+        const std::vector<float>& z = niveis[nivel];
+        int w = larguras[nivel];
+        for(int y = y0 >> nivel; y <= (y1 >> nivel); y++)
+            for(int x = x0 >> nivel; x <= (x1 >> nivel); x++)
+                if(z[y * w + x] >= z_min) return false; // Algum ponto do oclusor está atrás: pode aparecer
+        return true;
+    }
+};
+
+// Retângulo de tela (inclusivo) e profundidade mais próxima de uma esfera no View Space.
+// Usa os 8 cantos da caixa que envolve a esfera: a projeção da esfera fica dentro da
+// projeção desses cantos. Retorna false se a esfera cruza o plano near (sem teste seguro).
+inline bool retangulo_esfera(const Vec4& centro, float raio, const Mat4& proj,
+                             int vp_x, int vp_y, int vp_w, int vp_h, int largura, int altura, float z_near,
+                             int& x0, int& y0, int& x1, int& y1, float& z_min) {
+    z_min = -centro.z - raio;
+    if(z_min <= z_near) return false;
+
+    float min_x = 1e30f, min_y = 1e30f, max_x = -1e30f, max_y = -1e30f;
+    for(int i = 0; i < 8; i++) {
+        Vec4 c(centro.x + ((i & 1) ? raio : -raio), centro.y + ((i & 2) ? raio : -raio), centro.z + ((i & 4) ? raio : -raio));
+        Vec4 pc = proj * c;
+        float sx = (pc.x / pc.w + 1) * 0.5f * vp_w + vp_x;
+        float sy = (1 - pc.y / pc.w) * 0.5f * vp_h + vp_y;
+        min_x = std::min(min_x, sx); max_x = std::max(max_x, sx);
+        min_y = std::min(min_y, sy); max_y = std::max(max_y, sy);
+    }
+    // Margem de 1 pixel para cobrir o arredondamento do Viewport Transform
+    x0 = std::max((int)std::floor(min_x) - 1, 0);
+    y0 = std::max((int)std::floor(min_y) - 1, 0);
+    x1 = std::min((int)std::ceil(max_x) + 1, largura - 1);
+    y1 = std::min((int)std::ceil(max_y) + 1, altura - 1);
+    return x0 <= x1 && y0 <= y1;
+}
+
+#endif
@@ -0,0 +1,157 @@
+/**
+ * INSTRUMENTACAO.H
+ * Medição do pipeline: tempo gasto em cada etapa do frame, fragmentos testados no Z-Buffer e
+ * mapa de calor do overdraw, ligados em tempo de execução, e um trace por thread no formato do
+ * Chrome (chrome://tracing ou ui.perfetto.dev) gravado em JSON para análise offline.
+ * Compilado com -DINSTRUMENTACAO=0 (make INSTRUMENTACAO=0), os pontos de medição e os contadores
+ * dos rasterizadores somem do código: desligada assim, a instrumentação não custa nada.
+ */
+
+#ifndef INSTRUMENTACAO_H
+#define INSTRUMENTACAO_H
+
+#ifndef INSTRUMENTACAO
+#define INSTRUMENTACAO 1
+#endif
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+// Etapas medidas. Recorte e projeção são feitos juntos, triângulo a triângulo, em processar_objeto;
+// no Forward o Pixel Shader roda dentro do rasterizador, então "sombreamento" é só a 2ª passada
+// do Deferred e a iluminação Flat com luzes pontuais. "sombras" é só a renderização das faces
+// obsoletas do mapa de sombras; a consulta ao mapa faz parte do Pixel Shader.
+enum EtapaFrame {
+    ETAPA_LIMPEZA, ETAPA_CULLING, ETAPA_VERTICES, ETAPA_RECORTE, ETAPA_LUZES, ETAPA_SOMBRAS,
+    ETAPA_RASTER, ETAPA_SOMBREAMENTO, ETAPA_RESOLVER, ETAPA_APRESENTAR, N_ETAPAS
+};
+
+const char* const NOMES_ETAPAS[N_ETAPAS] = {
+    "limpeza", "culling", "vertices", "recorte", "luzes", "sombras", "raster", "sombreamento", "resolver", "apresentar"
+};
+
+inline int64_t relogio_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Identificador pequeno da thread atual (ordem do primeiro uso), usado como "tid" no trace
+inline int id_thread_trace() {
+    static std::atomic<int> proximo(0);
+    thread_local int id = proximo++;
+    return id;
+}
+
+struct EventoTrace {
+    int64_t inicio_ns, dur_ns;
+    uint32_t frame;
+    uint16_t etapa, thread;
+};
+
+struct Instrumentacao {
+    bool ativo = false;              // Medição do frame atual (ver iniciar_frame)
+    std::atomic<bool> gravando{false}; // Guardando eventos para o trace (lido também pela thread principal)
+    std::atomic<uint32_t> frame{0};
+    std::atomic<int64_t> ns[N_ETAPAS]; // Tempo acumulado do frame por etapa (soma das threads)
+    std::mutex mtx;                  // Protege eventos
+    std::vector<EventoTrace> eventos;
+    const char* arquivo_trace = "trace.json";
+
+    Instrumentacao() { for(auto& t : ns) t = 0; }
+
+    // Sair com a gravação ligada (sem passar pelo J) não perde a captura: o que ficou é gravado aqui
+    ~Instrumentacao() { if(!eventos.empty()) salvar_trace(); }
+
+    // Liga ou desliga a medição do próximo frame. Quando o trace para de ser gravado, os eventos
+    // acumulados são escritos em arquivo_trace (ou no destrutor, se o programa terminar antes).
+    void iniciar_frame(bool medir, bool gravar_trace) {
+        ativo = INSTRUMENTACAO && (medir || gravar_trace);
+        if(gravando && !gravar_trace) salvar_trace();
+        gravando = ativo && gravar_trace;
+        frame++;
+    }
+
+    // Passa os tempos acumulados (em ms) para 'ms' e zera os acumuladores
+    void fechar_frame(double* ms) {
+        for(int i = 0; i < N_ETAPAS; i++) ms[i] = ns[i].exchange(0) * 1e-6;
+    }
+
+    // Só o evento do trace, sem somar no frame (etapas de outra thread, como a apresentação)
+    void evento(EtapaFrame etapa, int64_t inicio, int64_t fim) {
+        if(!gravando) return;
+        EventoTrace ev = { inicio, fim - inicio, frame, (uint16_t)etapa, (uint16_t)id_thread_trace() };
+        std::lock_guard<std::mutex> lock(mtx);
+        eventos.push_back(ev);
+    }
+
+    void registrar(EtapaFrame etapa, int64_t inicio, int64_t fim) {
+        ns[etapa] += fim - inicio;
+        evento(etapa, inicio, fim);
+    }
+
+    // Trace Event Format: um evento completo ("ph":"X") por medição, tempos em microssegundos
+    bool salvar_trace() {
+        std::lock_guard<std::mutex> lock(mtx);
+        FILE* f = std::fopen(arquivo_trace, "w");
+        if(!f) return false;
+        int64_t base = eventos.empty() ? 0 : eventos[0].inicio_ns;
+        for(const EventoTrace& ev : eventos) base = std::min(base, ev.inicio_ns);
+        std::fprintf(f, "{\"traceEvents\":[\n");
+        for(size_t i = 0; i < eventos.size(); i++) {
+            const EventoTrace& ev = eventos[i];
+            std::fprintf(f, "{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}%s\n",
+                         NOMES_ETAPAS[ev.etapa], ev.thread, (ev.inicio_ns - base) * 1e-3, ev.dur_ns * 1e-3,
+                         ev.frame, i + 1 < eventos.size() ? "," : "");
+        }
+        std::fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+        std::fclose(f);
+        std::printf("\nTrace com %zu eventos gravado em %s\n", eventos.size(), arquivo_trace);
+        eventos.clear();
+        return true;
+    }
+};
+
+// Mede o escopo em que é declarado (só se a medição do frame estiver ligada)
+struct MedidorEtapa {
+    Instrumentacao* instr;
+    EtapaFrame etapa;
+    int64_t inicio;
+
+    MedidorEtapa(Instrumentacao& i, EtapaFrame e) : instr(i.ativo ? &i : nullptr), etapa(e), inicio(instr ? relogio_ns() : 0) {}
+    ~MedidorEtapa() { if(instr) instr->registrar(etapa, inicio, relogio_ns()); }
+};
+
+#define INSTR_CONCAT2(a, b) a##b
+#define INSTR_CONCAT(a, b) INSTR_CONCAT2(a, b)
+#if INSTRUMENTACAO
+#define MEDIR_ETAPA(instr, etapa) MedidorEtapa INSTR_CONCAT(medidor_, __LINE__)(instr, etapa)
+#else
+#define MEDIR_ETAPA(instr, etapa) ((void)0)
+#endif
+
+// Texto "etapa ms | etapa ms | ..." com as etapas que tiveram tempo
+inline void formatar_etapas(char* buf, size_t n, const double* ms) {
+    size_t usado = 0;
+    buf[0] = 0;
+    for(int i = 0; i < N_ETAPAS && usado < n; i++) {
+        if(ms[i] <= 0) continue;
+        usado += std::snprintf(buf + usado, n - usado, "%s%s %.2f", usado ? " | " : "", NOMES_ETAPAS[i], ms[i]);
+    }
+}
+
+// Cor do mapa de calor para n >= 1 fragmentos aprovados em um pixel: azul (1) até vermelho (7)
+// e branco a partir de 8
+inline uint32_t cor_calor(int n) {
+    static const uint32_t rampa[] = {
+        0xFF1030A0, 0xFF1080E0, 0xFF10C060, 0xFF90E010, 0xFFF0E010, 0xFFF09010, 0xFFF03010, 0xFFFFFFFF
+    };
+    const int ultimo = sizeof(rampa) / sizeof(rampa[0]) - 1;
+    return rampa[n - 1 < ultimo ? n - 1 : ultimo];
+}
+
+#endif
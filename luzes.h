@@ -0,0 +1,115 @@
+/**
+ * LUZES.H
+ * Culling de luzes pontuais por tile (Tiled Light Culling).
+ * A tela é dividida em tiles de TILE_LUZ x TILE_LUZ pixels. Cada tile guarda a faixa de
+ * profundidade da geometria que o cobre neste frame e a lista das luzes cuja esfera de alcance
+ * toca esse volume (retângulo do tile x faixa de profundidade). O Pixel Shader avalia apenas
+ * as luzes do tile do pixel, em vez de todas as luzes da cena.
+ */
+
+#ifndef LUZES_H
+#define LUZES_H
+
+#include "math_utils.h"
+#include "hiz.h"
+#include <vector>
+#include <algorithm>
+
+// Lado dos tiles de luz. Com TILE_LUZ >= SIMD_LARGURA, um bloco de pixels do rasterizador
+// de arestas toca no máximo dois tiles vizinhos na horizontal.
+const int TILE_LUZ = 32;
+static_assert(TILE_LUZ >= SIMD_LARGURA, "bloco SIMD maior que o tile de luz");
+
+// Luz pontual já no View Space, no formato usado pelo Pixel Shader.
+struct LuzVisao {
+    float x, y, z;
+    float raio;
+    float inv_raio2;    // 1 / raio², para a atenuação
+    float cor[3];
+};
+
+struct GradeLuzes {
+    int largura = 0, altura = 0;                 // Resolução do framebuffer do frame
+    int tiles_x = 0, tiles_y = 0;
+    std::vector<LuzVisao> luzes;                 // Mesma ordem de Cena::luzes
+    std::vector<float> z_min, z_max;             // Faixa de profundidade (W) da geometria de cada tile
+    std::vector<std::vector<uint32_t>> listas;   // Luzes de cada tile, em ordem crescente de índice
+
+    bool vazia() const { return luzes.empty(); }
+
+    // Lista do tile que contém o pixel (x, y)
+    int tile_do_pixel(int x, int y) const { return (y / TILE_LUZ) * tiles_x + x / TILE_LUZ; }
+    const std::vector<uint32_t>& lista_pixel(int x, int y) const { return listas[tile_do_pixel(x, y)]; }
+
+    // Início do frame: leva as luzes para o View Space e zera as faixas de profundidade.
+    void preparar(const std::vector<LuzPontual>& cena_luzes, const Mat4& view, int largura_fb, int altura_fb) {
+        luzes.resize(cena_luzes.size());
+        for(size_t i = 0; i < cena_luzes.size(); i++) {
+            const LuzPontual& l = cena_luzes[i];
+            Vec4 v = view * l.pos;
+            LuzVisao& lv = luzes[i];
+            lv.x = v.x; lv.y = v.y; lv.z = v.z;
+            lv.raio = l.raio;
+            lv.inv_raio2 = 1.0f / (l.raio * l.raio);
+            lv.cor[0] = l.cor.x; lv.cor[1] = l.cor.y; lv.cor[2] = l.cor.z;
+        }
+        if(luzes.empty()) return;
+
+        largura = largura_fb; altura = altura_fb;
+        tiles_x = (largura + TILE_LUZ - 1) / TILE_LUZ;
+        tiles_y = (altura + TILE_LUZ - 1) / TILE_LUZ;
+        z_min.assign(tiles_x * tiles_y, 1e30f);
+        z_max.assign(tiles_x * tiles_y, -1e30f);
+        listas.resize(tiles_x * tiles_y);
+    }
+
+    // Acrescenta à faixa de profundidade dos tiles do retângulo (inclusivo, em pixels) a de um
+    // triângulo. Um tile sem nenhum triângulo fica com z_min > z_max e não recebe luzes.
+    void expandir(int x0, int y0, int x1, int y1, float zmin, float zmax) {
+        x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+        x1 = std::min(x1, largura - 1); y1 = std::min(y1, altura - 1);
+        if(x0 > x1 || y0 > y1) return;
+        for(int ty = y0 / TILE_LUZ; ty <= y1 / TILE_LUZ; ty++) {
+            for(int tx = x0 / TILE_LUZ; tx <= x1 / TILE_LUZ; tx++) {
+                int k = ty * tiles_x + tx;
+                z_min[k] = std::min(z_min[k], zmin);
+                z_max[k] = std::max(z_max[k], zmax);
+            }
+        }
+    }
+
+    // Monta as listas: a esfera de cada luz é projetada em um retângulo de tela (como no Hi-Z) e
+    // testada contra a faixa de profundidade de cada tile coberto. Sem 'culling', todo tile com
+    // geometria recebe todas as luzes (laço ingênuo, para comparação).
+    // Retorna o total de pares (tile, luz).
+    long long distribuir(const Mat4& proj, int vp_x, int vp_y, int vp_w, int vp_h, float z_near, bool culling) {
+        for(auto& l : listas) l.clear();
+        long long pares = 0;
+        for(uint32_t i = 0; i < luzes.size(); i++) {
+            const LuzVisao& l = luzes[i];
+            float prof = -l.z; // Profundidade do centro (W)
+            int x0 = 0, y0 = 0, x1 = largura - 1, y1 = altura - 1;
+            if(culling) {
+                if(prof + l.raio <= z_near) continue; // Inteira atrás do near
+                float zm;
+                if(!retangulo_esfera(Vec4(l.x, l.y, l.z), l.raio, proj, vp_x, vp_y, vp_w, vp_h, largura, altura, z_near,
+                                     x0, y0, x1, y1, zm)) {
+                    if(prof - l.raio > z_near) continue; // À frente do near, mas fora da tela
+                    x0 = 0; y0 = 0; x1 = largura - 1; y1 = altura - 1; // Cruza o near: sem retângulo seguro
+                }
+            }
+            for(int ty = y0 / TILE_LUZ; ty <= y1 / TILE_LUZ; ty++) {
+                for(int tx = x0 / TILE_LUZ; tx <= x1 / TILE_LUZ; tx++) {
+                    int k = ty * tiles_x + tx;
+                    if(z_min[k] > z_max[k]) continue;
+                    if(culling && (prof + l.raio < z_min[k] || prof - l.raio > z_max[k])) continue;
+                    listas[k].push_back(i);
+                    pares++;
+                }
+            }
+        }
+        return pares;
+    }
+};
+
+#endif
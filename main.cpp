@@ -10,16 +10,17 @@
 #include <cstdio>
 #include <ctime>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
-#include "rasterizer.h" 
+#include "pipeline.h"
+#include "resolucao.h"
+#include "produtor_frames.h"
+#include "arquivo_cena.h"
+#include "exportacao_shm.h"
 
 const int TARGET_FPS = 60;
 const int FRAME_DELAY = 1000 / TARGET_FPS;
 
-// --- GEOMETRIA (ESPAÇO DO OBJETO) ---
-Vec4 verts_cubo[8] = { {-1,-1,-1}, {1,-1,-1}, {1,1,-1}, {-1,1,-1}, {-1,-1,1}, {1,-1,1}, {1,1,1}, {-1,1,1} };
-int indices[12][3] = { {0,1,2}, {0,2,3}, {5,4,7}, {5,7,6}, {3,2,6}, {3,6,7}, {4,5,1}, {4,1,0}, {4,0,3}, {4,3,7}, {1,5,6}, {1,6,2} };
-
 // --- ESTADO GLOBAL DA CENA ---
 Vec4 g_cam_pos(0,0,0);
 Vec4 g_light_pos(2,3,-5);
@@ -27,7 +28,22 @@ Vec3 g_ambient_color(0.2f, 0.2f, 0.2f); // Cor da Luz Ambiente Global
 Vec3 g_light_color(1.0f, 1.0f, 1.0f);   // Cor da Luz Pontual (Branca)
 float g_fov = 1.04f;
 bool g_use_phong = true;
-int g_vp_x = 0, g_vp_y = 0, g_vp_w = SCREEN_W, g_vp_h = SCREEN_H;
+bool g_use_tiles = true; // Rasterização multithread em tiles
+ModoRaster g_raster = RASTER_SCANLINE; // Núcleo de rasterização (Scanline ou Funções de Aresta SIMD)
+bool g_use_deferred = false; // Deferred (Visibility Buffer): ilumina cada pixel visível uma vez
+bool g_use_hiz = true;       // Occlusion Culling com Z-Buffer hierárquico
+bool g_use_fb_tiles = false; // Framebuffer em tiles (limpeza por flags, resolvido no envio à textura)
+bool g_use_prof16 = false;   // Profundidade de 16 bits no framebuffer em tiles
+bool g_use_msaa = false;     // MSAA 4x: cobertura e Z por amostra, um Pixel Shader por pixel
+bool g_use_sombras = false;  // Sombras da luz principal (Cube Shadow Map guardado entre frames)
+bool g_use_pipeline = true;  // Desenha o frame N+1 enquanto apresenta o N (P: sequencial)
+bool g_instrumentar = false; // Tempos por etapa e contadores no console (ver instrumentacao.h)
+bool g_mapa_calor = false;   // Mostra o overdraw de cada pixel no lugar da imagem
+bool g_gravar_trace = false; // Grava eventos; ao desligar, escreve trace.json (formato do Chrome)
+int g_janela_w = SCREEN_W, g_janela_h = SCREEN_H; // Resolução de saída (janela e textura)
+int g_vp_x = 0, g_vp_y = 0, g_vp_w = SCREEN_W, g_vp_h = SCREEN_H; // Viewport, em pixels da janela
+const char* g_arquivo_cena = "cena.cena"; // Instantâneo gravado com F5 e restaurado com F9
+bool g_exportar_shm = false; // Publica cada frame exibido em memória compartilhada (ver exportacao_shm.h)
 
 // --- INTERFACE / INPUT ---
 enum Modo { M_OBJ, M_LUZ, M_CAM, M_MAT, M_VIEW, M_LIGHT_COLOR };
@@ -36,14 +52,47 @@ int mat_sel_type = 2; // Inicia em Kd (Cor)
 int sel_idx = 0;
 int light_sel_type = 1;
 
-void atualizar_interface(const std::vector<Cubo>& cena) {
+// Câmera, luz principal e viewport para o instantâneo da cena (ver arquivo_cena.h)
+CameraCena camera_atual() {
+    CameraCena c;
+    c.cam_pos = g_cam_pos; c.light_pos = g_light_pos;
+    c.light_color = g_light_color; c.ambient_color = g_ambient_color;
+    c.fov = g_fov;
+    c.vp_x = g_vp_x; c.vp_y = g_vp_y; c.vp_w = g_vp_w; c.vp_h = g_vp_h;
+    return c;
+}
+
+void aplicar_camera(const CameraCena& c) {
+    g_cam_pos = c.cam_pos; g_light_pos = c.light_pos;
+    g_light_color = c.light_color; g_ambient_color = c.ambient_color;
+    g_fov = c.fov;
+    g_vp_x = c.vp_x; g_vp_y = c.vp_y; g_vp_w = c.vp_w; g_vp_h = c.vp_h;
+}
+
+// Troca a cena pela do arquivo (a atual é mantida se ele não abrir ou estiver vazio)
+bool restaurar_cena(const char* caminho, Cena& cena) {
+    Cena lida;
+    CameraCena camera;
+    Uint32 t0 = SDL_GetTicks();
+    if(!carregar_cena(caminho, lida, camera) || lida.empty()) {
+        printf("\nNao foi possivel carregar a cena %s\n", caminho);
+        return false;
+    }
+    cena = std::move(lida);
+    aplicar_camera(camera);
+    sel_idx = 0;
+    printf("\nCena %s: %zu objetos, %zu luzes (%u ms)\n", caminho, cena.size(), cena.luzes.size(), SDL_GetTicks() - t0);
+    return true;
+}
+
+void atualizar_interface(const Cena& cena) {
     printf("\r                                                                                \r"); 
     
     switch(modo_atual) {
         case M_OBJ:
             printf("[MODO: OBJETO %d] Pos: %.2f %.2f %.2f | Rot: %.2f %.2f", 
-                   sel_idx, cena[sel_idx].posicao.x, cena[sel_idx].posicao.y, cena[sel_idx].posicao.z,
-                   cena[sel_idx].rotacao.x, cena[sel_idx].rotacao.y);
+                   sel_idx, cena.posicoes[sel_idx].x, cena.posicoes[sel_idx].y, cena.posicoes[sel_idx].z,
+                   cena.rotacoes[sel_idx].x, cena.rotacoes[sel_idx].y);
             break;
         case M_LUZ:
             printf("[MODO: LUZ] Pos: %.2f %.2f %.2f", g_light_pos.x, g_light_pos.y, g_light_pos.z);
@@ -60,51 +109,99 @@ void atualizar_interface(const std::vector<Cubo>& cena) {
             printf("[MODO: VIEWPORT] X,Y: %d,%d | W,H: %d,%d", g_vp_x, g_vp_y, g_vp_w, g_vp_h);
             break;
         case M_MAT:
-            const Cubo& c = cena[sel_idx];
-            Vec3 target = (mat_sel_type==1) ? c.mat.ka : (mat_sel_type==2 ? c.mat.kd : c.mat.ks);
+            const Material& mat = cena.materiais[cena.material_idx[sel_idx]];
+            Vec3 target = (mat_sel_type==1) ? mat.ka : (mat_sel_type==2 ? mat.kd : mat.ks);
             char tipo[20];
             if(mat_sel_type==1) sprintf(tipo, "Ka (Ambiente)");
             else if(mat_sel_type==2) sprintf(tipo, "Kd (COR BASE)");
             else sprintf(tipo, "Ks (REFLEXO)");
             
-            printf("[MODO: MATERIAL] %s | R:%.2f G:%.2f B:%.2f | Brilho: %.0f", 
-                   tipo, target.x, target.y, target.z, c.mat.shininess);
+            printf("[MODO: MATERIAL] %s | R:%.2f G:%.2f B:%.2f | Brilho: %.0f | Textura: %s", 
+                   tipo, target.x, target.y, target.z, mat.shininess,
+                   mat.textura < cena.texturas.size() ? cena.texturas[mat.textura]->nome.c_str() : "nenhuma");
             break;
     }
     fflush(stdout);
 }
 
 int main(int argc, char* argv[]) {
+    // Uso: ./renderizador [cena.cena] [modelo.obj | modelo.malha] [textura.ppm] [largura altura] (ex.: 1920 1080, 3840 2160)
+    const char* modelo = nullptr;
+    const char* arquivo_cena = nullptr;
+    const char* arquivo_textura = TEXTURA_XADREZ; // Aplicada com a tecla F
+    while(argc > 1 && std::atoi(argv[1]) == 0) {
+        size_t n = std::strlen(argv[1]);
+        if(n > 5 && std::strcmp(argv[1] + n - 5, ".cena") == 0) arquivo_cena = g_arquivo_cena = argv[1];
+        else if(n > 4 && std::strcmp(argv[1] + n - 4, ".ppm") == 0) arquivo_textura = argv[1];
+        else modelo = argv[1];
+        argc--; argv++;
+    }
+    if(argc > 2) {
+        g_janela_w = std::max(64, std::atoi(argv[1]));
+        g_janela_h = std::max(64, std::atoi(argv[2]));
+        g_vp_w = g_janela_w; g_vp_h = g_janela_h;
+    }
     SDL_Init(SDL_INIT_VIDEO);
     std::srand(std::time(nullptr));
-    SDL_Window* win = SDL_CreateWindow("CG Final - Pipeline Completo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, SCREEN_W, SCREEN_H, 0);
+    SDL_Window* win = SDL_CreateWindow("CG Final - Pipeline Completo", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, g_janela_w, g_janela_h, 0);
     SDL_Renderer* ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED);
-    SDL_Texture* tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_W, SCREEN_H);
+    SDL_Texture* tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, g_janela_w, g_janela_h);
     
-    std::vector<uint32_t> fb(SCREEN_W * SCREEN_H);
-    std::vector<float> zb(SCREEN_W * SCREEN_H);
-    std::vector<Cubo> cena;
+    // A cena é da thread principal; a thread de render desenha cópias dela (instantâneos)
+    Cena cena;
+    ContextoRender ctx; // Threads e buffers do pipeline, reaproveitados entre frames
+    ProdutorFrames produtor(ctx, g_janela_w, g_janela_h, 3); // Thread de render + anel triplo
+    ExportadorShm exportador;
+    ControleResolucao resolucao(g_janela_w, g_janela_h, (float)FRAME_DELAY);
+    resolucao.ativo = false; // Liga com a tecla G
     
     // --- INICIALIZAÇÃO DA CENA ---
     
     // Cubo 1: Material "Plástico Vermelho"
-    Cubo c1; c1.posicao=Vec4(-1.2,0,-5); c1.rotacao=Vec4(0.5,0.6,0); c1.escala=Vec4(1,1,1);
-    c1.mat.ka = Vec3(0.1,0.0,0.0); // Sombra vermelha escura
-    c1.mat.kd = Vec3(0.8,0.0,0.0); // Cor vermelha vibrante
-    c1.mat.ks = Vec3(1.0,1.0,1.0); // Reflexo branco (comum em plásticos)
-    c1.mat.shininess=50;
-    cena.push_back(c1);
+    Material m1;
+    m1.ka = Vec3(0.1,0.0,0.0); // Sombra vermelha escura
+    m1.kd = Vec3(0.8,0.0,0.0); // Cor vermelha vibrante
+    m1.ks = Vec3(1.0,1.0,1.0); // Reflexo branco (comum em plásticos)
+    m1.shininess=50;
+    cena.adicionar(Vec4(-1.2,0,-5), Vec4(0.5,0.6,0), 1, cena.registrar_material(m1));
 
     // Cubo 2: Material "Plástico Verde"
-    Cubo c2; c2.posicao=Vec4(1.2,0,-5); c2.rotacao=Vec4(0,-0.3,0); c2.escala=Vec4(1,1,1);
-    c2.mat.ka = Vec3(0.0,0.1,0.0); 
-    c2.mat.kd = Vec3(0.0,0.8,0.0); 
-    c2.mat.ks = Vec3(1.0,1.0,1.0); 
-    c2.mat.shininess=100;
-    cena.push_back(c2);
+    Material m2;
+    m2.ka = Vec3(0.0,0.1,0.0); 
+    m2.kd = Vec3(0.0,0.8,0.0); 
+    m2.ks = Vec3(1.0,1.0,1.0); 
+    m2.shininess=100;
+    cena.adicionar(Vec4(1.2,0,-5), Vec4(0,-0.3,0), 1, cena.registrar_material(m2));
+
+    // Modelo da linha de comando: o OBJ é convertido para .malha na primeira vez (ver malha.h)
+    if(modelo) {
+        Uint32 t0 = SDL_GetTicks();
+        std::shared_ptr<Malha> malha = carregar_malha(modelo);
+        if(malha) {
+            Material m3 = m1;
+            m3.ka = Vec3(0.1,0.1,0.0); m3.kd = Vec3(0.8,0.7,0.2);
+            sel_idx = cena.adicionar(Vec4(0,0,-5), Vec4(0,0,0), 1.5f, cena.registrar_material(m3), cena.registrar_malha(malha));
+            printf("Modelo %s: %u triangulos, %u vertices (%u ms)\n", malha->nome.c_str(), malha->n_triangulos(),
+                   malha->n_vertices, SDL_GetTicks() - t0);
+        } else {
+            printf("Nao foi possivel carregar o modelo %s\n", modelo);
+        }
+    }
+    if(arquivo_cena) restaurar_cena(arquivo_cena, cena); // Substitui a cena inicial
+    std::shared_ptr<const Textura> textura; // Carregada no primeiro uso da tecla F
+    produtor.marcar_reconstrucao();
     
     bool running = true;
+    int frame_titulo = 0;
     atualizar_interface(cena);
+    EstatisticasFrame stats;
+    int res_w = g_janela_w, res_h = g_janela_h; // Resolução do último frame apresentado
+    // Latência entrada -> tela: do evento lido até o SDL_RenderPresent do frame que o contém
+    double lat_soma = 0, lat_janela = 0, lat_max = 0;
+    int lat_n = 0, lat_n_janela = 0;
+    int quadros_exibidos = 0;
+    double ms_etapas[N_ETAPAS] = {}; // Soma das etapas dos frames exibidos desde o último relatório
+    Uint64 inicio_titulo = SDL_GetPerformanceCounter();
 
     while(running) {
         Uint32 start = SDL_GetTicks();
@@ -114,29 +211,85 @@ int main(int argc, char* argv[]) {
         while(SDL_PollEvent(&e)) {
             if(e.type==SDL_QUIT) running=false;
             if(e.type==SDL_KEYDOWN) {
+                produtor.marcar_entrada(Relogio::now());
                 float s = 0.2f; 
                 // Seleção de Modos
                 if(e.key.keysym.sym == SDLK_m) g_use_phong = !g_use_phong;
+                if(e.key.keysym.sym == SDLK_t) g_use_tiles = !g_use_tiles;
+                if(e.key.keysym.sym == SDLK_v) g_use_deferred = !g_use_deferred;
+                if(e.key.keysym.sym == SDLK_o) g_use_hiz = !g_use_hiz;
+                if(e.key.keysym.sym == SDLK_b) g_use_fb_tiles = !g_use_fb_tiles;
+                if(e.key.keysym.sym == SDLK_z) g_use_prof16 = !g_use_prof16;
+                if(e.key.keysym.sym == SDLK_u) g_use_msaa = !g_use_msaa;
+                if(e.key.keysym.sym == SDLK_y) g_use_sombras = !g_use_sombras;
+                if(e.key.keysym.sym == SDLK_p) g_use_pipeline = !g_use_pipeline;
+                if(e.key.keysym.sym == SDLK_i) g_instrumentar = !g_instrumentar;
+                if(e.key.keysym.sym == SDLK_h) g_mapa_calor = !g_mapa_calor;
+                if(e.key.keysym.sym == SDLK_j) g_gravar_trace = !g_gravar_trace;
+                if(e.key.keysym.sym == SDLK_g) { resolucao.ativo = !resolucao.ativo; resolucao.escala = 1.0f; resolucao.media_ms = 0.0f; }
+                if(e.key.keysym.sym == SDLK_r) g_raster = (g_raster == RASTER_SCANLINE) ? RASTER_EDGE : RASTER_SCANLINE;
                 if(e.key.keysym.sym == SDLK_TAB) modo_atual = (Modo)((modo_atual + 1) % 6);
                 if(e.key.keysym.sym == SDLK_SPACE && !cena.empty()) sel_idx = (sel_idx+1)%cena.size();
                 if(e.key.keysym.sym == SDLK_n) {
-                    Cubo novo = c1; novo.posicao = Vec4(0,0,-5);
-                    novo.mat.kd = Vec3((rand()%100)/100.0f, (rand()%100)/100.0f, (rand()%100)/100.0f);
-                    cena.push_back(novo); sel_idx = cena.size()-1;
+                    // Mesmo material base do Cubo 1, com outra cor difusa (reaproveitado se já existir)
+                    Material novo = m1;
+                    novo.kd = Vec3((rand()%100)/100.0f, (rand()%100)/100.0f, (rand()%100)/100.0f);
+                    sel_idx = cena.adicionar(Vec4(0,0,-5), Vec4(0.5,0.6,0), 1, cena.registrar_material(novo));
+                    produtor.marcar_reconstrucao();
+                }
+                if(e.key.keysym.sym == SDLK_l && !cena.empty()) {
+                    // Luz pontual de cor aleatória logo acima do cubo selecionado
+                    Vec3 cor((rand()%100)/100.0f, (rand()%100)/100.0f, (rand()%100)/100.0f);
+                    Vec4 pos = cena.posicoes[sel_idx];
+                    cena.adicionar_luz(Vec4(pos.x, pos.y + 1.5f, pos.z), cor, 3.0f);
+                    produtor.marcar_cena();
+                }
+                if(e.key.keysym.sym == SDLK_k) { cena.luzes.clear(); produtor.marcar_cena(); }
+                if(e.key.keysym.sym == SDLK_f && !cena.empty()) {
+                    // Liga/desliga a textura no material do objeto selecionado
+                    Material& mat = cena.material_exclusivo(sel_idx);
+                    if(mat.textura != SEM_TEXTURA) mat.textura = SEM_TEXTURA;
+                    else {
+                        if(!textura) textura = carregar_textura(arquivo_textura);
+                        if(textura) mat.textura = cena.registrar_textura(textura);
+                        else printf("\nNao foi possivel carregar a textura %s\n", arquivo_textura);
+                    }
+                    produtor.marcar_cena();
+                }
+                if(e.key.keysym.sym == SDLK_F5) {
+                    Uint32 t0 = SDL_GetTicks();
+                    uint64_t bytes = salvar_cena(g_arquivo_cena, cena, camera_atual());
+                    if(bytes) printf("\nCena gravada em %s (%.1f MB, %u ms)\n", g_arquivo_cena, bytes / 1048576.0, SDL_GetTicks() - t0);
+                    else printf("\nNao foi possivel gravar %s\n", g_arquivo_cena);
+                }
+                if(e.key.keysym.sym == SDLK_F9 && restaurar_cena(g_arquivo_cena, cena)) produtor.marcar_reconstrucao();
+                if(e.key.keysym.sym == SDLK_x) {
+                    g_exportar_shm = !g_exportar_shm;
+                    if(!g_exportar_shm) exportador.fechar();
+                    else if(exportador.abrir(SHM_NOME_PADRAO, g_janela_w, g_janela_h)) printf("\nExportando frames em /dev/shm%s\n", SHM_NOME_PADRAO);
+                    else { printf("\nNao foi possivel criar %s\n", SHM_NOME_PADRAO); g_exportar_shm = false; }
                 }
 
                 // Lógica de Movimento por Modo
                 if(modo_atual == M_OBJ && !cena.empty()) {
-                    if(e.key.keysym.sym==SDLK_w) cena[sel_idx].posicao.y += s;
-                    if(e.key.keysym.sym==SDLK_s) cena[sel_idx].posicao.y -= s;
-                    if(e.key.keysym.sym==SDLK_a) cena[sel_idx].posicao.x -= s;
-                    if(e.key.keysym.sym==SDLK_d) cena[sel_idx].posicao.x += s;
-                    if(e.key.keysym.sym==SDLK_q) cena[sel_idx].posicao.z += s;
-                    if(e.key.keysym.sym==SDLK_e) cena[sel_idx].posicao.z -= s;
-                    if(e.key.keysym.sym==SDLK_LEFT) cena[sel_idx].rotacao.y -= 0.1;
-                    if(e.key.keysym.sym==SDLK_RIGHT) cena[sel_idx].rotacao.y += 0.1;
-                    if(e.key.keysym.sym==SDLK_UP)   cena[sel_idx].rotacao.x -= 0.1;
-                    if(e.key.keysym.sym==SDLK_DOWN) cena[sel_idx].rotacao.x += 0.1;
+                    const Vec4 pos0 = cena.posicoes[sel_idx], rot0 = cena.rotacoes[sel_idx];
+                    const float esc0 = cena.escalas[sel_idx];
+                    if(e.key.keysym.sym==SDLK_w) cena.posicoes[sel_idx].y += s;
+                    if(e.key.keysym.sym==SDLK_s) cena.posicoes[sel_idx].y -= s;
+                    if(e.key.keysym.sym==SDLK_a) cena.posicoes[sel_idx].x -= s;
+                    if(e.key.keysym.sym==SDLK_d) cena.posicoes[sel_idx].x += s;
+                    if(e.key.keysym.sym==SDLK_q) cena.posicoes[sel_idx].z += s;
+                    if(e.key.keysym.sym==SDLK_e) cena.posicoes[sel_idx].z -= s;
+                    if(e.key.keysym.sym==SDLK_LEFT) cena.rotacoes[sel_idx].y -= 0.1;
+                    if(e.key.keysym.sym==SDLK_RIGHT) cena.rotacoes[sel_idx].y += 0.1;
+                    if(e.key.keysym.sym==SDLK_UP)   cena.rotacoes[sel_idx].x -= 0.1;
+                    if(e.key.keysym.sym==SDLK_DOWN) cena.rotacoes[sel_idx].x += 0.1;
+                    // Só quando o objeto de fato mudou: a edição suja as faces de sombra dele e copia a
+                    // cena para o próximo instantâneo (refit incremental da BVH)
+                    const Vec4 &pos = cena.posicoes[sel_idx], &rot = cena.rotacoes[sel_idx];
+                    if(pos.x != pos0.x || pos.y != pos0.y || pos.z != pos0.z || rot.x != rot0.x || rot.y != rot0.y ||
+                       rot.z != rot0.z || cena.escalas[sel_idx] != esc0)
+                        produtor.marcar_edicao(sel_idx);
                 }
                 else if(modo_atual == M_LUZ) {
                     if(e.key.keysym.sym==SDLK_w) g_light_pos.y += s;
@@ -171,8 +324,9 @@ int main(int argc, char* argv[]) {
                     if(e.key.keysym.sym==SDLK_2 || e.key.keysym.sym==SDLK_KP_2) mat_sel_type = 2; 
                     if(e.key.keysym.sym==SDLK_3 || e.key.keysym.sym==SDLK_KP_3) mat_sel_type = 3; 
                     
-                    Vec3* target = (mat_sel_type==1) ? &cena[sel_idx].mat.ka : 
-                                   (mat_sel_type==2) ? &cena[sel_idx].mat.kd : &cena[sel_idx].mat.ks;
+                    Material& mat = cena.material_exclusivo(sel_idx);
+                    Vec3* target = (mat_sel_type==1) ? &mat.ka : 
+                                   (mat_sel_type==2) ? &mat.kd : &mat.ks;
                     
                     if(e.key.keysym.sym==SDLK_d) target->x = std::min(1.0f, target->x + 0.05f); 
                     if(e.key.keysym.sym==SDLK_a) target->x = std::max(0.0f, target->x - 0.05f); 
@@ -181,8 +335,9 @@ int main(int argc, char* argv[]) {
                     if(e.key.keysym.sym==SDLK_e) target->z = std::min(1.0f, target->z + 0.05f); 
                     if(e.key.keysym.sym==SDLK_q) target->z = std::max(0.0f, target->z - 0.05f); 
                     
-                    if(e.key.keysym.sym==SDLK_7 || e.key.keysym.sym==SDLK_KP_7) cena[sel_idx].mat.shininess += 5.0f;
-                    if(e.key.keysym.sym==SDLK_8 || e.key.keysym.sym==SDLK_KP_8) cena[sel_idx].mat.shininess = std::max(1.0f, cena[sel_idx].mat.shininess - 5.0f);
+                    if(e.key.keysym.sym==SDLK_7 || e.key.keysym.sym==SDLK_KP_7) mat.shininess += 5.0f;
+                    if(e.key.keysym.sym==SDLK_8 || e.key.keysym.sym==SDLK_KP_8) mat.shininess = std::max(1.0f, mat.shininess - 5.0f);
+                    produtor.marcar_cena();
                 }
                 else if(modo_atual == M_LIGHT_COLOR) {
                     if(e.key.keysym.sym == SDLK_1) light_sel_type = 1;
@@ -202,77 +357,112 @@ int main(int argc, char* argv[]) {
             }
         }
         
-        // --- 2. PREPARAÇÃO DO FRAME (Limpeza) ---
-        std::fill(fb.begin(), fb.end(), 0xFF222222); // Fundo Cinza Escuro
-        std::fill(zb.begin(), zb.end(), 1000.0f);    // Reset Z-Buffer
-        
-        // --- 3. PIPELINE GRÁFICO (GEOMETRY & RASTER) ---
-        
-        // Estágio: Definição da Câmera (Matriz View) e Lente (Matriz Projection)
-        Mat4 proj = perspective(g_fov, (float)SCREEN_W/SCREEN_H, 0.1f, 100.0f);
-        Mat4 view = translate(-g_cam_pos.x, -g_cam_pos.y, -g_cam_pos.z);
-        
-        for(auto& cubo : cena) {
-            // Estágio: Matriz Model (Transforma Objeto -> Mundo)
-            Mat4 model = translate(cubo.posicao.x, cubo.posicao.y, cubo.posicao.z) * rotateY(cubo.rotacao.y) * rotateX(cubo.rotacao.x) * scale(cubo.escala.x);
-            Mat4 model_view = view * model; // Combinada para levar ao View Space
-            
-            // Estágio: Vertex Shader (Transformação de Vértices)
-            Vec4 view_verts[8];
-            for(int i=0; i<8; i++) view_verts[i] = model_view * verts_cubo[i];
-            
-            for(int i=0; i<12; i++) {
-                Vec4 v1 = view_verts[indices[i][0]];
-                Vec4 v2 = view_verts[indices[i][1]];
-                Vec4 v3 = view_verts[indices[i][2]];
-                
-                // Estágio: Clipping (Recorte Geométrico Sutherland-Hodgman)
-                std::vector<Vec4> clipped;
-                clip_triangle_sutherland_hodgman(v1, v2, v3, clipped);
-                
-                // Processa os triângulos resultantes do recorte
-                for(size_t k=0; k < clipped.size(); k+=3) {
-                    Vec4 t1 = clipped[k], t2 = clipped[k+1], t3 = clipped[k+2];
-                    
-                    // Estágio: Back-Face Culling (No View Space)
-                    Vec4 n = (t3 - t1).cross(t2 - t1); n.normalize();
-                    if(n.dot(t1 * -1.0f) <= 0) continue; // Descarta se não olha para a câmera
-                    
-                    // Estágio: Projeção e Divisão Perspectiva (NDC)
-                    Vec4 p1 = proj*t1, p2 = proj*t2, p3 = proj*t3;
-                    if(p1.w!=0) { p1.x/=p1.w; p1.y/=p1.w; p1.z/=p1.w; }
-                    if(p2.w!=0) { p2.x/=p2.w; p2.y/=p2.w; p2.z/=p2.w; }
-                    if(p3.w!=0) { p3.x/=p3.w; p3.y/=p3.w; p3.z/=p3.w; }
-                    
-                    // Estágio: Viewport Transform (Tela)
-                    int x1 = (p1.x+1)*0.5*g_vp_w + g_vp_x; int y1 = (1-p1.y)*0.5*g_vp_h + g_vp_y;
-                    int x2 = (p2.x+1)*0.5*g_vp_w + g_vp_x; int y2 = (1-p2.y)*0.5*g_vp_h + g_vp_y;
-                    int x3 = (p3.x+1)*0.5*g_vp_w + g_vp_x; int y3 = (1-p3.y)*0.5*g_vp_h + g_vp_y;
-                    
-                    // Estágio: Rasterização (Scanline + ZBuffer + Pixel Shader)
-                    if(g_use_phong) {
-                        fill_phong(x1, y1, p1.w, t1, x2, y2, p2.w, t2, x3, y3, p3.w, t3, 
-                                    n, cubo, g_light_pos, Vec4(0,0,0), fb, zb, 
-                                    g_vp_w, g_vp_h, g_vp_x, g_vp_y, g_light_color, g_ambient_color);
-                    } else {
-                        // Flat Shading: Calcula luz uma vez por triângulo
-                        Vec4 lightPosView = view * g_light_pos;
-                        Vec4 centro = (t1 + t2 + t3) * 0.333f;
-                        uint32_t c = calc_luz_rgb(centro, n, cubo, lightPosView, Vec4(0,0,0), 
-                                     g_light_color, g_ambient_color);   
-                        fill_flat(x1,y1,p1.w, x2,y2,p2.w, x3,y3,p3.w, c, fb, zb, g_vp_w, g_vp_h, g_vp_x, g_vp_y);
-                    }
-                }
-            }
+        // --- 2. INSTANTÂNEO DA CENA PARA A THREAD DE RENDER ---
+        ParametrosFrame params;
+        params.cam_pos = g_cam_pos; params.light_pos = g_light_pos;
+        params.light_color = g_light_color; params.ambient_color = g_ambient_color;
+        params.fov = g_fov; params.use_phong = g_use_phong; params.use_tiles = g_use_tiles;
+        params.raster = g_raster; params.use_deferred = g_use_deferred; params.use_hiz = g_use_hiz;
+        params.use_fb_tiles = g_use_fb_tiles; params.use_prof16 = g_use_prof16;
+        params.use_msaa = g_use_msaa; params.use_sombras = g_use_sombras;
+        params.instrumentar = g_instrumentar; params.mapa_calor = g_mapa_calor; params.gravar_trace = g_gravar_trace;
+        // Viewport da janela levado para a resolução interna
+        params.largura = resolucao.largura(); params.altura = resolucao.altura();
+        params.vp_x = g_vp_x * params.largura / g_janela_w; params.vp_y = g_vp_y * params.altura / g_janela_h;
+        params.vp_w = g_vp_w * params.largura / g_janela_w; params.vp_h = g_vp_h * params.altura / g_janela_h;
+        uint64_t numero = produtor.publicar(cena, params);
+        if(!g_use_pipeline) produtor.esperar(numero); // Sequencial: apresenta o frame que acabou de pedir
+
+        // --- 3. APRESENTAÇÃO ---
+        // Frame pronto mais recente (em pipeline, normalmente o anterior ao que está sendo desenhado),
+        // já ampliado para a janela pela thread de render. Sem frame novo, a textura é reapresentada.
+        const QuadroAnel* quadro = produtor.adquirir();
+        bool com_entrada = false;
+        Relogio::time_point t_entrada;
+        if(quadro) {
+            SDL_UpdateTexture(tex, NULL, quadro->imagem.data(), g_janela_w * 4);
+            if(g_exportar_shm) exportador.publicar(quadro->imagem.data(), g_janela_w, g_janela_h, g_janela_w);
+            resolucao.registrar((float)quadro->render_ms); // A thread de render é o caminho crítico
+            stats = quadro->stats;
+            res_w = quadro->largura; res_h = quadro->altura;
+            com_entrada = quadro->tem_entrada; t_entrada = quadro->t_entrada;
+            produtor.liberar(quadro); // Já copiado: o render pode reusar a posição durante a apresentação
+            quadros_exibidos++;
+            for(int i = 0; i < N_ETAPAS; i++) ms_etapas[i] += stats.ms_etapa[i];
         }
-        
-        SDL_UpdateTexture(tex, NULL, fb.data(), SCREEN_W*4);
+        int64_t inicio_apresentar = relogio_ns();
         SDL_RenderCopy(ren, tex, NULL, NULL);
         SDL_RenderPresent(ren);
+        int64_t fim_apresentar = relogio_ns();
+        if(g_instrumentar) {
+            ms_etapas[ETAPA_APRESENTAR] += (fim_apresentar - inicio_apresentar) * 1e-6;
+            produtor.registrar_apresentacao(inicio_apresentar, fim_apresentar);
+        }
+        if(com_entrada) {
+            double ms = std::chrono::duration<double, std::milli>(Relogio::now() - t_entrada).count();
+            lat_soma += ms; lat_n++;
+            lat_janela += ms; lat_n_janela++;
+            lat_max = std::max(lat_max, ms);
+        }
+
+        // Barra de título: overdraw (execuções do Pixel Shader / pixels visíveis) e cubos ocluídos
+        if(++frame_titulo % 30 == 0) {
+            double seg = (SDL_GetPerformanceCounter() - inicio_titulo) / (double)SDL_GetPerformanceFrequency();
+            char titulo[320];
+            snprintf(titulo, sizeof(titulo), "CG Final - Pipeline Completo | %s | Overdraw %.2fx (%lld sombreados / %lld visiveis) | Ocluidos %lld/%zu | Luzes %zu | Res %dx%d%s",
+                     g_use_deferred ? "Deferred" : "Forward", stats.overdraw(),
+                     stats.pixels_sombreados, stats.pixels_visiveis, stats.objetos_ocluidos, cena.size(), cena.luzes.size(),
+                     res_w, res_h, resolucao.ativo ? " (dinamica)" : "");
+            if(g_use_fb_tiles && !usa_msaa(params)) {
+                size_t n = strlen(titulo);
+                snprintf(titulo + n, sizeof(titulo) - n, " | FB tiles%s", g_use_prof16 ? " Z16" : "");
+            }
+            size_t n = strlen(titulo);
+            if(usa_msaa(params)) {
+                snprintf(titulo + n, sizeof(titulo) - n, " | MSAA 4x");
+                n = strlen(titulo);
+            }
+            if(usa_sombras(params)) {
+                snprintf(titulo + n, sizeof(titulo) - n, " | Sombras");
+                n = strlen(titulo);
+            }
+            snprintf(titulo + n, sizeof(titulo) - n, " | %s %.0f fps", g_use_pipeline ? "Pipeline" : "Sequencial", quadros_exibidos / seg);
+            if(lat_n_janela > 0) {
+                n = strlen(titulo);
+                snprintf(titulo + n, sizeof(titulo) - n, " | Latencia %.1f ms", lat_janela / lat_n_janela);
+            }
+            if(g_exportar_shm) {
+                n = strlen(titulo);
+                snprintf(titulo + n, sizeof(titulo) - n, " | SHM %llu perdidos", (unsigned long long)exportador.descartados());
+            }
+            SDL_SetWindowTitle(win, titulo);
+
+            // Instrumentação: média das etapas (ms por frame exibido, somadas entre as threads) e
+            // contadores do último frame
+            if(g_instrumentar && quadros_exibidos > 0) {
+                for(int i = 0; i < N_ETAPAS; i++) ms_etapas[i] /= i == ETAPA_APRESENTAR ? 30 : quadros_exibidos;
+                char etapas[256];
+                formatar_etapas(etapas, sizeof(etapas), ms_etapas);
+                printf("\r[ETAPAS ms] %s\n[TRIANGULOS] %lld entrada | %lld fora | %lld recortados | %lld costas | %lld rasterizados"
+                       "\n[FRAGMENTOS] %lld testados | %lld aprovados | %lld sombreados\n",
+                       etapas, stats.triangulos_entrada, stats.triangulos_fora, stats.triangulos_recortados,
+                       stats.triangulos_costas, stats.triangulos_rasterizados,
+                       stats.fragmentos_testados, stats.fragmentos_aprovados, stats.pixels_sombreados);
+                if(usa_sombras(params))
+                    printf("[SOMBRAS] %lld faces refeitas | %lld triangulos no mapa (ultimo frame)\n",
+                           stats.faces_sombra, stats.triangulos_sombra);
+                atualizar_interface(cena);
+            }
+            std::fill(ms_etapas, ms_etapas + N_ETAPAS, 0.0);
+            quadros_exibidos = 0; lat_janela = 0; lat_n_janela = 0;
+            inicio_titulo = SDL_GetPerformanceCounter();
+        }
+        
         int t = SDL_GetTicks() - start;
         if(FRAME_DELAY > t) SDL_Delay(FRAME_DELAY - t);
     }
     
+    if(lat_n > 0) printf("Latencia entrada -> tela: media %.1f ms, max %.1f ms (%d frames com entrada)\n", lat_soma / lat_n, lat_max, lat_n);
     SDL_DestroyTexture(tex); SDL_DestroyRenderer(ren); SDL_DestroyWindow(win); SDL_Quit();
     return 0;
 }
\ No newline at end of file
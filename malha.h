@@ -0,0 +1,441 @@
+/**
+ * MALHA.H
+ * Malhas indexadas: carregamento de Wavefront OBJ e formato binário próprio (.malha).
+ * O OBJ é convertido uma única vez: vértices únicos (posição + normal), índices reordenados para
+ * a cache de vértices (algoritmo de Forsyth), vértices renumerados na ordem do primeiro uso e
+ * posições e normais quantizadas. O binário é mapeado em memória (mmap) e usado sem cópia, então
+ * abrir um modelo já convertido é quase instantâneo.
+ *
+ * A malha é normalizada para o cubo [-1,1]³ na conversão: a esfera envolvente do cubo (usada no
+ * Frustum Culling, na BVH e no Hi-Z) vale também para ela, e a escala do objeto define o tamanho.
+ */
+
+#ifndef MALHA_H
+#define MALHA_H
+
+#include "math_utils.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Quantização: posição normalizada em [-1,1] vezes 32767 (int16); normal vezes 127 (int8)
+const float MALHA_QUANT_POS = 32767.0f;
+const float MALHA_QUANT_NORMAL = 127.0f;
+const uint32_t MALHA_VERSAO = 1;
+
+// Cabeçalho do arquivo .malha; as seções vêm em seguida, alinhadas a 16 bytes:
+// posições int16[4 * n_vertices] (x, y, z, 0), normais int8[4 * n_vertices] (x, y, z, 0) e
+// índices uint32[n_indices] (triângulos, em ordem otimizada para a cache de vértices).
+struct CabecalhoMalha {
+    char magica[4];               // "MLH1"
+    uint32_t versao;
+    uint32_t n_vertices, n_indices;
+    float centro[3], meia_extensao; // Posição original = centro + meia_extensao * normalizada
+    uint64_t off_posicoes, off_normais, off_indices;
+    uint64_t tamanho;             // Tamanho total do arquivo
+};
+
+struct Malha {
+    uint32_t n_vertices = 0, n_indices = 0;
+    const int16_t* posicoes = nullptr;  // 4 por vértice
+    const int8_t* normais = nullptr;    // 4 por vértice
+    const uint32_t* indices = nullptr;
+    float centro[3] = { 0, 0, 0 }, meia_extensao = 1;
+    std::string nome;
+
+    uint32_t n_triangulos() const { return n_indices / 3; }
+
+    Malha() {}
+    ~Malha() { if(mapa) munmap(mapa, tamanho_mapa); }
+    Malha(const Malha&) = delete;
+    Malha& operator=(const Malha&) = delete;
+
+    // Aponta as seções para o conteúdo de um arquivo .malha (mapeado ou em memória). O pipeline
+    // indexa as seções direto, então um arquivo corrompido ou truncado é recusado aqui: cada seção
+    // tem de caber no arquivo e todo índice tem de apontar para um vértice existente.
+    bool apontar(const uint8_t* base, size_t tamanho) {
+        if(tamanho < sizeof(CabecalhoMalha)) return false;
+        CabecalhoMalha c;
+        std::memcpy(&c, base, sizeof(c));
+        if(std::memcmp(c.magica, "MLH1", 4) != 0 || c.versao != MALHA_VERSAO || c.tamanho != tamanho) return false;
+        // [offset, offset + bytes) dentro do arquivo, sem estouro; offsets alinhados como na gravação
+        auto cabe = [&](uint64_t offset, uint64_t bytes) {
+            return offset % 16 == 0 && offset >= sizeof(CabecalhoMalha) && offset <= tamanho && bytes <= tamanho - offset;
+        };
+        if(!cabe(c.off_posicoes, (uint64_t)c.n_vertices * 4 * sizeof(int16_t)) || !cabe(c.off_normais, (uint64_t)c.n_vertices * 4) ||
+           !cabe(c.off_indices, (uint64_t)c.n_indices * sizeof(uint32_t)) || c.n_indices % 3 != 0) return false;
+        const uint32_t* idx = (const uint32_t*)(base + c.off_indices);
+        for(uint32_t i = 0; i < c.n_indices; i++) if(idx[i] >= c.n_vertices) return false;
+        n_vertices = c.n_vertices; n_indices = c.n_indices;
+        posicoes = (const int16_t*)(base + c.off_posicoes);
+        normais = (const int8_t*)(base + c.off_normais);
+        indices = idx;
+        std::memcpy(centro, c.centro, sizeof(centro));
+        meia_extensao = c.meia_extensao;
+        return true;
+    }
+
+    void* mapa = nullptr;         // Região do mmap (nullptr se os dados estão em 'memoria')
+    size_t tamanho_mapa = 0;
+    std::vector<uint8_t> memoria; // Arquivo montado em memória quando não deu para gravá-lo
+};
+
+// Malha ainda não quantizada, saída do leitor de OBJ
+struct DadosMalha {
+    std::vector<float> posicoes;  // 3 por vértice
+    std::vector<float> normais;   // 3 por vértice
+    std::vector<uint32_t> indices;
+};
+
+// ==========================================
+//   LEITURA DO OBJ
+// ==========================================
+
+inline const char* pular_espacos(const char* c) { while(*c == ' ' || *c == '\t') c++; return c; }
+
+// Lê um OBJ (v, vn e f; polígonos viram leques de triângulos, índices negativos são relativos).
+// Cada par (posição, normal) distinto vira um vértice. Sem normais no arquivo, cada vértice
+// recebe a média das normais das faces em volta, ponderada pela área.
+inline bool ler_obj(const char* caminho, DadosMalha& d) {
+    FILE* f = std::fopen(caminho, "rb");
+    if(!f) return false;
+    std::fseek(f, 0, SEEK_END);
+    long tamanho = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    std::vector<char> texto(tamanho + 1);
+    size_t lidos = std::fread(texto.data(), 1, tamanho, f);
+    std::fclose(f);
+    texto[lidos] = 0;
+
+    std::vector<float> v, vn;
+    std::unordered_map<uint64_t, uint32_t> unicos;
+    std::vector<uint32_t> face;
+    bool sem_normais = false;
+    d = DadosMalha();
+
+    const char* c = texto.data();
+    while(*c) {
+        c = pular_espacos(c);
+        if(c[0] == 'v' && (c[1] == ' ' || c[1] == '\t')) {
+            char* fim;
+            for(int i = 0; i < 3; i++) { v.push_back(std::strtof(c + 1, &fim)); c = fim - 1; }
+            c++;
+        } else if(c[0] == 'v' && c[1] == 'n') {
+            char* fim;
+            c += 1;
+            for(int i = 0; i < 3; i++) { vn.push_back(std::strtof(c + 1, &fim)); c = fim - 1; }
+            c++;
+        } else if(c[0] == 'f' && (c[1] == ' ' || c[1] == '\t')) {
+            c++;
+            face.clear();
+            for(;;) {
+                c = pular_espacos(c);
+                if(*c == 0 || *c == '\n' || *c == '\r' || *c == '#') break;
+                char* fim;
+                long iv = std::strtol(c, &fim, 10), in = 0;
+                if(fim == c) break;
+                c = fim;
+                if(*c == '/') {
+                    c++;
+                    if(*c != '/') { std::strtol(c, &fim, 10); c = fim; } // Coordenada de textura (ignorada)
+                    if(*c == '/') { c++; in = std::strtol(c, &fim, 10); c = fim; }
+                }
+                while(*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r') c++;
+                long nv = (long)v.size() / 3, nn = (long)vn.size() / 3;
+                if(iv < 0) iv += nv + 1;
+                if(in < 0) in += nn + 1;
+                if(iv < 1 || iv > nv) continue;
+                if(in < 1 || in > nn) { in = 0; sem_normais = true; }
+                uint64_t chave = ((uint64_t)iv << 32) | (uint64_t)in;
+                auto it = unicos.find(chave);
+                uint32_t idx;
+                if(it != unicos.end()) idx = it->second;
+                else {
+                    idx = (uint32_t)(d.posicoes.size() / 3);
+                    for(int k = 0; k < 3; k++) d.posicoes.push_back(v[(iv - 1) * 3 + k]);
+                    for(int k = 0; k < 3; k++) d.normais.push_back(in ? vn[(in - 1) * 3 + k] : 0.0f);
+                    unicos.emplace(chave, idx);
+                }
+                face.push_back(idx);
+            }
+            for(size_t k = 2; k < face.size(); k++) {
+                d.indices.push_back(face[0]); d.indices.push_back(face[k - 1]); d.indices.push_back(face[k]);
+            }
+        }
+        while(*c && *c != '\n') c++;
+        if(*c) c++;
+    }
+
+    if(sem_normais) {
+        // Normais por vértice: soma dos produtos vetoriais das faces (o módulo é o dobro da área)
+        std::fill(d.normais.begin(), d.normais.end(), 0.0f);
+        for(size_t t = 0; t + 2 < d.indices.size(); t += 3) {
+            const float* a = &d.posicoes[d.indices[t] * 3];
+            const float* b = &d.posicoes[d.indices[t + 1] * 3];
+            const float* e = &d.posicoes[d.indices[t + 2] * 3];
+            Vec4 n = Vec4(b[0] - a[0], b[1] - a[1], b[2] - a[2]).cross(Vec4(e[0] - a[0], e[1] - a[1], e[2] - a[2]));
+            for(int k = 0; k < 3; k++) {
+                float* o = &d.normais[d.indices[t + k] * 3];
+                o[0] += n.x; o[1] += n.y; o[2] += n.z;
+            }
+        }
+    }
+    for(size_t i = 0; i < d.normais.size(); i += 3) {
+        float* n = &d.normais[i];
+        float len = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        if(len > 0) { n[0] /= len; n[1] /= len; n[2] /= len; }
+    }
+    return !d.indices.empty();
+}
+
+// ==========================================
+//   OTIMIZAÇÃO PARA A CACHE DE VÉRTICES
+// ==========================================
+// Algoritmo de Tom Forsyth ("Linear-Speed Vertex Cache Optimisation"): guloso, escolhe sempre o
+// triângulo de maior pontuação entre os vizinhos dos vértices de uma cache LRU simulada. A nota
+// de um vértice cresce se ele está na cache (mais se for recente) e se tem poucos triângulos
+// restantes, para que os vértices sejam "terminados" e saiam da cache de vez.
+
+const int CACHE_FORSYTH = 32;
+
+inline void otimizar_cache_vertices(std::vector<uint32_t>& indices, uint32_t n_vertices) {
+    const size_t n_tri = indices.size() / 3;
+    if(n_tri == 0) return;
+
+    float nota_cache[CACHE_FORSYTH], nota_valencia[64];
+    for(int i = 0; i < CACHE_FORSYTH; i++)
+        nota_cache[i] = i < 3 ? 0.75f : std::pow(1.0f - (i - 3) / (float)(CACHE_FORSYTH - 3), 1.5f);
+    for(int i = 1; i < 64; i++) nota_valencia[i] = 2.0f / std::sqrt((float)i);
+    nota_valencia[0] = 0.0f;
+    auto nota = [&](int pos, uint32_t restantes) {
+        if(restantes == 0) return -1.0f;
+        return (pos >= 0 ? nota_cache[pos] : 0.0f) + nota_valencia[std::min<uint32_t>(restantes, 63)];
+    };
+
+    // Triângulos de cada vértice (CSR); os já emitidos são removidos da lista
+    std::vector<uint32_t> inicio(n_vertices + 1, 0), restantes(n_vertices, 0);
+    for(uint32_t i : indices) restantes[i]++;
+    for(uint32_t v = 0; v < n_vertices; v++) inicio[v + 1] = inicio[v] + restantes[v];
+    std::vector<uint32_t> adj(indices.size()), preenchidos(n_vertices, 0);
+    for(size_t t = 0; t < n_tri; t++)
+        for(int k = 0; k < 3; k++) { uint32_t v = indices[t * 3 + k]; adj[inicio[v] + preenchidos[v]++] = (uint32_t)t; }
+
+    std::vector<int> pos_cache(n_vertices, -1);
+    std::vector<float> nota_vertice(n_vertices), nota_tri(n_tri);
+    std::vector<uint8_t> emitido(n_tri, 0);
+    for(uint32_t v = 0; v < n_vertices; v++) nota_vertice[v] = nota(-1, restantes[v]);
+    for(size_t t = 0; t < n_tri; t++)
+        nota_tri[t] = nota_vertice[indices[t*3]] + nota_vertice[indices[t*3+1]] + nota_vertice[indices[t*3+2]];
+
+    std::vector<uint32_t> saida;
+    saida.reserve(indices.size());
+    std::vector<uint32_t> cache, nova_cache;
+    size_t cursor = 0;     // Próximo triângulo não emitido, para quando a cache não oferece nenhum
+    long long melhor = -1;
+    for(size_t t = 0; t < n_tri; t++) if(melhor < 0 || nota_tri[t] > nota_tri[melhor]) melhor = (long long)t;
+
+    for(size_t emitidos = 0; emitidos < n_tri; emitidos++) {
+        if(melhor < 0) {
+            while(emitido[cursor]) cursor++;
+            melhor = (long long)cursor;
+        }
+        uint32_t t = (uint32_t)melhor;
+        emitido[t] = 1;
+        nova_cache.clear();
+        for(int k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            saida.push_back(v);
+            nova_cache.push_back(v);
+            // Remove t da lista de triângulos de v
+            uint32_t* lista = &adj[inicio[v]];
+            for(uint32_t j = 0; j < restantes[v]; j++)
+                if(lista[j] == t) { lista[j] = lista[restantes[v] - 1]; break; }
+            restantes[v]--;
+        }
+        for(uint32_t v : cache) if(std::find(nova_cache.begin(), nova_cache.end(), v) == nova_cache.end()) nova_cache.push_back(v);
+
+        // Atualiza posições e notas dos vértices que estavam ou estão na cache
+        for(size_t i = 0; i < nova_cache.size(); i++) {
+            uint32_t v = nova_cache[i];
+            pos_cache[v] = i < (size_t)CACHE_FORSYTH ? (int)i : -1;
+            nota_vertice[v] = nota(pos_cache[v], restantes[v]);
+        }
+        if(nova_cache.size() > (size_t)CACHE_FORSYTH) nova_cache.resize(CACHE_FORSYTH);
+        cache.swap(nova_cache);
+
+        // Próximo: o triângulo de maior nota entre os vizinhos dos vértices da cache
+        melhor = -1;
+        float melhor_nota = -1.0f;
+        for(uint32_t v : cache) {
+            for(uint32_t j = 0; j < restantes[v]; j++) {
+                uint32_t tt = adj[inicio[v] + j];
+                float s = nota_vertice[indices[tt*3]] + nota_vertice[indices[tt*3+1]] + nota_vertice[indices[tt*3+2]];
+                nota_tri[tt] = s;
+                if(s > melhor_nota) { melhor_nota = s; melhor = tt; }
+            }
+        }
+    }
+    indices.swap(saida);
+}
+
+// Renumera os vértices na ordem em que os índices os usam pela primeira vez: os vértices de
+// triângulos próximos ficam próximos na memória (e em slots diferentes da cache da pipeline).
+inline void reordenar_vertices(DadosMalha& d) {
+    uint32_t n = (uint32_t)(d.posicoes.size() / 3);
+    std::vector<uint32_t> novo(n, 0xFFFFFFFF);
+    uint32_t proximo = 0;
+    for(uint32_t& i : d.indices) {
+        if(novo[i] == 0xFFFFFFFF) novo[i] = proximo++;
+        i = novo[i];
+    }
+    std::vector<float> p(proximo * 3), nn(proximo * 3);
+    for(uint32_t v = 0; v < n; v++) {
+        if(novo[v] == 0xFFFFFFFF) continue; // Vértice sem triângulo: descartado
+        for(int k = 0; k < 3; k++) { p[novo[v] * 3 + k] = d.posicoes[v * 3 + k]; nn[novo[v] * 3 + k] = d.normais[v * 3 + k]; }
+    }
+    d.posicoes.swap(p);
+    d.normais.swap(nn);
+}
+
+// Vértices transformados por triângulo (ACMR) com uma cache FIFO de 'tamanho' entradas: 3 sem
+// reaproveitamento, ~0.5 no limite de uma malha regular
+inline double acmr_fifo(const uint32_t* indices, size_t n_indices, int tamanho = CACHE_FORSYTH) {
+    std::vector<uint32_t> fifo(tamanho, 0xFFFFFFFF);
+    size_t cabeca = 0, faltas = 0;
+    for(size_t i = 0; i < n_indices; i++) {
+        if(std::find(fifo.begin(), fifo.end(), indices[i]) != fifo.end()) continue;
+        fifo[cabeca] = indices[i];
+        cabeca = (cabeca + 1) % tamanho;
+        faltas++;
+    }
+    return n_indices ? (double)faltas / (n_indices / 3) : 0.0;
+}
+
+// ==========================================
+//   FORMATO BINÁRIO
+// ==========================================
+
+inline size_t alinhar16(size_t n) { return (n + 15) & ~(size_t)15; }
+
+// Quantiza a malha (já otimizada) e monta o conteúdo do arquivo .malha
+inline std::vector<uint8_t> montar_binario(const DadosMalha& d) {
+    uint32_t n = (uint32_t)(d.posicoes.size() / 3);
+    float mn[3] = { 1e30f, 1e30f, 1e30f }, mx[3] = { -1e30f, -1e30f, -1e30f };
+    for(uint32_t v = 0; v < n; v++)
+        for(int k = 0; k < 3; k++) { mn[k] = std::min(mn[k], d.posicoes[v*3+k]); mx[k] = std::max(mx[k], d.posicoes[v*3+k]); }
+
+    CabecalhoMalha c;
+    std::memset(&c, 0, sizeof(c));
+    std::memcpy(c.magica, "MLH1", 4);
+    c.versao = MALHA_VERSAO;
+    c.n_vertices = n; c.n_indices = (uint32_t)d.indices.size();
+    c.meia_extensao = 0;
+    for(int k = 0; k < 3; k++) { c.centro[k] = (mn[k] + mx[k]) * 0.5f; c.meia_extensao = std::max(c.meia_extensao, (mx[k] - mn[k]) * 0.5f); }
+    if(c.meia_extensao <= 0) c.meia_extensao = 1;
+    c.off_posicoes = alinhar16(sizeof(CabecalhoMalha));
+    c.off_normais = alinhar16(c.off_posicoes + (size_t)n * 4 * sizeof(int16_t));
+    c.off_indices = alinhar16(c.off_normais + (size_t)n * 4);
+    c.tamanho = c.off_indices + d.indices.size() * sizeof(uint32_t);
+
+    std::vector<uint8_t> arq(c.tamanho, 0);
+    std::memcpy(arq.data(), &c, sizeof(c));
+    int16_t* pos = (int16_t*)(arq.data() + c.off_posicoes);
+    int8_t* nor = (int8_t*)(arq.data() + c.off_normais);
+    float inv = 1.0f / c.meia_extensao;
+    for(uint32_t v = 0; v < n; v++) {
+        for(int k = 0; k < 3; k++) {
+            float p = std::min(std::max((d.posicoes[v*3+k] - c.centro[k]) * inv, -1.0f), 1.0f);
+            pos[v*4+k] = (int16_t)std::lround(p * MALHA_QUANT_POS);
+            nor[v*4+k] = (int8_t)std::lround(std::min(std::max(d.normais[v*3+k], -1.0f), 1.0f) * MALHA_QUANT_NORMAL);
+        }
+    }
+    std::memcpy(arq.data() + c.off_indices, d.indices.data(), d.indices.size() * sizeof(uint32_t));
+    return arq;
+}
+
+// Mapeia um arquivo .malha (somente leitura). nullptr se não existir ou for inválido.
+inline std::shared_ptr<Malha> mapear_malha(const char* caminho) {
+    int fd = open(caminho, O_RDONLY);
+    if(fd < 0) return nullptr;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return nullptr; }
+    void* mapa = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapa == MAP_FAILED) return nullptr;
+    std::shared_ptr<Malha> m(new Malha());
+    m->mapa = mapa; m->tamanho_mapa = (size_t)st.st_size;
+    if(!m->apontar((const uint8_t*)mapa, m->tamanho_mapa)) return nullptr;
+    m->nome = caminho;
+    return m;
+}
+
+// Grava o conteúdo em um arquivo temporário e renomeia no fim (como salvar_cena): um .malha que
+// outra Malha ainda tenha mapeado nunca é truncado, e uma gravação que falhou não deixa um
+// arquivo pela metade com data nova.
+inline bool gravar_binario(const char* destino, const std::vector<uint8_t>& arq) {
+    std::string temporario = std::string(destino) + ".tmp";
+    FILE* f = std::fopen(temporario.c_str(), "wb");
+    if(!f) return false;
+    bool ok = std::fwrite(arq.data(), 1, arq.size(), f) == arq.size();
+    ok = (std::fclose(f) == 0) && ok;
+    if(!ok || std::rename(temporario.c_str(), destino) != 0) { std::remove(temporario.c_str()); return false; }
+    return true;
+}
+
+// Converte um OBJ para .malha (otimização, quantização) e grava em 'destino'. Retorna o conteúdo;
+// 'gravado' (opcional) diz se o arquivo foi de fato gravado.
+inline std::vector<uint8_t> converter_obj(const char* obj, const char* destino, bool otimizar = true,
+                                          bool* gravado = nullptr) {
+    DadosMalha d;
+    if(gravado) *gravado = false;
+    if(!ler_obj(obj, d)) return std::vector<uint8_t>();
+    if(otimizar) otimizar_cache_vertices(d.indices, (uint32_t)(d.posicoes.size() / 3));
+    reordenar_vertices(d);
+    std::vector<uint8_t> arq = montar_binario(d);
+    if(destino) {
+        bool ok = gravar_binario(destino, arq);
+        if(gravado) *gravado = ok;
+    }
+    return arq;
+}
+
+// Carrega um modelo: um .malha é mapeado direto; um .obj é convertido para "<nome>.malha" ao lado
+// dele na primeira vez (ou quando o OBJ for mais novo) e o binário é mapeado nas seguintes.
+inline std::shared_ptr<Malha> carregar_malha(const std::string& caminho) {
+    std::string ext = caminho.size() > 4 ? caminho.substr(caminho.size() - 4) : "";
+    for(char& ch : ext) ch = (char)std::tolower((unsigned char)ch);
+    if(ext != ".obj") return mapear_malha(caminho.c_str());
+
+    std::string bin = caminho.substr(0, caminho.size() - 4) + ".malha";
+    struct stat so, sb;
+    bool atual = stat(caminho.c_str(), &so) == 0 && stat(bin.c_str(), &sb) == 0 && sb.st_mtime >= so.st_mtime;
+    if(atual) {
+        std::shared_ptr<Malha> m = mapear_malha(bin.c_str());
+        if(m) return m;
+    }
+    bool gravado;
+    std::vector<uint8_t> arq = converter_obj(caminho.c_str(), bin.c_str(), true, &gravado);
+    if(arq.empty()) return nullptr;
+    std::shared_ptr<Malha> m = gravado ? mapear_malha(bin.c_str()) : nullptr;
+    if(m) return m;
+    // Sem permissão para gravar ao lado do OBJ (o .malha antigo, se houver, está desatualizado):
+    // usa o binário montado em memória
+    m.reset(new Malha());
+    m->memoria.swap(arq);
+    if(!m->apontar(m->memoria.data(), m->memoria.size())) return nullptr;
+    m->nome = caminho;
+    return m;
+}
+
+#endif
@@ -11,7 +11,11 @@
 #include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <vector>
+#include <memory>
+#include "simd.h"
 
+// Resolução padrão da janela. O framebuffer do pipeline tem resolução própria (ParametrosFrame).
 const int SCREEN_W = 800;
 const int SCREEN_H = 600;
 
@@ -85,18 +89,141 @@ struct Mat4 {
     }
 };
 
+// Transformação Afim compacta (3x4): a última linha de uma Mat4 afim é sempre (0,0,0,1),
+// então não precisa ser guardada nem multiplicada. Usada nos estágios não projetivos (Model, View).
+struct Afim3x4 {
+    float m[3][4];
+
+    Afim3x4() {
+        for(int i=0; i<3; i++) for(int j=0; j<4; j++) m[i][j] = (i==j) ? 1.0f : 0.0f;
+    }
+
+    explicit Afim3x4(const Mat4& a) {
+        for(int i=0; i<3; i++) for(int j=0; j<4; j++) m[i][j] = a.m[i][j];
+    }
+
+    Mat4 para_mat4() const {
+        Mat4 r;
+        for(int i=0; i<3; i++) for(int j=0; j<4; j++) r.m[i][j] = m[i][j];
+        return r;
+    }
+
+    // Concatenação: 36 multiplicações em vez das 64 da Mat4
+    Afim3x4 operator*(const Afim3x4& o) const {
+        Afim3x4 r;
+        for(int i=0; i<3; i++) {
+            for(int j=0; j<3; j++) r.m[i][j] = m[i][0]*o.m[0][j] + m[i][1]*o.m[1][j] + m[i][2]*o.m[2][j];
+            r.m[i][3] = m[i][0]*o.m[0][3] + m[i][1]*o.m[1][3] + m[i][2]*o.m[2][3] + m[i][3];
+        }
+        return r;
+    }
+
+    // Aplicação em um vértice (W é preservado)
+    Vec4 operator*(const Vec4& v) const {
+        return Vec4(
+            m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z + m[0][3]*v.w,
+            m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z + m[1][3]*v.w,
+            m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z + m[2][3]*v.w,
+            v.w
+        );
+    }
+};
+
 // --- ESTRUTURAS DE CENA ---
 
+const uint32_t SEM_TEXTURA = 0xFFFFFFFF; // Material::textura dos materiais só com cores constantes
+
 struct Material {
     Vec3 ka;        // Coeficiente Ambiente (Cor da sombra)
     Vec3 kd;        // Coeficiente Difuso (Cor real do objeto)
     Vec3 ks;        // Coeficiente Especular (Cor do brilho/reflexo)
     float shininess; // Expoente de brilho (Polimento)
+    uint32_t textura = SEM_TEXTURA; // Índice em Cena::texturas (modula Ka e Kd)
+
+    bool operator==(const Material& o) const {
+        return ka.x==o.ka.x && ka.y==o.ka.y && ka.z==o.ka.z && kd.x==o.kd.x && kd.y==o.kd.y && kd.z==o.kd.z &&
+               ks.x==o.ks.x && ks.y==o.ks.y && ks.z==o.ks.z && shininess==o.shininess && textura==o.textura;
+    }
 };
 
-struct Cubo {
-    Vec4 posicao, rotacao, escala;
-    Material mat;
+// Luz pontual de alcance finito (além da luz principal de ParametrosFrame). A contribuição
+// cai suavemente até zero na distância 'raio', o que permite descartar a luz fora dessa esfera.
+struct LuzPontual {
+    Vec4 pos;      // World Space
+    Vec3 cor;
+    float raio;
+};
+
+struct Malha; // Malha indexada carregada de arquivo (ver malha.h)
+const uint32_t MALHA_CUBO = 0xFFFFFFFF; // malha_idx dos objetos que são o cubo embutido
+struct Textura; // Textura com mipmaps (ver textura.h)
+
+// Cena em estrutura de arrays (SoA): cada atributo dos cubos fica em um vetor contíguo,
+// e o material é um índice para uma tabela sem repetições. Laços que só olham posição e
+// escala (culling, BVH) percorrem apenas esses vetores.
+struct Cena {
+    std::vector<Vec4> posicoes;
+    std::vector<Vec4> rotacoes;          // Ângulos em X e Y (radianos)
+    std::vector<float> escalas;          // Escala uniforme
+    std::vector<uint32_t> material_idx;  // Índice em materiais
+    std::vector<Material> materiais;     // Tabela compartilhada
+    std::vector<LuzPontual> luzes;       // Luzes pontuais extras (ver luzes.h)
+    std::vector<uint32_t> malha_idx;     // Índice em malhas, ou MALHA_CUBO
+    std::vector<std::shared_ptr<const Malha>> malhas; // Compartilhadas com os instantâneos da cena
+    std::vector<std::shared_ptr<const Textura>> texturas; // Referenciadas pelos materiais
+
+    size_t size() const { return posicoes.size(); }
+    bool empty() const { return posicoes.empty(); }
+
+    // Índice do material na tabela, acrescentando-o se ainda não existir.
+    // Busca linear: a tabela tem poucas entradas comparada ao número de cubos.
+    uint32_t registrar_material(const Material& m) {
+        for(uint32_t i = 0; i < materiais.size(); i++) if(materiais[i] == m) return i;
+        materiais.push_back(m);
+        return (uint32_t)materiais.size() - 1;
+    }
+
+    // Acrescenta um objeto (o cubo, ou uma malha de registrar_malha) e retorna seu índice.
+    uint32_t adicionar(const Vec4& posicao, const Vec4& rotacao, float escala, uint32_t material,
+                       uint32_t malha = MALHA_CUBO) {
+        posicoes.push_back(posicao);
+        rotacoes.push_back(rotacao);
+        escalas.push_back(escala);
+        material_idx.push_back(material);
+        malha_idx.push_back(malha);
+        return (uint32_t)size() - 1;
+    }
+
+    uint32_t registrar_malha(std::shared_ptr<const Malha> m) {
+        malhas.push_back(std::move(m));
+        return (uint32_t)malhas.size() - 1;
+    }
+
+    // Índice da textura na tabela, acrescentando-a se ainda não estiver nela
+    uint32_t registrar_textura(std::shared_ptr<const Textura> t) {
+        for(uint32_t i = 0; i < texturas.size(); i++) if(texturas[i] == t) return i;
+        texturas.push_back(std::move(t));
+        return (uint32_t)texturas.size() - 1;
+    }
+
+    uint32_t adicionar_luz(const Vec4& posicao, const Vec3& cor, float raio) {
+        luzes.push_back({ posicao, cor, raio });
+        return (uint32_t)luzes.size() - 1;
+    }
+
+    // Material do cubo idx para edição. Se outro cubo também o usa, o cubo passa a ter uma
+    // cópia própria, para que a edição não altere os demais.
+    Material& material_exclusivo(uint32_t idx) {
+        uint32_t m = material_idx[idx];
+        for(uint32_t i = 0; i < size(); i++) {
+            if(i != idx && material_idx[i] == m) {
+                materiais.push_back(materiais[m]);
+                material_idx[idx] = m = (uint32_t)materiais.size() - 1;
+                break;
+            }
+        }
+        return materiais[m];
+    }
 };
 
 // --- FÁBRICA DE MATRIZES ---
@@ -125,6 +252,18 @@ inline Mat4 rotateY(float a) {
     return m; 
 }
 
+// Matriz Model completa em forma fechada: translate(pos) * rotateY(rot.y) * rotateX(rot.x) * scale(s).
+// Evita as três multiplicações de matrizes e calcula cada seno/cosseno uma única vez.
+inline Afim3x4 afim_modelo(const Vec4& pos, const Vec4& rot, float s) {
+    float cx = std::cos(rot.x), sx = std::sin(rot.x);
+    float cy = std::cos(rot.y), sy = std::sin(rot.y);
+    Afim3x4 a;
+    a.m[0][0] = cy*s;  a.m[0][1] = sy*sx*s; a.m[0][2] = sy*cx*s; a.m[0][3] = pos.x;
+    a.m[1][0] = 0;     a.m[1][1] = cx*s;    a.m[1][2] = -sx*s;   a.m[1][3] = pos.y;
+    a.m[2][0] = -sy*s; a.m[2][1] = cy*sx*s; a.m[2][2] = cy*cx*s; a.m[2][3] = pos.z;
+    return a;
+}
+
 // Projeção Perspectiva: Define o Frustum de visão.
 // Transforma o espaço de visão em Clip Space.
 inline Mat4 perspective(float fov, float aspect, float n, float f) {
@@ -140,6 +279,133 @@ inline Mat4 perspective(float fov, float aspect, float n, float f) {
     return m;
 }
 
+// --- PLANOS DO FRUSTUM ---
+
+// Plano a*x + b*y + c*z + d = 0. A distância é positiva do lado de DENTRO do volume de visão.
+struct Plano {
+    float a, b, c, d;
+    float dist(const Vec4& v) const { return a*v.x + b*v.y + c*v.z + d; }
+};
+
+// Extrai os 6 planos do frustum no View Space a partir da matriz de projeção (Gribb-Hartmann):
+// um ponto está dentro quando -w <= x, y, z <= w no Clip Space, ou seja, (linha3 ± linhaI) . v >= 0.
+// Ordem: esquerda, direita, baixo, cima, near, far. Os planos saem normalizados (|a,b,c| = 1)
+// para que dist() seja uma distância real, usada no teste de esferas envolventes.
+inline void extrair_planos_frustum(const Mat4& proj, Plano out[6]) {
+    for(int i = 0; i < 3; i++) {
+        for(int lado = 0; lado < 2; lado++) {
+            float s = (lado == 0) ? 1.0f : -1.0f;
+            Plano& p = out[i*2 + lado];
+            p.a = proj.m[3][0] + s*proj.m[i][0];
+            p.b = proj.m[3][1] + s*proj.m[i][1];
+            p.c = proj.m[3][2] + s*proj.m[i][2];
+            p.d = proj.m[3][3] + s*proj.m[i][3];
+            float len = std::sqrt(p.a*p.a + p.b*p.b + p.c*p.c);
+            if(len > 0) { p.a/=len; p.b/=len; p.c/=len; p.d/=len; }
+        }
+    }
+}
+
+// --- TRANSFORMAÇÃO EM LOTE (SIMD) ---
+
+// Código de saída (outcode) de um vértice: bit i ligado se ele está fora do plano i do frustum.
+inline int outcode_vertice(const Vec4& v, const Plano planos[6]) {
+    int oc = 0;
+    for(int pl = 0; pl < 6; pl++) if(planos[pl].dist(v) < 0) oc |= (1 << pl);
+    return oc;
+}
+
+// Projeção, divisão perspectiva e Viewport de um vértice do View Space (versão escalar do lote,
+// com as mesmas operações na mesma ordem: os dois caminhos geram coordenadas idênticas).
+inline void projetar_vertice(const Vec4& v, const Mat4& proj, int vp_x, int vp_y, int vp_w, int vp_h,
+                             float& sx, float& sy, float& w) {
+    Vec4 c = proj * v;
+    w = c.w;
+    sx = (c.x / c.w + 1.0f) * 0.5f * vp_w + vp_x;
+    sy = (1.0f - c.y / c.w) * 0.5f * vp_h + vp_y;
+}
+
+// Lote de matrizes afins em SoA: m[i][j][k] é o elemento (i,j) da matriz da instância k.
+// O tamanho é arredondado para múltiplos de SIMD_LARGURA (as sobras são preenchidas com zero).
+struct LoteAfim {
+    std::vector<float> m[3][4];
+    size_t n = 0, capacidade = 0;
+
+    void redimensionar(size_t quantidade) {
+        n = quantidade;
+        capacidade = (quantidade + SIMD_LARGURA - 1) / SIMD_LARGURA * SIMD_LARGURA;
+        for(int i=0; i<3; i++) for(int j=0; j<4; j++) m[i][j].assign(capacidade, 0.0f);
+    }
+    void definir(size_t k, const Afim3x4& a) {
+        for(int i=0; i<3; i++) for(int j=0; j<4; j++) m[i][j][k] = a.m[i][j];
+    }
+};
+
+// Vértices transformados em SoA, agrupados por vértice: o vértice v da instância k fica em
+// [v * capacidade + k] (capacidade do LoteAfim de origem).
+struct LoteVertices {
+    std::vector<float> vx, vy, vz;   // View Space (recorte, back-face e iluminação)
+    std::vector<float> sx, sy;       // Tela, após divisão perspectiva e Viewport
+    std::vector<float> w;            // W do Clip Space (profundidade do Z-Buffer)
+    std::vector<uint8_t> outcode;    // Ver outcode_vertice
+};
+
+// Transforma os n_verts vértices do objeto (ox, oy, oz, com W = 1) por todas as matrizes do lote,
+// SIMD_LARGURA instâncias por vez: Model-View, Projeção, divisão perspectiva, Viewport e outcode
+// na mesma passada. Vértices com outcode != 0 podem ter coordenadas de tela inválidas (W <= 0):
+// quem os usa deve recortá-los e projetar de novo com projetar_vertice.
+inline void transformar_lote(const LoteAfim& lote, const float* ox, const float* oy, const float* oz, int n_verts,
+                             const Mat4& proj, const Plano planos[6], int vp_x, int vp_y, int vp_w, int vp_h,
+                             LoteVertices& saida) {
+    const size_t cap = lote.capacidade;
+    const size_t total = cap * n_verts;
+    saida.vx.resize(total); saida.vy.resize(total); saida.vz.resize(total);
+    saida.sx.resize(total); saida.sy.resize(total); saida.w.resize(total);
+    saida.outcode.resize(total);
+
+    const vfloat um = vf_set(1.0f), meio = vf_set(0.5f);
+    const vfloat vpw = vf_set((float)vp_w), vph = vf_set((float)vp_h);
+    const vfloat vpx = vf_set((float)vp_x), vpy = vf_set((float)vp_y);
+
+    for(size_t k = 0; k < cap; k += SIMD_LARGURA) {
+        vfloat m[3][4];
+        for(int i=0; i<3; i++) for(int j=0; j<4; j++) m[i][j] = vf_load(&lote.m[i][j][k]);
+
+        for(int v = 0; v < n_verts; v++) {
+            vfloat x = vf_set(ox[v]), y = vf_set(oy[v]), z = vf_set(oz[v]);
+            // Model-View (afim): mesma ordem de somas de Afim3x4::operator*
+            vfloat tx = vf_add(vf_add(vf_add(vf_mul(m[0][0], x), vf_mul(m[0][1], y)), vf_mul(m[0][2], z)), m[0][3]);
+            vfloat ty = vf_add(vf_add(vf_add(vf_mul(m[1][0], x), vf_mul(m[1][1], y)), vf_mul(m[1][2], z)), m[1][3]);
+            vfloat tz = vf_add(vf_add(vf_add(vf_mul(m[2][0], x), vf_mul(m[2][1], y)), vf_mul(m[2][2], z)), m[2][3]);
+
+            // Projeção (linhas X, Y e W) e divisão perspectiva
+            vfloat c[4];
+            for(int i : { 0, 1, 3 })
+                c[i] = vf_add(vf_add(vf_add(vf_mul(vf_set(proj.m[i][0]), tx), vf_mul(vf_set(proj.m[i][1]), ty)),
+                                     vf_mul(vf_set(proj.m[i][2]), tz)), vf_set(proj.m[i][3]));
+            vfloat nx = vf_div(c[0], c[3]), ny = vf_div(c[1], c[3]);
+
+            // Viewport
+            size_t o = v * cap + k;
+            vf_store(&saida.vx[o], tx); vf_store(&saida.vy[o], ty); vf_store(&saida.vz[o], tz);
+            vf_store(&saida.sx[o], vf_add(vf_mul(vf_mul(vf_add(nx, um), meio), vpw), vpx));
+            vf_store(&saida.sy[o], vf_add(vf_mul(vf_mul(vf_sub(um, ny), meio), vph), vpy));
+            vf_store(&saida.w[o], c[3]);
+
+            // Outcodes: mesmo teste (dist < 0) do recorte Sutherland-Hodgman
+            uint8_t* oc = &saida.outcode[o];
+            for(int i = 0; i < SIMD_LARGURA; i++) oc[i] = 0;
+            for(int pl = 0; pl < 6; pl++) {
+                const Plano& p = planos[pl];
+                vfloat d = vf_add(vf_add(vf_add(vf_mul(vf_set(p.a), tx), vf_mul(vf_set(p.b), ty)), vf_mul(vf_set(p.c), tz)), vf_set(p.d));
+                int fora = vf_mask(vf_lt(d, vf_set(0.0f)));
+                if(!fora) continue;
+                for(int i = 0; i < SIMD_LARGURA; i++) if(fora & (1 << i)) oc[i] |= (uint8_t)(1 << pl);
+            }
+        }
+    }
+}
+
 // --- UTILITÁRIOS ---
 
 inline uint8_t clamp(float v) { return v>255?255:(v<0?0:(uint8_t)v); }
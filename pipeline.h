@@ -0,0 +1,1302 @@
+/**
+ * PIPELINE.H
+ * Estágios do pipeline gráfico desacoplados da janela SDL.
+ * Recebe a cena e os parâmetros do frame e desenha em um framebuffer em memória,
+ * permitindo que a aplicação interativa e o benchmark headless usem o mesmo caminho.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "rasterizer.h"
+#include "thread_pool.h"
+#include "bvh.h"
+#include "hiz.h"
+#include "malha.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+// --- GEOMETRIA (ESPAÇO DO OBJETO) ---
+const Vec4 verts_cubo[8] = { {-1,-1,-1}, {1,-1,-1}, {1,1,-1}, {-1,1,-1}, {-1,-1,1}, {1,-1,1}, {1,1,1}, {-1,1,1} };
+const int indices[12][3] = { {0,1,2}, {0,2,3}, {5,4,7}, {5,7,6}, {3,2,6}, {3,6,7}, {4,5,1}, {4,1,0}, {4,0,3}, {4,3,7}, {1,5,6}, {1,6,2} };
+
+// Coordenadas de textura dos cantos de cada triângulo do cubo (projeção em caixa: cada face
+// recebe a textura inteira), na ordem de 'indices'
+struct UVCubo {
+    float s[12][3], t[12][3];
+    UVCubo() {
+        for(int i = 0; i < 12; i++) {
+            const Vec4 o[3] = { verts_cubo[indices[i][0]], verts_cubo[indices[i][1]], verts_cubo[indices[i][2]] };
+            uv_caixa(o, s[i], t[i]);
+        }
+    }
+};
+const UVCubo uv_cubo;
+
+const int TILE = 64;                    // Lado (em pixels) dos tiles do modo multithread
+static_assert(TILE % TILE_FB == 0, "tile do modo multithread deve cobrir tiles inteiros do framebuffer");
+const float Z_NEAR = 0.1f, Z_FAR = 100.0f;
+
+// Occlusion Culling: cubos com retângulo de tela maior que isso viram oclusores na pré-passada
+const int OCLUSOR_AREA_MIN = 48 * 48;
+const int MAX_OCLUSORES = 32;
+
+// Estado global de um frame: câmera, luz, viewport e modo de shading.
+struct ParametrosFrame {
+    Vec4 cam_pos;
+    Vec4 light_pos;
+    Vec3 light_color;
+    Vec3 ambient_color;
+    float fov;
+    bool use_phong;
+    bool use_tiles = false; // Rasterização em tiles distribuída entre threads (sort-middle)
+    ModoRaster raster = RASTER_SCANLINE;
+    bool use_deferred = false; // Visibility Buffer: ilumina cada pixel visível uma única vez
+    bool use_bvh = true;    // Frustum Culling hierárquico: visita só os cubos candidatos
+    bool use_hiz = false;   // Occlusion Culling com Z-Buffer hierárquico
+    bool use_culling_luzes = true; // Luzes pontuais por tile (senão todo pixel avalia todas as luzes)
+    bool use_fb_tiles = false; // Framebuffer em tiles com limpeza por flags (ver framebuffer.h)
+    bool use_prof16 = false;   // Profundidade de 16 bits (só com use_fb_tiles)
+    bool use_msaa = false;     // MSAA 4x (ver FramebufferMSAA); no Forward, e no lugar de use_fb_tiles
+    int largura = SCREEN_W, altura = SCREEN_H; // Resolução de fb/zb (independente da janela)
+    int vp_x, vp_y, vp_w, vp_h;     // Viewport, em pixels do framebuffer
+    bool instrumentar = false; // Mede o tempo das etapas (ver instrumentacao.h)
+    bool gravar_trace = false; // Guarda eventos do trace; ao desligar, grava o arquivo
+    bool mapa_calor = false;   // Troca a imagem pelo overdraw de cada pixel
+    bool use_cache_vertices = true; // Malhas: cada vértice transformado uma vez por frame (senão, um Vertex Shader por canto)
+    bool use_sombras = false;  // Sombras da luz principal por Cube Shadow Map (ver sombras.h); só no Phong
+    bool use_texturas = true;  // Texturas dos materiais (ver textura.h); sem elas, só as cores constantes
+};
+
+// Contadores de trabalho de um frame (usados pelo benchmark).
+struct EstatisticasFrame {
+    long long objetos_transformados = 0;   // Cubos cujo cache de vértices (Model/View) foi recalculado
+    long long objetos_visitados = 0;       // Cubos candidatos testados individualmente (todos, sem a BVH)
+    long long objetos_fora_frustum = 0;    // Cubos descartados pela esfera envolvente antes do Vertex Shader
+    long long objetos_oclusores = 0;       // Cubos desenhados na pré-passada de profundidade do Hi-Z
+    long long objetos_ocluidos = 0;        // Cubos descartados pelo Hi-Z antes do Vertex Shader
+    long long triangulos_entrada = 0;      // Triângulos enviados ao pipeline (12 por cubo visível)
+    long long triangulos_malha = 0;        // Dos quais vindos de malhas indexadas
+    long long vertices_malha = 0;          // Vértices de malha transformados (Vertex Shaders executados)
+    long long triangulos_fora = 0;         // Descartados pelos outcodes (três vértices fora do mesmo plano)
+    long long triangulos_recortados = 0;   // Passaram pelo Sutherland-Hodgman
+    long long triangulos_costas = 0;       // Descartados pelo Back-Face Culling (após o recorte)
+    long long triangulos_rasterizados = 0; // Triângulos que sobreviveram ao recorte e ao culling
+    long long fragmentos_testados = 0;     // Fragmentos cobertos levados ao Z-Buffer (só com instrumentação)
+    long long fragmentos_aprovados = 0;    // Fragmentos que passaram no Z-Buffer (inclui os sobrescritos)
+    long long pixels_sombreados = 0;       // Execuções do Pixel Shader (no Deferred, uma por pixel visível)
+    long long pixels_visiveis = 0;         // Pixels cobertos na imagem final
+    long long pares_tile_luz = 0;          // Soma do tamanho das listas de luzes dos tiles
+    long long faces_sombra = 0;            // Faces do mapa de sombras refeitas neste frame (0 com o cache válido)
+    long long triangulos_sombra = 0;       // Triângulos rasterizados nessas faces
+    double ms_etapa[N_ETAPAS] = {};        // Tempo por etapa, somado entre as threads (só com instrumentação)
+
+    // Acumula os contadores de outra estatística (parciais das threads do estágio geométrico)
+    void somar(const EstatisticasFrame& o) {
+        objetos_transformados += o.objetos_transformados;
+        objetos_visitados += o.objetos_visitados;
+        objetos_fora_frustum += o.objetos_fora_frustum;
+        objetos_oclusores += o.objetos_oclusores;
+        objetos_ocluidos += o.objetos_ocluidos;
+        triangulos_entrada += o.triangulos_entrada;
+        triangulos_malha += o.triangulos_malha;
+        vertices_malha += o.vertices_malha;
+        triangulos_fora += o.triangulos_fora;
+        triangulos_recortados += o.triangulos_recortados;
+        triangulos_costas += o.triangulos_costas;
+        triangulos_rasterizados += o.triangulos_rasterizados;
+        fragmentos_testados += o.fragmentos_testados;
+        fragmentos_aprovados += o.fragmentos_aprovados;
+        pixels_sombreados += o.pixels_sombreados;
+        pixels_visiveis += o.pixels_visiveis;
+        pares_tile_luz += o.pares_tile_luz;
+        faces_sombra += o.faces_sombra;
+        triangulos_sombra += o.triangulos_sombra;
+        for(int i = 0; i < N_ETAPAS; i++) ms_etapa[i] += o.ms_etapa[i];
+    }
+
+    // Overdraw: execuções do Pixel Shader por pixel visível (no Forward, os fragmentos aprovados
+    // no Z-Buffer, inclusive os sobrescritos depois; no Deferred, 1)
+    double overdraw() const { return pixels_visiveis ? (double)pixels_sombreados / pixels_visiveis : 0.0; }
+
+    // ACMR das malhas: vértices transformados por triângulo (3 sem cache; ~0.5 numa malha fechada)
+    double acmr() const { return triangulos_malha ? (double)vertices_malha / triangulos_malha : 0.0; }
+};
+
+// MSAA só no Forward: o Visibility Buffer do Deferred guarda um triângulo por pixel
+inline bool usa_msaa(const ParametrosFrame& p) { return p.use_msaa && !p.use_deferred; }
+
+// As sombras só entram no Pixel Shader do Phong (o Flat ilumina uma vez por triângulo)
+inline bool usa_sombras(const ParametrosFrame& p) { return p.use_sombras && p.use_phong; }
+
+// O frame é desenhado em um framebuffer do contexto (em tiles ou com amostras) e chega a fb só por
+// resolver_framebuffer; fb e zb então não precisam de limpar_buffers.
+inline bool usa_framebuffer_contexto(const ParametrosFrame& p) { return p.use_fb_tiles || usa_msaa(p); }
+
+// --- PREPARAÇÃO DO FRAME (Limpeza) ---
+inline void limpar_buffers(std::vector<uint32_t>& fb, std::vector<float>& zb) {
+    std::fill(fb.begin(), fb.end(), COR_FUNDO);
+    std::fill(zb.begin(), zb.end(), Z_LIMPO);
+}
+
+// Triângulo já projetado em coordenadas de tela, com tudo que o rasterizador precisa.
+// É a saída do estágio geométrico e a entrada dos rasterizadores (direto ou em tiles).
+struct TrianguloTela {
+    int x1, y1, x2, y2, x3, y3;
+    float z1, z2, z3;       // Profundidade (W) usada no Z-Buffer
+    Vec4 t1, t2, t3;        // Posições no View Space (interpoladas para a luz no Phong)
+    Vec4 n;                 // Normal da face
+    float s[3], t[3];       // Coordenadas de textura dos vértices (só se o material tiver textura)
+    Vec4 nv[3];             // Normais dos vértices no View Space (só com 'suave')
+    bool suave;             // Phong com a normal interpolada dos vértices (malhas); senão a da face
+    uint32_t material;      // Índice em ContextoRender::luz
+    uint32_t cor_flat;      // Cor constante do Flat Shading (calculada uma vez por triângulo)
+    int min_x, min_y, max_x, max_y; // Caixa envolvente em pixels (para o binning)
+};
+
+// Estágio geométrico paralelo: os cubos visíveis são divididos em blocos processados por threads
+// diferentes. Cada bloco grava um segmento contíguo no vetor de saída da sua tarefa
+// (ContextoRender::saidas); o id de um triângulo é (bloco << BITS_LOCAL) | posição no segmento,
+// o que mantém a ordem de cena sem copiar nada.
+const int OBJETOS_POR_BLOCO = 64;
+const int BITS_LOCAL = 16;
+static_assert(OBJETOS_POR_BLOCO * 12 * (CLIP_MAX_SAIDA / 3) < (1 << BITS_LOCAL), "segmento maior que o id local");
+
+// Malhas indexadas são divididas em trechos de triângulos consecutivos (na ordem otimizada para a
+// cache), cada um uma tarefa do estágio geométrico com seu próprio segmento.
+const int TRIANGULOS_POR_TRECHO = 2048;
+static_assert(TRIANGULOS_POR_TRECHO * (CLIP_MAX_SAIDA / 3) < (1 << BITS_LOCAL), "trecho maior que o id local");
+
+// Antes dos trechos, os vértices de cada malha visível são transformados uma única vez no frame,
+// em lotes distribuídos entre as threads, e os trechos os indexam diretamente.
+const int VERTICES_POR_LOTE = 4096;
+
+struct SegmentoTriangulos {
+    uint32_t quantidade;
+    const TrianguloTela* base;   // Resolvido após o estágio (as saídas podem crescer durante ele)
+};
+
+// Fluxo de triângulos consumido pelo rasterizador, em ordem de submissão.
+struct FluxoTriangulos {
+    std::vector<SegmentoTriangulos> segmentos;
+
+    const TrianguloTela& operator[](uint32_t id) const {
+        return segmentos[id >> BITS_LOCAL].base[id & ((1u << BITS_LOCAL) - 1)];
+    }
+};
+
+// Malha visível no frame: a Model-View, calculada uma vez por objeto, e a posição dos seus
+// vértices transformados em ContextoRender::vertices_malha
+struct MalhaVisivel {
+    uint32_t idx;
+    uint32_t primeiro_vertice;
+    Afim3x4 mv;          // Com a dequantização das posições (int16 -> [-1,1]) embutida nas colunas
+};
+
+// Triângulos (em ContextoRender::trechos) ou vértices (em lotes_malha) [primeiro, primeiro + quantidade)
+// da malha visível 'malha'
+struct TrechoMalha {
+    uint32_t malha, primeiro, quantidade;
+};
+
+// Vértice de malha já transformado (saída do Vertex Shader)
+struct VerticeTransformado {
+    Vec4 view;
+    Vec4 normal;         // Normal da malha no View Space (não normalizada)
+    float tela[3];       // Tela e W, válidos só com outcode == 0
+    int outcode;
+};
+
+// Cubo que sobreviveu ao Frustum Culling, com o que os estágios seguintes precisam.
+struct ObjetoVisivel {
+    uint32_t idx;
+    bool tem_retangulo;   // Retângulo de tela válido (esfera inteira à frente do near)
+    int x0, y0, x1, y1;   // Retângulo de tela da esfera (inclusivo)
+    float z_min;          // Profundidade mais próxima da esfera
+};
+
+// Cache de transformação de um cubo. A matriz Model só muda quando o cubo é editado e os
+// vértices transformados só mudam quando ele ou a câmera (View, Projeção, Viewport) se movem;
+// cena e câmera paradas não fazem nenhuma conta por objeto.
+struct CacheTransformacao {
+    Afim3x4 model;
+    Vec4 view_verts[8];
+    float tela_x[8], tela_y[8], tela_w[8]; // Tela e W, válidos só nos vértices com outcode == 0
+    uint8_t outcode[8];
+    bool modelo_sujo = true;     // Marcado por atualizar_objeto (edição de posição/rotação/escala)
+    uint32_t versao_camera = 0;  // Versão da câmera com que os vértices foram calculados
+};
+
+// Arena de uma thread no estágio geométrico: o rascunho das tarefas que ela executa, reiniciado
+// (e não liberado) a cada frame. Os triângulos não ficam aqui, e sim na saída de cada tarefa: com
+// o roubo de trabalho, quanto cada thread processa muda de um frame para o outro, e uma thread
+// que recebesse mais tarefas que no frame anterior teria de crescer sua arena.
+struct ArenaGeometria {
+    std::vector<uint32_t> pendentes;   // Cubos com cache obsoleto a transformar em lote
+    std::vector<VerticeTransformado> vertices; // Sem use_cache_vertices: um vértice por canto do trecho atual
+    std::vector<Vec4> vertices_sombra; // Vértices de uma malha no espaço de uma face do mapa de sombras
+    std::vector<int> outcodes_sombra;
+    LoteAfim lote_model_view;
+    LoteVertices lote_vertices;
+    EstatisticasFrame st;
+
+    // Já no tamanho de uma tarefa (um bloco de cubos ou um trecho de malha): uma thread que pega
+    // sua primeira tarefa depois de muitos frames também não aloca.
+    void reservar() {
+        pendentes.reserve(OBJETOS_POR_BLOCO);
+        lote_model_view.redimensionar(OBJETOS_POR_BLOCO);
+        size_t n = lote_model_view.capacidade * 8;
+        LoteVertices& v = lote_vertices;
+        v.vx.reserve(n); v.vy.reserve(n); v.vz.reserve(n); v.sx.reserve(n); v.sy.reserve(n); v.w.reserve(n);
+        v.outcode.reserve(n);
+        vertices.reserve(TRIANGULOS_POR_TRECHO * 3);
+    }
+
+    void reiniciar() { pendentes.clear(); st = EstatisticasFrame(); }
+};
+
+// Estado persistente entre frames: arenas e fluxo de triângulos, bins dos tiles e threads.
+// Os vetores são apenas limpos a cada frame, reaproveitando a memória já alocada.
+struct ContextoRender {
+    std::vector<ArenaGeometria> arenas;      // Uma por thread do pool
+    std::vector<std::vector<TrianguloTela>> saidas; // Triângulos de cada tarefa do estágio geométrico
+    FluxoTriangulos fluxo;
+    std::vector<std::vector<uint32_t>> bins; // Índices de triângulos por tile, em ordem de submissão
+    std::vector<RegistroVisibilidade> vis;   // Visibility Buffer do modo Deferred
+    BVHCena bvh;                             // Índice espacial dos cubos (ver atualizar_objeto)
+    std::vector<uint32_t> candidatos;        // Cubos que a BVH não descartou neste frame
+    std::vector<ObjetoVisivel> visiveis;      // Cubos dentro do frustum neste frame
+    std::vector<MalhaVisivel> malhas;         // Malhas visíveis neste frame
+    std::vector<TrechoMalha> lotes_malha;     // Lotes de vértices dessas malhas
+    std::vector<TrechoMalha> trechos;         // Trechos de triângulos dessas malhas
+    std::vector<VerticeTransformado> vertices_malha; // Seus vértices transformados neste frame
+    std::vector<uint32_t> oclusores;         // Índices (em visiveis) dos oclusores do Hi-Z
+    std::vector<TrianguloTela> tris_oclusores;
+    std::vector<float> zb_oclusores;         // Profundidade só dos oclusores (base da pirâmide)
+    PiramideZ hiz;
+    std::vector<ConstantesLuz> luz;          // Constantes de iluminação de cada material neste frame
+    GradeLuzes luzes;                        // Luzes pontuais no View Space e suas listas por tile
+    Vec4 luz_view;                           // Luz principal no View Space neste frame
+    MapaSombras sombras;                     // Cube Shadow Map da luz principal (guardado entre frames)
+    FramebufferTiles quadro;                 // Destino do frame com use_fb_tiles (até resolver_framebuffer)
+    FramebufferMSAA msaa;                    // Destino do frame com MSAA (até resolver_framebuffer)
+    Instrumentacao instr;                    // Tempos por etapa e trace (ver instrumentacao.h)
+    std::vector<uint8_t> calor;              // Mapa de calor do overdraw, mesmo índice do framebuffer
+    std::vector<CacheTransformacao> transformacoes; // Um por cubo, na ordem da cena
+    Afim3x4 view_cache;                       // View, Projeção e Viewport do último frame
+    Mat4 proj_cache;
+    int vp_cache[4] = { 0, 0, 0, 0 };
+    uint32_t versao_camera = 1;               // Incrementada a cada mudança de um deles
+    PoolThreads pool;
+
+    explicit ContextoRender(int n_threads = 0) : pool(n_threads) {
+        arenas.resize(pool.num_threads());
+        for(ArenaGeometria& a : arenas) a.reservar();
+    }
+};
+
+// --- ÍNDICE ESPACIAL E CACHE DE TRANSFORMAÇÕES ---
+// A BVH e o cache precisam saber quando a cena muda: edições de posição/rotação/escala de um
+// cubo fazem um refit incremental e sujam seu cache; inserções e remoções reconstroem tudo.
+inline void reconstruir_indice(ContextoRender& ctx, const Cena& cena) {
+    ctx.bvh.construir(cena);
+    ctx.transformacoes.assign(cena.size(), CacheTransformacao());
+    ctx.sombras.invalidar();
+}
+
+inline void atualizar_objeto(ContextoRender& ctx, const Cena& cena, int idx) {
+    if(ctx.bvh.num_objetos() != cena.size() || ctx.transformacoes.size() != cena.size()) {
+        reconstruir_indice(ctx, cena);
+        return;
+    }
+    ctx.bvh.atualizar(cena, idx);
+    if(idx >= 0 && (size_t)idx < cena.size()) {
+        ctx.transformacoes[idx].modelo_sujo = true;
+        ctx.sombras.objeto_movido(cena.posicoes[idx], 1.7320508f * std::fabs(cena.escalas[idx]), idx);
+    }
+}
+
+// Lista, em ordem de cena, os cubos que podem tocar o frustum. A ordem original é mantida
+// para que a submissão de triângulos (e portanto a imagem) não dependa da travessia.
+inline void selecionar_candidatos(ContextoRender& ctx, const Cena& cena, const ParametrosFrame& p,
+                                  const Mat4& view, const Plano frustum[6]) {
+    ctx.candidatos.clear();
+    if(!p.use_bvh) {
+        for(uint32_t i = 0; i < cena.size(); i++) ctx.candidatos.push_back(i);
+        return;
+    }
+    if(ctx.bvh.num_objetos() != cena.size()) ctx.bvh.construir(cena);
+
+    Plano mundo[6];
+    for(int i = 0; i < 6; i++) mundo[i] = plano_para_mundo(frustum[i], view);
+    ctx.bvh.consultar_frustum(mundo, ctx.candidatos);
+    std::sort(ctx.candidatos.begin(), ctx.candidatos.end());
+}
+
+// --- ESTÁGIO GEOMÉTRICO ---
+
+// Câmera do frame: matrizes e planos calculados uma vez e compartilhados pelos estágios.
+struct CameraFrame {
+    Mat4 proj, view;
+    Vec4 lightPosView;
+    Plano frustum[6];
+};
+
+inline CameraFrame montar_camera(const ParametrosFrame& p) {
+    CameraFrame cam;
+    // Estágio: Definição da Câmera (Matriz View) e Lente (Matriz Projection)
+    cam.proj = perspective(p.fov, (float)p.largura/p.altura, Z_NEAR, Z_FAR);
+    cam.view = translate(-p.cam_pos.x, -p.cam_pos.y, -p.cam_pos.z);
+    cam.lightPosView = cam.view * p.light_pos;
+    extrair_planos_frustum(cam.proj, cam.frustum);
+    return cam;
+}
+
+// Compara View, Projeção e Viewport do frame com as do cache: se algum mudou, todos os vértices
+// transformados ficam obsoletos (as matrizes Model continuam válidas).
+inline void verificar_camera(ContextoRender& ctx, const CameraFrame& cam, const ParametrosFrame& p) {
+    Afim3x4 view(cam.view);
+    int vp[4] = { p.vp_x, p.vp_y, p.vp_w, p.vp_h };
+    if(std::memcmp(view.m, ctx.view_cache.m, sizeof(view.m)) != 0 ||
+       std::memcmp(cam.proj.m, ctx.proj_cache.m, sizeof(cam.proj.m)) != 0 ||
+       std::memcmp(vp, ctx.vp_cache, sizeof(vp)) != 0) {
+        ctx.view_cache = view;
+        ctx.proj_cache = cam.proj;
+        std::memcpy(ctx.vp_cache, vp, sizeof(vp));
+        ctx.versao_camera++;
+    }
+}
+
+// Estágio: Vertex Shader em lote. Os cubos de a.pendentes com cache obsoleto são transformados
+// juntos (Model-View, Projeção, Viewport e outcodes, SIMD_LARGURA cubos por vez) e o resultado
+// volta para o cache de cada um. Esvazia a.pendentes. Threads diferentes podem chamar em paralelo
+// desde que suas listas não tenham cubos em comum.
+inline void transformar_pendentes(ContextoRender& ctx, ArenaGeometria& a, const Cena& cena, const CameraFrame& cam,
+                                  const ParametrosFrame& p, EstatisticasFrame& st) {
+    size_t n = 0;
+    for(uint32_t idx : a.pendentes) {
+        const CacheTransformacao& c = ctx.transformacoes[idx];
+        if(c.modelo_sujo || c.versao_camera != ctx.versao_camera) a.pendentes[n++] = idx;
+    }
+    a.pendentes.resize(n);
+    if(n == 0) return;
+
+    LoteAfim& lote = a.lote_model_view;
+    lote.redimensionar(n);
+    for(size_t k = 0; k < n; k++) {
+        uint32_t idx = a.pendentes[k];
+        CacheTransformacao& c = ctx.transformacoes[idx];
+        if(c.modelo_sujo) {
+            // Estágio: Matriz Model (Transforma Objeto -> Mundo)
+            c.model = afim_modelo(cena.posicoes[idx], cena.rotacoes[idx], cena.escalas[idx]);
+            c.modelo_sujo = false;
+        }
+        lote.definir(k, ctx.view_cache * c.model); // Combinada para levar ao View Space
+    }
+
+    float ox[8], oy[8], oz[8];
+    for(int v = 0; v < 8; v++) { ox[v] = verts_cubo[v].x; oy[v] = verts_cubo[v].y; oz[v] = verts_cubo[v].z; }
+    const LoteVertices& r = a.lote_vertices;
+    transformar_lote(lote, ox, oy, oz, 8, cam.proj, cam.frustum, p.vp_x, p.vp_y, p.vp_w, p.vp_h, a.lote_vertices);
+
+    for(size_t k = 0; k < n; k++) {
+        CacheTransformacao& c = ctx.transformacoes[a.pendentes[k]];
+        for(int v = 0; v < 8; v++) {
+            size_t o = v * lote.capacidade + k;
+            c.view_verts[v] = Vec4(r.vx[o], r.vy[o], r.vz[o]);
+            c.tela_x[v] = r.sx[o]; c.tela_y[v] = r.sy[o]; c.tela_w[v] = r.w[o];
+            c.outcode[v] = r.outcode[o];
+        }
+        c.versao_camera = ctx.versao_camera;
+    }
+    st.objetos_transformados += n;
+    a.pendentes.clear();
+}
+
+// Coordenadas baricêntricas de p (no plano do triângulo abc) em relação a a, b e c
+inline void baricentricas(const Vec4& p, const Vec4& a, const Vec4& b, const Vec4& c, float w[3]) {
+    Vec4 n = (b - a).cross(c - a);
+    float inv = 1.0f / n.dot(n);
+    w[1] = (p - a).cross(c - a).dot(n) * inv;
+    w[2] = (b - a).cross(p - a).dot(n) * inv;
+    w[0] = 1.0f - w[1] - w[2];
+}
+
+// Recorte, Back-Face Culling e montagem dos triângulos de tela de um triângulo já transformado
+// (vértices no View Space, outcodes e, nos vértices com outcode 0, tela e W).
+// Os outcodes decidem o caminho: todos os vértices fora do mesmo plano, descarte; todos dentro,
+// usa as coordenadas de tela já calculadas; senão, recorta só nos planos violados.
+// 's' e 't' (ou nullptr) são as coordenadas de textura dos vértices, usadas se o material tiver
+// textura, e 'normais' (ou nullptr) as normais dos vértices no View Space; nos vértices criados
+// pelo recorte, umas e outras vêm das baricêntricas no triângulo original.
+inline void montar_triangulo(const ContextoRender& ctx, uint32_t material, const Vec4& v1, const Vec4& v2, const Vec4& v3,
+                             const int oc[3], const float tela[3][3], const float* s_uv, const float* t_uv,
+                             const Vec4* normais, const CameraFrame& cam, const ParametrosFrame& p,
+                             std::vector<TrianguloTela>& saida, EstatisticasFrame& st) {
+    st.triangulos_entrada++;
+    if(oc[0] & oc[1] & oc[2]) { st.triangulos_fora++; return; }
+    int mascara_planos = oc[0] | oc[1] | oc[2];
+
+    // Estágio: Clipping (Recorte Geométrico Sutherland-Hodgman nos planos violados)
+    Vec4 clipped[CLIP_MAX_SAIDA];
+    int n_clipped = 3;
+    if(mascara_planos) {
+        n_clipped = clip_triangle_sutherland_hodgman(v1, v2, v3, cam.frustum, mascara_planos, clipped);
+        st.triangulos_recortados++;
+    }
+    else { clipped[0] = v1; clipped[1] = v2; clipped[2] = v3; }
+
+    // Processa os triângulos resultantes do recorte
+    for(int k=0; k < n_clipped; k+=3) {
+        Vec4 t1 = clipped[k], t2 = clipped[k+1], t3 = clipped[k+2];
+
+        // Estágio: Back-Face Culling (No View Space)
+        Vec4 n = (t3 - t1).cross(t2 - t1); n.normalize();
+        if(n.dot(t1 * -1.0f) <= 0) { st.triangulos_costas++; continue; } // Descarta se não olha para a câmera
+
+        // Estágio: Projeção, Divisão Perspectiva e Viewport (já feitos no Vertex Shader se não houve recorte)
+        float s[3][3];
+        if(mascara_planos) {
+            projetar_vertice(t1, cam.proj, p.vp_x, p.vp_y, p.vp_w, p.vp_h, s[0][0], s[0][1], s[0][2]);
+            projetar_vertice(t2, cam.proj, p.vp_x, p.vp_y, p.vp_w, p.vp_h, s[1][0], s[1][1], s[1][2]);
+            projetar_vertice(t3, cam.proj, p.vp_x, p.vp_y, p.vp_w, p.vp_h, s[2][0], s[2][1], s[2][2]);
+        } else {
+            for(int j = 0; j < 3; j++) { s[j][0] = tela[j][0]; s[j][1] = tela[j][1]; s[j][2] = tela[j][2]; }
+        }
+
+        TrianguloTela t;
+        t.x1 = (int)s[0][0]; t.y1 = (int)s[0][1];
+        t.x2 = (int)s[1][0]; t.y2 = (int)s[1][1];
+        t.x3 = (int)s[2][0]; t.y3 = (int)s[2][1];
+        t.z1 = s[0][2]; t.z2 = s[1][2]; t.z3 = s[2][2];
+        t.t1 = t1; t.t2 = t2; t.t3 = t3;
+        t.n = n;
+        const bool uv = s_uv && ctx.luz[material].textura;
+        t.suave = normais && p.use_phong;
+        if(uv || t.suave) {
+            const Vec4* c[3] = { &t1, &t2, &t3 };
+            for(int j = 0; j < 3; j++) {
+                float w[3] = { j == 0 ? 1.0f : 0.0f, j == 1 ? 1.0f : 0.0f, j == 2 ? 1.0f : 0.0f };
+                if(mascara_planos) baricentricas(*c[j], v1, v2, v3, w);
+                if(uv) {
+                    t.s[j] = w[0] * s_uv[0] + w[1] * s_uv[1] + w[2] * s_uv[2];
+                    t.t[j] = w[0] * t_uv[0] + w[1] * t_uv[1] + w[2] * t_uv[2];
+                }
+                if(t.suave) t.nv[j] = normais[0] * w[0] + normais[1] * w[1] + normais[2] * w[2];
+            }
+        }
+        t.material = material;
+        t.min_x = std::min(t.x1, std::min(t.x2, t.x3)); t.max_x = std::max(t.x1, std::max(t.x2, t.x3));
+        t.min_y = std::min(t.y1, std::min(t.y2, t.y3)); t.max_y = std::max(t.y1, std::max(t.y2, t.y3));
+
+        // Flat Shading: Calcula luz uma vez por triângulo (com luzes pontuais, só depois
+        // do culling de luzes, em iluminar_flat)
+        if(!p.use_phong && ctx.luzes.vazia()) {
+            Vec4 centro = (t1 + t2 + t3) * 0.333f;
+            t.cor_flat = calc_luz_rgb(centro, n, ctx.luz[material], cam.lightPosView, Vec4(0,0,0));
+        }
+        saida.push_back(t);
+        st.triangulos_rasterizados++;
+    }
+}
+
+// Triângulos de tela de um cubo já transformado (vértices no cache do objeto)
+inline void processar_objeto(const ContextoRender& ctx, uint32_t material, const CacheTransformacao& c,
+                             const CameraFrame& cam, const ParametrosFrame& p, std::vector<TrianguloTela>& saida,
+                             EstatisticasFrame& st) {
+    for(int i=0; i<12; i++) {
+        const int iv[3] = { indices[i][0], indices[i][1], indices[i][2] };
+        int oc[3];
+        float tela[3][3];
+        for(int j = 0; j < 3; j++) {
+            oc[j] = c.outcode[iv[j]];
+            tela[j][0] = c.tela_x[iv[j]]; tela[j][1] = c.tela_y[iv[j]]; tela[j][2] = c.tela_w[iv[j]];
+        }
+        montar_triangulo(ctx, material, c.view_verts[iv[0]], c.view_verts[iv[1]], c.view_verts[iv[2]], oc, tela,
+                         uv_cubo.s[i], uv_cubo.t[i], nullptr, cam, p, saida, st);
+    }
+}
+
+// Estágio: Frustum Culling (Esfera envolvente no View Space)
+// Cubos totalmente fora de algum plano são descartados antes de qualquer transformação;
+// nos demais, os outcodes dos vértices decidem o recorte triângulo a triângulo.
+inline void culling_frustum(ContextoRender& ctx, const Cena& cena, const CameraFrame& cam,
+                            const ParametrosFrame& p, EstatisticasFrame& st) {
+    ctx.visiveis.clear();
+    for(uint32_t idx : ctx.candidatos) {
+        Vec4 centro = cam.view * cena.posicoes[idx];
+        float raio = 1.7320508f * std::fabs(cena.escalas[idx]); // Meia diagonal do cubo [-1,1]^3
+        ObjetoVisivel ov;
+        ov.idx = idx;
+        bool fora = false;
+        for(int pl = 0; pl < 6 && !fora; pl++) fora = cam.frustum[pl].dist(centro) < -raio;
+        if(fora) { st.objetos_fora_frustum++; continue; }
+
+        ov.tem_retangulo = p.use_hiz && retangulo_esfera(centro, raio, cam.proj, p.vp_x, p.vp_y, p.vp_w, p.vp_h,
+                                                         p.largura, p.altura, Z_NEAR, ov.x0, ov.y0, ov.x1, ov.y1, ov.z_min);
+        ctx.visiveis.push_back(ov);
+    }
+}
+
+// Estágio: Occlusion Culling (Hi-Z)
+// Pré-passada: os maiores cubos na tela (oclusores) têm apenas a profundidade rasterizada em um
+// buffer próprio, do qual se constrói a pirâmide Hi-Z. Cada cubo visível é então testado pelo
+// seu retângulo de tela; os ocultos são marcados (idx = VIS_NENHUM) e pulam o Vertex Shader.
+inline void culling_oclusao(ContextoRender& ctx, const Cena& cena, const CameraFrame& cam,
+                            const ParametrosFrame& p, EstatisticasFrame& st) {
+    ctx.oclusores.clear();
+    for(uint32_t i = 0; i < ctx.visiveis.size(); i++) {
+        const ObjetoVisivel& ov = ctx.visiveis[i];
+        // Só cubos: a malha não preenche necessariamente o seu volume envolvente
+        if(ov.tem_retangulo && cena.malha_idx[ov.idx] == MALHA_CUBO &&
+           (ov.x1 - ov.x0 + 1) * (ov.y1 - ov.y0 + 1) >= OCLUSOR_AREA_MIN) ctx.oclusores.push_back(i);
+    }
+    if(ctx.oclusores.empty()) return;
+
+    // Os mais próximos primeiro: tendem a esconder mais
+    if(ctx.oclusores.size() > (size_t)MAX_OCLUSORES) {
+        std::partial_sort(ctx.oclusores.begin(), ctx.oclusores.begin() + MAX_OCLUSORES, ctx.oclusores.end(),
+                          [&](uint32_t a, uint32_t b) { return ctx.visiveis[a].z_min < ctx.visiveis[b].z_min; });
+        ctx.oclusores.resize(MAX_OCLUSORES);
+    }
+
+    EstatisticasFrame st_pre;
+    ParametrosFrame p_pre = p;
+    p_pre.use_phong = true; // Não calcula a cor flat dos oclusores
+    ctx.tris_oclusores.clear();
+    ArenaGeometria& a = ctx.arenas[0]; // Poucos oclusores: a pré-passada roda na thread chamadora
+    for(uint32_t i : ctx.oclusores) a.pendentes.push_back(ctx.visiveis[i].idx);
+    transformar_pendentes(ctx, a, cena, cam, p, st);
+    for(uint32_t i : ctx.oclusores) {
+        uint32_t idx = ctx.visiveis[i].idx;
+        processar_objeto(ctx, cena.material_idx[idx], ctx.transformacoes[idx], cam, p_pre, ctx.tris_oclusores, st_pre);
+    }
+
+    ctx.zb_oclusores.assign(p.largura * p.altura, Z_LIMPO);
+    EstadoRaster e = EstadoRaster();
+    e.zb = ctx.zb_oclusores.data();
+    e.largura = p.largura; e.altura = p.altura;
+    e.vpx = p.vp_x; e.vpy = p.vp_y; e.vpw = p.vp_w; e.vph = p.vp_h;
+    for(const TrianguloTela& t : ctx.tris_oclusores)
+        fill_edge<SAIDA_PROFUNDIDADE, false>({ t.x1, t.y1, t.z1, t.t1 }, { t.x2, t.y2, t.z2, t.t2 }, { t.x3, t.y3, t.z3, t.t3 }, e);
+    ctx.hiz.construir(ctx.zb_oclusores, p.largura, p.altura);
+    st.objetos_oclusores = ctx.oclusores.size();
+
+    for(ObjetoVisivel& ov : ctx.visiveis) {
+        if(ov.tem_retangulo && ctx.hiz.ocluido(ov.x0, ov.y0, ov.x1, ov.y1, ov.z_min)) {
+            ov.idx = VIS_NENHUM;
+            st.objetos_ocluidos++;
+        }
+    }
+}
+
+// Estágio geométrico de um bloco de cubos visíveis: transforma em lote os que têm cache obsoleto
+// e acrescenta seus triângulos de tela, em ordem de cena, na arena da thread. Objetos com malha
+// ficam para processar_trecho.
+inline void processar_bloco(ContextoRender& ctx, const Cena& cena, const CameraFrame& cam, const ParametrosFrame& p,
+                            int bloco, int thread) {
+    ArenaGeometria& a = ctx.arenas[thread];
+    size_t ini = (size_t)bloco * OBJETOS_POR_BLOCO;
+    size_t fim = std::min(ini + OBJETOS_POR_BLOCO, ctx.visiveis.size());
+    for(size_t i = ini; i < fim; i++) {
+        uint32_t idx = ctx.visiveis[i].idx;
+        if(idx != VIS_NENHUM && cena.malha_idx[idx] == MALHA_CUBO) a.pendentes.push_back(idx);
+    }
+    {
+        MEDIR_ETAPA(ctx.instr, ETAPA_VERTICES);
+        transformar_pendentes(ctx, a, cena, cam, p, a.st);
+    }
+
+    MEDIR_ETAPA(ctx.instr, ETAPA_RECORTE);
+    std::vector<TrianguloTela>& tris = ctx.saidas[bloco];
+    tris.clear();
+    for(size_t i = ini; i < fim; i++) {
+        uint32_t idx = ctx.visiveis[i].idx;
+        if(idx == VIS_NENHUM || cena.malha_idx[idx] != MALHA_CUBO) continue;
+        processar_objeto(ctx, cena.material_idx[idx], ctx.transformacoes[idx], cam, p, tris, a.st);
+    }
+    ctx.fluxo.segmentos[bloco].quantidade = (uint32_t)tris.size();
+}
+
+// Vertex Shader de um vértice de malha: Model-View, outcode e, dentro do frustum, Projeção e Viewport
+inline VerticeTransformado transformar_vertice_malha(const Malha& m, uint32_t iv, const Afim3x4& mv,
+                                                     const CameraFrame& cam, const ParametrosFrame& p) {
+    const int16_t* q = m.posicoes + (size_t)iv * 4;
+    VerticeTransformado vt;
+    vt.view = mv * Vec4(q[0], q[1], q[2]);
+    const int8_t* qn = m.normais + (size_t)iv * 4;
+    vt.normal = mv * Vec4(qn[0], qn[1], qn[2], 0); // Direção: só a rotação (a escala é uniforme)
+    vt.outcode = outcode_vertice(vt.view, cam.frustum);
+    if(vt.outcode == 0) projetar_vertice(vt.view, cam.proj, p.vp_x, p.vp_y, p.vp_w, p.vp_h, vt.tela[0], vt.tela[1], vt.tela[2]);
+    else vt.tela[0] = vt.tela[1] = vt.tela[2] = 0;
+    return vt;
+}
+
+// Transforma um lote de vértices de uma malha visível para ctx.vertices_malha
+inline void transformar_lote_malha(ContextoRender& ctx, const Cena& cena, const CameraFrame& cam, const ParametrosFrame& p,
+                                   int lote, int thread) {
+    MEDIR_ETAPA(ctx.instr, ETAPA_VERTICES);
+    const TrechoMalha& l = ctx.lotes_malha[lote];
+    const MalhaVisivel& mv = ctx.malhas[l.malha];
+    const Malha& m = *cena.malhas[cena.malha_idx[mv.idx]];
+    VerticeTransformado* saida = ctx.vertices_malha.data() + mv.primeiro_vertice;
+    for(uint32_t iv = l.primeiro; iv < l.primeiro + l.quantidade; iv++) saida[iv] = transformar_vertice_malha(m, iv, mv.mv, cam, p);
+    ctx.arenas[thread].st.vertices_malha += l.quantidade;
+}
+
+// Estágio geométrico de um trecho de malha: monta os triângulos a partir dos vértices já
+// transformados por transformar_lote_malha. Sem use_cache_vertices, o Vertex Shader roda aqui,
+// uma vez por canto de triângulo.
+inline void processar_trecho(ContextoRender& ctx, const Cena& cena, const CameraFrame& cam, const ParametrosFrame& p,
+                             int trecho, int segmento, int thread) {
+    ArenaGeometria& a = ctx.arenas[thread];
+    const TrechoMalha& tr = ctx.trechos[trecho];
+    const MalhaVisivel& mv = ctx.malhas[tr.malha];
+    const Malha& m = *cena.malhas[cena.malha_idx[mv.idx]];
+    const uint32_t* idx = m.indices + (size_t)tr.primeiro * 3;
+    const uint32_t n_cantos = tr.quantidade * 3;
+    const VerticeTransformado* vertices = ctx.vertices_malha.data() + mv.primeiro_vertice;
+    if(!p.use_cache_vertices) {
+        MEDIR_ETAPA(ctx.instr, ETAPA_VERTICES);
+        a.vertices.resize(n_cantos);
+        for(uint32_t c = 0; c < n_cantos; c++) a.vertices[c] = transformar_vertice_malha(m, idx[c], mv.mv, cam, p);
+        a.st.vertices_malha += n_cantos;
+    }
+
+    MEDIR_ETAPA(ctx.instr, ETAPA_RECORTE);
+    std::vector<TrianguloTela>& tris = ctx.saidas[segmento];
+    tris.clear();
+    uint32_t material = cena.material_idx[mv.idx];
+    const bool texturizada = ctx.luz[material].textura != nullptr;
+    for(uint32_t c = 0; c < n_cantos; c += 3) {
+        // O OBJ usa a ordem anti-horária para a frente; o pipeline, a horária (como em 'indices')
+        const uint32_t cantos[3] = { c, c + 2, c + 1 };
+        const VerticeTransformado* v[3];
+        int oc[3];
+        float tela[3][3];
+        Vec4 normais[3];
+        for(int j = 0; j < 3; j++) {
+            v[j] = p.use_cache_vertices ? &vertices[idx[cantos[j]]] : &a.vertices[cantos[j]];
+            oc[j] = v[j]->outcode;
+            tela[j][0] = v[j]->tela[0]; tela[j][1] = v[j]->tela[1]; tela[j][2] = v[j]->tela[2];
+            normais[j] = v[j]->normal;
+        }
+        // Com textura: projeção em caixa das posições no objeto (o .malha não tem coordenadas de textura)
+        float s_uv[3], t_uv[3];
+        if(texturizada) {
+            Vec4 o[3];
+            for(int j = 0; j < 3; j++) {
+                const int16_t* q = m.posicoes + (size_t)idx[cantos[j]] * 4;
+                o[j] = Vec4(q[0], q[1], q[2]) * (1.0f / MALHA_QUANT_POS);
+            }
+            uv_caixa(o, s_uv, t_uv);
+        }
+        montar_triangulo(ctx, material, v[0]->view, v[1]->view, v[2]->view, oc, tela,
+                         texturizada ? s_uv : nullptr, t_uv, normais, cam, p, tris, a.st);
+    }
+    a.st.triangulos_malha += tr.quantidade;
+    ctx.fluxo.segmentos[segmento].quantidade = (uint32_t)tris.size();
+}
+
+// Gera o fluxo de triângulos de tela do frame.
+inline void gerar_triangulos(ContextoRender& ctx, const Cena& cena, const ParametrosFrame& p,
+                             EstatisticasFrame& st) {
+    for(ArenaGeometria& a : ctx.arenas) a.reiniciar();
+    CameraFrame cam = montar_camera(p);
+    if(ctx.transformacoes.size() != cena.size()) reconstruir_indice(ctx, cena);
+    verificar_camera(ctx, cam, p);
+
+    ctx.luz_view = cam.lightPosView;
+    ctx.luz.resize(cena.materiais.size());
+    for(size_t m = 0; m < cena.materiais.size(); m++) {
+        const Material& mat = cena.materiais[m];
+        ctx.luz[m] = montar_constantes_luz(mat, p.light_color, p.ambient_color);
+        if(p.use_texturas && mat.textura < cena.texturas.size()) ctx.luz[m].textura = cena.texturas[mat.textura].get();
+    }
+    {
+        MEDIR_ETAPA(ctx.instr, ETAPA_LUZES);
+        ctx.luzes.preparar(cena.luzes, cam.view, p.largura, p.altura);
+    }
+
+    {
+        MEDIR_ETAPA(ctx.instr, ETAPA_CULLING);
+        selecionar_candidatos(ctx, cena, p, cam.view, cam.frustum);
+        st.objetos_visitados = ctx.candidatos.size();
+        culling_frustum(ctx, cena, cam, p, st);
+        if(p.use_hiz) culling_oclusao(ctx, cena, cam, p, st);
+    }
+
+    // Malhas visíveis divididas em lotes de vértices e trechos de triângulos; os segmentos dos
+    // trechos vêm depois dos blocos de cubos
+    ctx.malhas.clear();
+    ctx.lotes_malha.clear();
+    ctx.trechos.clear();
+    uint32_t n_vertices = 0;
+    for(const ObjetoVisivel& ov : ctx.visiveis) {
+        if(ov.idx == VIS_NENHUM || cena.malha_idx[ov.idx] == MALHA_CUBO) continue;
+        const Malha& m = *cena.malhas[cena.malha_idx[ov.idx]];
+        uint32_t malha = (uint32_t)ctx.malhas.size();
+        MalhaVisivel mv = { ov.idx, n_vertices, ctx.view_cache * afim_modelo(cena.posicoes[ov.idx], cena.rotacoes[ov.idx], cena.escalas[ov.idx]) };
+        for(int i = 0; i < 3; i++) for(int j = 0; j < 3; j++) mv.mv.m[i][j] *= 1.0f / MALHA_QUANT_POS;
+        ctx.malhas.push_back(mv);
+        if(p.use_cache_vertices) {
+            for(uint32_t v = 0; v < m.n_vertices; v += VERTICES_POR_LOTE)
+                ctx.lotes_malha.push_back({ malha, v, std::min<uint32_t>(VERTICES_POR_LOTE, m.n_vertices - v) });
+            n_vertices += m.n_vertices;
+        }
+        uint32_t n = m.n_triangulos();
+        for(uint32_t t = 0; t < n; t += TRIANGULOS_POR_TRECHO)
+            ctx.trechos.push_back({ malha, t, std::min<uint32_t>(TRIANGULOS_POR_TRECHO, n - t) });
+    }
+    if(!ctx.lotes_malha.empty()) {
+        ctx.vertices_malha.resize(n_vertices);
+        ctx.pool.executar_por_thread((int)ctx.lotes_malha.size(), [&](int lote, int thread) {
+            transformar_lote_malha(ctx, cena, cam, p, lote, thread);
+        });
+    }
+
+    // Blocos de cubos e trechos de malha distribuídos entre as threads por roubo de trabalho
+    int blocos = (int)((ctx.visiveis.size() + OBJETOS_POR_BLOCO - 1) / OBJETOS_POR_BLOCO);
+    int tarefas = blocos + (int)ctx.trechos.size();
+    ctx.fluxo.segmentos.resize(tarefas);
+    if(ctx.saidas.size() < (size_t)tarefas) ctx.saidas.resize(tarefas); // Só cresce: as saídas guardam a capacidade
+    ctx.pool.executar_por_thread(tarefas, [&](int tarefa, int thread) {
+        if(tarefa < blocos) processar_bloco(ctx, cena, cam, p, tarefa, thread);
+        else processar_trecho(ctx, cena, cam, p, tarefa - blocos, tarefa, thread);
+    });
+
+    for(int s = 0; s < tarefas; s++) ctx.fluxo.segmentos[s].base = ctx.saidas[s].data();
+    for(const ArenaGeometria& a : ctx.arenas) st.somar(a.st);
+}
+
+// --- LUZES PONTUAIS ---
+// Culling de luzes por tile: a faixa de profundidade de cada tile vem das caixas envolventes
+// dos triângulos do frame (conservadora, vale para Forward e Deferred) e cada luz entra nas
+// listas dos tiles que sua esfera de alcance toca.
+inline void distribuir_luzes(ContextoRender& ctx, const ParametrosFrame& p, EstatisticasFrame& st) {
+    MEDIR_ETAPA(ctx.instr, ETAPA_LUZES);
+    GradeLuzes& g = ctx.luzes;
+    for(const SegmentoTriangulos& seg : ctx.fluxo.segmentos) {
+        for(uint32_t j = 0; j < seg.quantidade; j++) {
+            const TrianguloTela& t = seg.base[j];
+            g.expandir(t.min_x, t.min_y, t.max_x, t.max_y,
+                       std::min(t.z1, std::min(t.z2, t.z3)), std::max(t.z1, std::max(t.z2, t.z3)));
+        }
+    }
+    CameraFrame cam = montar_camera(p);
+    st.pares_tile_luz = g.distribuir(cam.proj, p.vp_x, p.vp_y, p.vp_w, p.vp_h, Z_NEAR, p.use_culling_luzes);
+}
+
+// Flat Shading com luzes pontuais: a cor de cada triângulo usa as luzes do tile que contém
+// o centro da sua projeção. Paralelo por segmento (cada tarefa só escreve nos seus triângulos).
+inline void iluminar_flat(ContextoRender& ctx, const ParametrosFrame& p) {
+    MEDIR_ETAPA(ctx.instr, ETAPA_SOMBREAMENTO);
+    CameraFrame cam = montar_camera(p);
+    ctx.pool.executar((int)ctx.fluxo.segmentos.size(), [&](int s) {
+        for(TrianguloTela& t : ctx.saidas[s]) {
+            int cx = std::min(std::max((t.x1 + t.x2 + t.x3) / 3, 0), p.largura - 1);
+            int cy = std::min(std::max((t.y1 + t.y2 + t.y3) / 3, 0), p.altura - 1);
+            Vec4 centro = (t.t1 + t.t2 + t.t3) * 0.333f;
+            t.cor_flat = calc_luz_rgb(centro, t.n, ctx.luz[t.material], cam.lightPosView, Vec4(0,0,0),
+                                      &ctx.luzes, &ctx.luzes.lista_pixel(cx, cy));
+        }
+    });
+}
+
+// --- SOMBRAS DA LUZ PRINCIPAL ---
+// As faces sujas do Cube Shadow Map (ver sombras.h) são refeitas antes do frame, uma por tarefa do
+// pool. Cada face é um frame só de profundidade com a câmera na luz: Model-View da face, outcodes,
+// recorte, projeção de 90° e fill_edge<SAIDA_PROFUNDIDADE>, como a pré-passada do Hi-Z.
+
+// Triângulo no espaço da face levado ao mapa. Só entram os voltados para longe da luz (faces de
+// trás): o oclusor de um objeto fechado fica atrás da sua própria superfície iluminada. A
+// profundidade é -1/W, que, ao contrário de W, varia linearmente na tela.
+inline void desenhar_triangulo_sombra(const MapaSombras& m, const Vec4& a, const Vec4& b, const Vec4& c,
+                                      const int oc[3], const EstadoRaster& e, long long& tris) {
+    if(oc[0] & oc[1] & oc[2]) return;
+    Vec4 n = (c - a).cross(b - a);
+    if(n.dot(a) <= 0) return; // Voltado para a luz (na origem)
+    int mascara_planos = oc[0] | oc[1] | oc[2];
+    Vec4 buf[CLIP_MAX_SAIDA];
+    int k = 3;
+    if(mascara_planos) k = clip_triangle_sutherland_hodgman(a, b, c, m.planos, mascara_planos, buf);
+    else { buf[0] = a; buf[1] = b; buf[2] = c; }
+    const int N = RESOLUCAO_SOMBRA;
+    for(int i = 0; i < k; i += 3) {
+        VerticeRaster v[3];
+        for(int j = 0; j < 3; j++) {
+            float sx, sy, w;
+            projetar_vertice(buf[i + j], m.proj, 0, 0, N, N, sx, sy, w);
+            v[j] = { (int)sx, (int)sy, -1.0f / w, buf[i + j] };
+        }
+        fill_edge<SAIDA_PROFUNDIDADE, false>(v[0], v[1], v[2], e);
+        tris++;
+    }
+}
+
+// Refaz a face f com os objetos cuja esfera envolvente a toca, usando a arena da thread para os
+// vértices das malhas. Retorna os triângulos desenhados.
+inline long long renderizar_face_sombra(ContextoRender& ctx, const Cena& cena, int f, ArenaGeometria& a) {
+    MapaSombras& m = ctx.sombras;
+    const int N = RESOLUCAO_SOMBRA;
+    float* prof = m.prof_face(f);
+    std::fill(prof, prof + N * N, Z_LIMPO);
+    EstadoRaster e = EstadoRaster();
+    e.zb = prof;
+    e.largura = N; e.altura = N;
+    e.vpx = 0; e.vpy = 0; e.vpw = N; e.vph = N;
+
+    long long tris = 0;
+    std::vector<Vec4>& vertices = a.vertices_sombra;
+    std::vector<int>& outcodes = a.outcodes_sombra;
+    for(uint32_t idx = 0; idx < cena.size(); idx++) {
+        if(!(m.faces_objeto[idx] & (1 << f))) continue;
+        Afim3x4 mv = m.view[f] * afim_modelo(cena.posicoes[idx], cena.rotacoes[idx], cena.escalas[idx]);
+        if(cena.malha_idx[idx] == MALHA_CUBO) {
+            Vec4 v[8];
+            int oc[8];
+            for(int i = 0; i < 8; i++) { v[i] = mv * verts_cubo[i]; oc[i] = outcode_vertice(v[i], m.planos); }
+            for(int i = 0; i < 12; i++) {
+                const int* t = indices[i];
+                const int oct[3] = { oc[t[0]], oc[t[1]], oc[t[2]] };
+                desenhar_triangulo_sombra(m, v[t[0]], v[t[1]], v[t[2]], oct, e, tris);
+            }
+            continue;
+        }
+        // Malha: cada vértice transformado uma vez, com a dequantização embutida (ver processar_trecho)
+        const Malha& malha = *cena.malhas[cena.malha_idx[idx]];
+        for(int i = 0; i < 3; i++) for(int j = 0; j < 3; j++) mv.m[i][j] *= 1.0f / MALHA_QUANT_POS;
+        vertices.resize(malha.n_vertices);
+        outcodes.resize(malha.n_vertices);
+        for(uint32_t i = 0; i < malha.n_vertices; i++) {
+            const int16_t* q = malha.posicoes + (size_t)i * 4;
+            vertices[i] = mv * Vec4(q[0], q[1], q[2]);
+            outcodes[i] = outcode_vertice(vertices[i], m.planos);
+        }
+        for(uint32_t c = 0; c < malha.n_indices; c += 3) {
+            // Ordem anti-horária do OBJ trocada para a horária do pipeline
+            const uint32_t i0 = malha.indices[c], i1 = malha.indices[c + 2], i2 = malha.indices[c + 1];
+            const int oct[3] = { outcodes[i0], outcodes[i1], outcodes[i2] };
+            desenhar_triangulo_sombra(m, vertices[i0], vertices[i1], vertices[i2], oct, e, tris);
+        }
+    }
+    return tris;
+}
+
+// Deixa o mapa de sombras válido para a luz e a cena do frame: com ambas paradas, não faz nada.
+inline void atualizar_sombras(ContextoRender& ctx, const Cena& cena, const ParametrosFrame& p, EstatisticasFrame& st) {
+    MapaSombras& m = ctx.sombras;
+    m.posicionar_luz(p.light_pos);
+    if(m.faces_objeto.size() != cena.size()) m.invalidar();
+    if(!m.sujas) return;
+    {
+        MEDIR_ETAPA(ctx.instr, ETAPA_SOMBRAS);
+        if(m.prof.empty()) m.prof.resize((size_t)FACES_SOMBRA * RESOLUCAO_SOMBRA * RESOLUCAO_SOMBRA);
+        // Faces de cada objeto com a luz atual (base para sujar as faces certas na próxima edição)
+        m.faces_objeto.resize(cena.size());
+        for(uint32_t idx = 0; idx < cena.size(); idx++)
+            m.faces_objeto[idx] = m.faces_esfera(cena.posicoes[idx], 1.7320508f * std::fabs(cena.escalas[idx]));
+    }
+
+    int faces[FACES_SOMBRA], n = 0;
+    for(int f = 0; f < FACES_SOMBRA; f++) if(m.sujas & (1 << f)) faces[n++] = f;
+    std::atomic<long long> tris(0);
+    ctx.pool.executar_por_thread(n, [&](int i, int thread) {
+        MEDIR_ETAPA(ctx.instr, ETAPA_SOMBRAS);
+        tris += renderizar_face_sombra(ctx, cena, faces[i], ctx.arenas[thread]);
+    });
+    m.sujas = 0;
+    st.faces_sombra = n;
+    st.triangulos_sombra = tris.load();
+}
+
+// --- ESTÁGIO DE RASTERIZAÇÃO ---
+// Destino comum dos núcleos, restrito ao retângulo de recorte (sx, sy, sw, sh): o viewport no
+// modo direto, ou a interseção viewport/tile no modo em tiles. Com use_fb_tiles o destino é o
+// framebuffer em tiles do contexto, e fb/zb não são usados.
+inline EstadoRaster estado_raster(ContextoRender& ctx, const ParametrosFrame& p,
+                                  std::vector<uint32_t>& fb, std::vector<float>& zb,
+                                  int sx, int sy, int sw, int sh) {
+    EstadoRaster e;
+    if(p.use_fb_tiles) {
+        FramebufferTiles& q = ctx.quadro;
+        e.fb = q.cor.data();
+        e.zb = q.prof.empty() ? nullptr : q.prof.data();
+        e.zb16 = q.prof_16.empty() ? nullptr : q.prof_16.data();
+        e.tiles_x = q.tiles_x;
+    } else {
+        e.fb = fb.data(); e.zb = zb.data();
+        e.zb16 = nullptr;
+        e.tiles_x = 0;
+    }
+    e.largura = p.largura; e.altura = p.altura;
+    e.vis = ctx.vis.empty() ? nullptr : ctx.vis.data();
+    e.msaa = usa_msaa(p) ? &ctx.msaa : nullptr;
+    e.thread = 0;
+    e.vpx = sx; e.vpy = sy; e.vpw = sw; e.vph = sh;
+    e.cor = 0; e.tri = 0;
+    e.setup = nullptr;
+    e.luzes = ctx.luzes.vazia() ? nullptr : &ctx.luzes;
+    e.testados = nullptr;
+    e.calor = (INSTRUMENTACAO && p.mapa_calor) ? ctx.calor.data() : nullptr;
+    return e;
+}
+
+// Setup do Pixel Shader de um triângulo do fluxo (Forward, MSAA e 2ª passada do Deferred), com os
+// planos das coordenadas de textura se o material tiver textura e as normais dos vértices nas malhas.
+inline SetupPhong setup_triangulo(const ContextoRender& ctx, const TrianguloTela& t, const ParametrosFrame& p) {
+    SetupPhong s = montar_setup_phong(t.n, ctx.luz[t.material], ctx.luz_view, Vec4(0,0,0), usa_sombras(p) ? &ctx.sombras : nullptr);
+    if(s.textura) {
+        const float x[3] = { (float)t.x1, (float)t.x2, (float)t.x3 }, y[3] = { (float)t.y1, (float)t.y2, (float)t.y3 };
+        const float w[3] = { t.z1, t.z2, t.z3 };
+        s.plano = montar_plano_textura(x, y, w, t.s, t.t);
+    }
+    if(t.suave) {
+        const Vec4 v[3] = { t.t1, t.t2, t.t3 };
+        montar_normais_suaves(s, v, t.nv);
+    }
+    return s;
+}
+
+// Desenha o triângulo de id i (ver FluxoTriangulos) com uma combinação fixa de modos.
+// Retorna os fragmentos aprovados no Z-Buffer.
+template<ModoRaster RASTER, SaidaRaster SAIDA, bool LUZES, class F>
+inline int rasterizar_variante(ContextoRender& ctx, uint32_t i, const ParametrosFrame& p, EstadoRaster e) {
+    const TrianguloTela& t = ctx.fluxo[i];
+    VerticeRaster v1 = { t.x1, t.y1, t.z1, t.t1 };
+    VerticeRaster v2 = { t.x2, t.y2, t.z2, t.t2 };
+    VerticeRaster v3 = { t.x3, t.y3, t.z3, t.t3 };
+    e.cor = t.cor_flat;
+    e.tri = i;
+
+    // Setup do Pixel Shader uma vez por triângulo; no laço só entram as baricêntricas
+    SetupPhong setup;
+    if(SAIDA == SAIDA_PHONG) {
+        setup = setup_triangulo(ctx, t, p);
+        e.setup = &setup;
+    }
+
+    // Estágio: Rasterização (Funções de Aresta SIMD + ZBuffer + Pixel Shader)
+    if(RASTER == RASTER_EDGE) return fill_edge<SAIDA, LUZES, F>(v1, v2, v3, e);
+
+    // Estágio: Rasterização (Scanline + ZBuffer + Pixel Shader). O recorte por linha só entra
+    // se a caixa envolvente do triângulo sai do retângulo de recorte.
+    bool dentro = t.min_x >= std::max(e.vpx, 0) && t.max_x < std::min(e.vpx + e.vpw, e.largura) &&
+                  t.min_y >= std::max(e.vpy, 0) && t.max_y < std::min(e.vpy + e.vph, e.altura);
+    return dentro ? fill_scanline<SAIDA, LUZES, false, F>(v1, v2, v3, e)
+                  : fill_scanline<SAIDA, LUZES, true, F>(v1, v2, v3, e);
+}
+
+// MSAA: sempre pelas funções de aresta (o scanline não tem posições de amostra), Flat ou Phong
+template<SaidaRaster SAIDA, bool LUZES>
+inline int rasterizar_msaa(ContextoRender& ctx, uint32_t i, const ParametrosFrame& p, EstadoRaster e) {
+    const TrianguloTela& t = ctx.fluxo[i];
+    VerticeRaster v1 = { t.x1, t.y1, t.z1, t.t1 };
+    VerticeRaster v2 = { t.x2, t.y2, t.z2, t.t2 };
+    VerticeRaster v3 = { t.x3, t.y3, t.z3, t.t3 };
+    e.cor = t.cor_flat;
+    SetupPhong setup;
+    if(SAIDA == SAIDA_PHONG) {
+        setup = setup_triangulo(ctx, t, p);
+        e.setup = &setup;
+    }
+    return fill_edge_msaa<SAIDA, LUZES>(v1, v2, v3, e);
+}
+
+typedef int (*NucleoTriangulo)(ContextoRender&, uint32_t, const ParametrosFrame&, EstadoRaster);
+
+// Tabela de despacho: o núcleo é escolhido uma vez por frame, e não testado a cada triângulo.
+// Deferred (1ª passada) e Flat não dependem das luzes pontuais (a cor flat já as inclui).
+template<class F>
+inline NucleoTriangulo nucleo_formato(ModoRaster raster, SaidaRaster saida, bool luzes) {
+    static const NucleoTriangulo tabela[2][3][2] = {
+        { // RASTER_SCANLINE
+            { rasterizar_variante<RASTER_SCANLINE, SAIDA_FLAT, false, F>,         rasterizar_variante<RASTER_SCANLINE, SAIDA_FLAT, false, F> },
+            { rasterizar_variante<RASTER_SCANLINE, SAIDA_PHONG, false, F>,        rasterizar_variante<RASTER_SCANLINE, SAIDA_PHONG, true, F> },
+            { rasterizar_variante<RASTER_SCANLINE, SAIDA_VISIBILIDADE, false, F>, rasterizar_variante<RASTER_SCANLINE, SAIDA_VISIBILIDADE, false, F> },
+        },
+        { // RASTER_EDGE
+            { rasterizar_variante<RASTER_EDGE, SAIDA_FLAT, false, F>,             rasterizar_variante<RASTER_EDGE, SAIDA_FLAT, false, F> },
+            { rasterizar_variante<RASTER_EDGE, SAIDA_PHONG, false, F>,            rasterizar_variante<RASTER_EDGE, SAIDA_PHONG, true, F> },
+            { rasterizar_variante<RASTER_EDGE, SAIDA_VISIBILIDADE, false, F>,     rasterizar_variante<RASTER_EDGE, SAIDA_VISIBILIDADE, false, F> },
+        },
+    };
+    return tabela[raster][saida][luzes ? 1 : 0];
+}
+
+inline NucleoTriangulo selecionar_nucleo(const ParametrosFrame& p, bool luzes) {
+    SaidaRaster saida = p.use_deferred ? SAIDA_VISIBILIDADE : (p.use_phong ? SAIDA_PHONG : SAIDA_FLAT);
+    if(usa_msaa(p)) {
+        if(saida == SAIDA_FLAT) return rasterizar_msaa<SAIDA_FLAT, false>;
+        return luzes ? rasterizar_msaa<SAIDA_PHONG, true> : rasterizar_msaa<SAIDA_PHONG, false>;
+    }
+    if(!p.use_fb_tiles) return nucleo_formato<FormatoLinear>(p.raster, saida, luzes);
+    if(p.use_prof16) return nucleo_formato<FormatoTiles16>(p.raster, saida, luzes);
+    return nucleo_formato<FormatoTiles>(p.raster, saida, luzes);
+}
+
+// Deferred, 2ª passada: ilumina uma única vez cada pixel coberto do retângulo [x0,x1) x [y0,y1).
+// Um pixel só tem registro válido se algum fragmento passou no Z-Buffer (zb < Z_LIMPO),
+// então o Visibility Buffer não precisa ser limpo a cada frame. No framebuffer em tiles, os
+// tiles não tocados no frame (flag de validade zerada) são pulados sem ler a profundidade.
+template<class F>
+inline long long sombrear_visibilidade(ContextoRender& ctx, const ParametrosFrame& p, const EstadoRaster& e,
+                                       int x0, int y0, int x1, int y1) {
+    const int W = SIMD_LARGURA;
+    auto coberto = [&](int i) { return F::PROF16 ? e.zb16[i] != PROF16_LIMPO : e.zb[i] < Z_LIMPO; };
+    auto indice = [&](int x, int y) { return F::indice(x, y, e.largura, e.tiles_x); };
+    long long sombreados = 0;
+    for(int y = y0; y < y1; y++) {
+        int x = x0;
+        while(x < x1) {
+            if(F::TILES && !ctx.quadro.tile_valido(x, y)) { x = std::min(x1, (x / TILE_FB + 1) * TILE_FB); continue; }
+            int idx = indice(x, y);
+            if(!coberto(idx)) { x++; continue; }
+            uint32_t tri = ctx.vis[idx].tri;
+            const TrianguloTela& t = ctx.fluxo[tri];
+            if(!p.use_phong) { e.fb[idx] = t.cor_flat; sombreados++; x++; continue; }
+
+            // Sequência de pixels do mesmo triângulo na linha (e no mesmo tile de luz, se houver
+            // luzes pontuais): um setup, sombreada em lotes SIMD
+            SetupPhong setup = setup_triangulo(ctx, t, p);
+            const GradeLuzes* luzes = ctx.luzes.vazia() ? nullptr : &ctx.luzes;
+            const std::vector<uint32_t>* lista = luzes ? &luzes->lista_pixel(x, y) : nullptr;
+            int fim = luzes ? std::min(x1, (x / TILE_LUZ + 1) * TILE_LUZ) : x1;
+            if(F::TILES) fim = std::min(fim, (x / TILE_FB + 1) * TILE_FB); // Não entra em outro tile
+            while(x < fim) {
+                float lx[W], ly[W], lz[W], cx[W];
+                int li[W], k = 0;
+                for(; x < fim && k < W; x++) {
+                    int i = indice(x, y);
+                    if(!coberto(i)) continue;
+                    const RegistroVisibilidade& r = ctx.vis[i];
+                    if(r.tri != tri) break;
+                    lx[k] = r.px; ly[k] = r.py; lz[k] = r.pz; cx[k] = x + 0.5f; li[k] = i; k++;
+                }
+                if(k == 0) break;
+                for(int j = k; j < W; j++) { lx[j] = lx[0]; ly[j] = ly[0]; lz[j] = lz[0]; cx[j] = cx[0]; }
+                vfloat albedo[3];
+                const vfloat* a = albedo_textura(setup, vf_load(cx), vf_set(y + 0.5f), (1 << k) - 1, albedo);
+                uint32_t cores[W];
+                vi_store(cores, sombrear_phong(setup, vf_load(lx), vf_load(ly), vf_load(lz), luzes, lista, a));
+                for(int j = 0; j < k; j++) e.fb[li[j]] = cores[j];
+                sombreados += k;
+                if(k < W) break;
+            }
+        }
+    }
+    return sombreados;
+}
+
+inline long long sombrear_visibilidade(ContextoRender& ctx, const ParametrosFrame& p, const EstadoRaster& e,
+                                       int x0, int y0, int x1, int y1) {
+    if(!p.use_fb_tiles) return sombrear_visibilidade<FormatoLinear>(ctx, p, e, x0, y0, x1, y1);
+    if(p.use_prof16) return sombrear_visibilidade<FormatoTiles16>(ctx, p, e, x0, y0, x1, y1);
+    return sombrear_visibilidade<FormatoTiles>(ctx, p, e, x0, y0, x1, y1);
+}
+
+// Forward: conta os pixels cobertos do retângulo [x0,x1) x [y0,y1) depois da rasterização (no
+// Deferred, é o que sombrear_visibilidade devolve). No framebuffer em tiles, os pixels de uma linha
+// dentro de um tile são contíguos, e os tiles não tocados no frame são pulados.
+template<class F>
+inline long long contar_visiveis(const ContextoRender& ctx, const EstadoRaster& e, int x0, int y0, int x1, int y1) {
+    long long visiveis = 0;
+    for(int y = y0; y < y1; y++) {
+        int x = x0;
+        while(x < x1) {
+            int fim = F::TILES ? std::min(x1, (x / TILE_FB + 1) * TILE_FB) : x1;
+            if(F::TILES && !ctx.quadro.tile_valido(x, y)) { x = fim; continue; }
+            int i = F::indice(x, y, e.largura, e.tiles_x), n = fim - x;
+            if(F::PROF16) for(int k = 0; k < n; k++) visiveis += e.zb16[i + k] != PROF16_LIMPO;
+            else for(int k = 0; k < n; k++) visiveis += e.zb[i + k] < Z_LIMPO;
+            x = fim;
+        }
+    }
+    return visiveis;
+}
+
+inline long long contar_visiveis(const ContextoRender& ctx, const ParametrosFrame& p, const EstadoRaster& e,
+                                 int x0, int y0, int x1, int y1) {
+    if(e.msaa) return e.msaa->pixels_cobertos(x0, y0, x1, y1);
+    if(!p.use_fb_tiles) return contar_visiveis<FormatoLinear>(ctx, e, x0, y0, x1, y1);
+    if(p.use_prof16) return contar_visiveis<FormatoTiles16>(ctx, e, x0, y0, x1, y1);
+    return contar_visiveis<FormatoTiles>(ctx, e, x0, y0, x1, y1);
+}
+
+// Modo direto: uma thread, triângulos na ordem de submissão.
+inline void rasterizar_direto(ContextoRender& ctx, const ParametrosFrame& p,
+                              std::vector<uint32_t>& fb, std::vector<float>& zb, EstatisticasFrame& st) {
+    int rx0 = std::max(p.vp_x, 0), ry0 = std::max(p.vp_y, 0);
+    int rx1 = std::min(p.vp_x + p.vp_w, p.largura), ry1 = std::min(p.vp_y + p.vp_h, p.altura);
+    if(p.use_fb_tiles) {
+        // Framebuffer em tiles: limpa só os tiles que as caixas envolventes tocam
+        MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+        for(const SegmentoTriangulos& seg : ctx.fluxo.segmentos) {
+            for(uint32_t j = 0; j < seg.quantidade; j++) {
+                const TrianguloTela& t = seg.base[j];
+                int x0 = std::max(t.min_x, rx0), x1 = std::min(t.max_x, rx1 - 1);
+                int y0 = std::max(t.min_y, ry0), y1 = std::min(t.max_y, ry1 - 1);
+                if(x0 <= x1 && y0 <= y1) ctx.quadro.preparar_retangulo(x0, y0, x1, y1);
+            }
+        }
+    }
+
+    NucleoTriangulo nucleo = selecionar_nucleo(p, !ctx.luzes.vazia());
+    EstadoRaster e = estado_raster(ctx, p, fb, zb, p.vp_x, p.vp_y, p.vp_w, p.vp_h);
+    if(ctx.instr.ativo) e.testados = &st.fragmentos_testados;
+    {
+        MEDIR_ETAPA(ctx.instr, ETAPA_RASTER);
+        for(uint32_t s = 0; s < ctx.fluxo.segmentos.size(); s++)
+            for(uint32_t j = 0; j < ctx.fluxo.segmentos[s].quantidade; j++)
+                st.fragmentos_aprovados += nucleo(ctx, (s << BITS_LOCAL) | j, p, e);
+    }
+
+    if(p.use_deferred) {
+        MEDIR_ETAPA(ctx.instr, ETAPA_SOMBREAMENTO);
+        long long sombreados = sombrear_visibilidade(ctx, p, e, rx0, ry0, rx1, ry1);
+        st.pixels_sombreados += sombreados;
+        st.pixels_visiveis += sombreados;
+    } else {
+        // Forward: o Pixel Shader rodou uma vez por fragmento aprovado
+        st.pixels_sombreados += st.fragmentos_aprovados;
+        st.pixels_visiveis += contar_visiveis(ctx, p, e, rx0, ry0, rx1, ry1);
+    }
+}
+
+// Modo em tiles (sort-middle): os triângulos são distribuídos nos tiles que sua caixa envolvente
+// toca e cada tile é rasterizado por uma thread. Como cada tile só escreve na sua fatia de fb/zb
+// e processa os triângulos na mesma ordem do modo direto, o resultado é idêntico, sem locks.
+// Com o framebuffer em tiles, a thread limpa os tiles do framebuffer do seu tile logo antes de
+// rasterizá-lo, e eles continuam na cache durante a rasterização.
+inline void rasterizar_tiles(ContextoRender& ctx, const ParametrosFrame& p,
+                             std::vector<uint32_t>& fb, std::vector<float>& zb, EstatisticasFrame& st) {
+    // Região desenhável: interseção do viewport com a tela
+    int rx0 = std::max(p.vp_x, 0), ry0 = std::max(p.vp_y, 0);
+    int rx1 = std::min(p.vp_x + p.vp_w, p.largura), ry1 = std::min(p.vp_y + p.vp_h, p.altura);
+    if(rx0 >= rx1 || ry0 >= ry1) return;
+
+    const int tiles_x = (p.largura + TILE - 1) / TILE;
+    const int tiles_y = (p.altura + TILE - 1) / TILE;
+    ctx.bins.resize(tiles_x * tiles_y);
+    for(auto& b : ctx.bins) b.clear();
+
+    // Binning (medido como parte do raster)
+    {
+        MEDIR_ETAPA(ctx.instr, ETAPA_RASTER);
+        for(uint32_t s = 0; s < ctx.fluxo.segmentos.size(); s++) {
+            const SegmentoTriangulos& seg = ctx.fluxo.segmentos[s];
+            for(uint32_t j = 0; j < seg.quantidade; j++) {
+                const TrianguloTela& t = seg.base[j];
+                int x0 = std::max(t.min_x, rx0), x1 = std::min(t.max_x, rx1 - 1);
+                int y0 = std::max(t.min_y, ry0), y1 = std::min(t.max_y, ry1 - 1);
+                if(x0 > x1 || y0 > y1) continue;
+                for(int ty = y0 / TILE; ty <= y1 / TILE; ty++)
+                    for(int tx = x0 / TILE; tx <= x1 / TILE; tx++)
+                        ctx.bins[ty * tiles_x + tx].push_back((s << BITS_LOCAL) | j);
+            }
+        }
+    }
+
+    NucleoTriangulo nucleo = selecionar_nucleo(p, !ctx.luzes.vazia());
+    std::atomic<long long> aprovados(0), sombreados(0), visiveis(0), testados(0);
+    ctx.pool.executar_por_thread(tiles_x * tiles_y, [&](int tile, int thread) {
+        const std::vector<uint32_t>& bin = ctx.bins[tile];
+        if(bin.empty()) return;
+        int sx = std::max((tile % tiles_x) * TILE, rx0), sy = std::max((tile / tiles_x) * TILE, ry0);
+        int sw = std::min((tile % tiles_x) * TILE + TILE, rx1) - sx;
+        int sh = std::min((tile / tiles_x) * TILE + TILE, ry1) - sy;
+        long long local = 0, testados_tile = 0;
+        EstadoRaster e = estado_raster(ctx, p, fb, zb, sx, sy, sw, sh);
+        e.thread = thread;
+        if(ctx.instr.ativo) e.testados = &testados_tile;
+        if(p.use_fb_tiles) {
+            MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+            ctx.quadro.preparar_retangulo(sx, sy, sx + sw - 1, sy + sh - 1);
+        }
+        {
+            MEDIR_ETAPA(ctx.instr, ETAPA_RASTER);
+            for(uint32_t i : bin) local += nucleo(ctx, i, p, e);
+        }
+        aprovados += local;
+        testados += testados_tile;
+        // Deferred: o tile é iluminado pela mesma thread logo após sua passada de visibilidade
+        if(p.use_deferred) {
+            MEDIR_ETAPA(ctx.instr, ETAPA_SOMBREAMENTO);
+            long long n = sombrear_visibilidade(ctx, p, e, sx, sy, sx + sw, sy + sh);
+            sombreados += n;
+            visiveis += n;
+        } else {
+            sombreados += local;
+            visiveis += contar_visiveis(ctx, p, e, sx, sy, sx + sw, sy + sh);
+        }
+    });
+    st.fragmentos_testados += testados.load();
+    st.fragmentos_aprovados += aprovados.load();
+    st.pixels_sombreados += sombreados.load();
+    st.pixels_visiveis += visiveis.load();
+}
+
+// Mapa de calor: cada pixel com fragmentos aprovados recebe a cor da sua contagem (cor_calor);
+// os demais ficam com o fundo. 'destino' tem o mesmo layout de ctx.calor (linear ou em tiles).
+inline void pintar_mapa_calor(ContextoRender& ctx, uint32_t* destino) {
+    const int FAIXAS = 64;
+    size_t n = ctx.calor.size();
+    ctx.pool.executar(FAIXAS, [&](int f) {
+        size_t ini = n * f / FAIXAS, fim = n * (f + 1) / FAIXAS;
+        for(size_t i = ini; i < fim; i++) if(ctx.calor[i]) destino[i] = cor_calor(ctx.calor[i]);
+    });
+}
+
+// --- PIPELINE GRÁFICO (GEOMETRY & RASTER) ---
+// Com p.use_fb_tiles o frame é desenhado no framebuffer em tiles do contexto, e com MSAA no de
+// amostras, limpos aqui só pelas flags (fb e zb não são usados nem precisam de limpar_buffers):
+// a imagem linear sai de resolver_framebuffer, na hora de enviá-la para a tela.
+inline void renderizar_cena(ContextoRender& ctx, const Cena& cena, const ParametrosFrame& p,
+                            std::vector<uint32_t>& fb, std::vector<float>& zb,
+                            EstatisticasFrame* stats = nullptr) {
+    if(usa_msaa(p) && p.use_fb_tiles) {
+        // O MSAA tem seu próprio framebuffer: o em tiles fica de fora neste frame
+        ParametrosFrame sem_tiles = p;
+        sem_tiles.use_fb_tiles = false;
+        renderizar_cena(ctx, cena, sem_tiles, fb, zb, stats);
+        return;
+    }
+    EstatisticasFrame st;
+    if(p.use_fb_tiles) {
+        MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+        ctx.quadro.configurar(p.largura, p.altura, p.use_prof16);
+        ctx.quadro.limpar();
+    }
+    if(usa_msaa(p)) {
+        MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+        ctx.msaa.configurar(p.largura, p.altura, ctx.pool.num_threads());
+        ctx.msaa.limpar();
+    }
+    size_t pixels = p.use_fb_tiles ? ctx.quadro.cor.size() : (size_t)p.largura * p.altura;
+    if(p.use_deferred) ctx.vis.resize(pixels);
+    if(INSTRUMENTACAO && p.mapa_calor) ctx.calor.assign(pixels, 0);
+    if(usa_sombras(p)) atualizar_sombras(ctx, cena, p, st);
+    gerar_triangulos(ctx, cena, p, st);
+    if(!ctx.luzes.vazia()) {
+        distribuir_luzes(ctx, p, st);
+        if(!p.use_phong) iluminar_flat(ctx, p);
+    }
+    if(p.use_tiles) rasterizar_tiles(ctx, p, fb, zb, st);
+    else rasterizar_direto(ctx, p, fb, zb, st);
+    // Com MSAA, o mapa de calor é pintado na resolução
+    if(INSTRUMENTACAO && p.mapa_calor && !usa_msaa(p)) pintar_mapa_calor(ctx, p.use_fb_tiles ? ctx.quadro.cor.data() : fb.data());
+    if(stats) *stats = st;
+}
+
+// Copia o frame do framebuffer do contexto para 'destino' em ARGB linear (passo: pixels entre
+// linhas), por exemplo direto na textura de streaming: o em tiles é só reordenado, e o do MSAA tem
+// as amostras de cada pixel somadas. Sem usa_framebuffer_contexto o frame já está linear em fb.
+inline void resolver_framebuffer(ContextoRender& ctx, const ParametrosFrame& p, uint32_t* destino, int passo) {
+    MEDIR_ETAPA(ctx.instr, ETAPA_RESOLVER);
+    if(usa_msaa(p)) ctx.msaa.resolver(destino, passo, (INSTRUMENTACAO && p.mapa_calor) ? ctx.calor.data() : nullptr, ctx.pool);
+    else ctx.quadro.resolver(destino, passo, ctx.pool);
+}
+
+#endif
@@ -0,0 +1,241 @@
+/**
+ * PRODUTOR_FRAMES.H
+ * Produção de frames em pipeline: uma thread de render desenha o frame N+1 a partir de um
+ * instantâneo (cópia) da cena enquanto a thread principal envia e apresenta o frame N.
+ * Os frames prontos ficam em um anel de framebuffers já na resolução de saída. A entrada do
+ * usuário altera só a cena da thread principal e chega ao render no próximo instantâneo,
+ * nunca no meio de um frame. A cena só é copiada quando foi marcada como alterada; nos demais
+ * instantâneos só os parâmetros do frame mudam.
+ */
+
+#ifndef PRODUTOR_FRAMES_H
+#define PRODUTOR_FRAMES_H
+
+#include "pipeline.h"
+#include "resolucao.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+
+typedef std::chrono::steady_clock Relogio;
+
+// Estado publicado para a thread de render. Instantâneos publicados antes de a thread de render
+// consumir o anterior são fundidos: vale a cena mais nova, e as marcações se acumulam.
+struct InstantaneoCena {
+    Cena cena;
+    uint64_t versao_cena = 0;       // Versão da cena da thread principal copiada em 'cena'
+    ParametrosFrame p;
+    bool reconstruir = false;       // Cubos inseridos/removidos: reconstruir_indice
+    std::vector<int> editados;      // Cubos movidos: atualizar_objeto (refit da BVH)
+    bool tem_entrada = false;       // Algum evento de entrada chegou a este instantâneo
+    Relogio::time_point t_entrada;  // O mais antigo deles
+    uint64_t numero = 0;
+};
+
+// Uma posição do anel de framebuffers
+struct QuadroAnel {
+    enum Estado { LIVRE, RENDERIZANDO, PRONTO, EXIBINDO };
+    Estado estado = LIVRE;
+    std::vector<uint32_t> imagem;   // ARGB linear na resolução de saída
+    EstatisticasFrame stats;
+    int largura = 0, altura = 0;    // Resolução interna em que foi desenhado
+    double render_ms = 0;           // Tempo da thread de render neste frame
+    uint64_t numero = 0;            // Instantâneo de origem
+    bool tem_entrada = false;
+    Relogio::time_point t_entrada;
+};
+
+struct ProdutorFrames {
+    // n_quadros: 2 (buffer duplo) ou 3 (triplo). Com buffer duplo, a thread de render espera a
+    // apresentação pegar o frame pronto e copiá-lo (liberar) antes de começar outro. Com triplo
+    // sempre há uma posição livre: um frame pronto que ninguém pegou é descartado quando o
+    // seguinte fica pronto.
+    ProdutorFrames(ContextoRender& contexto, int largura_saida, int altura_saida, int n_quadros = 3)
+        : ctx(contexto), saida_w(largura_saida), saida_h(altura_saida), anel(std::max(2, n_quadros)) {
+        for(QuadroAnel& q : anel) q.imagem.assign((size_t)saida_w * saida_h, COR_FUNDO);
+        thread = std::thread([this] { loop_render(); });
+    }
+
+    ~ProdutorFrames() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            encerrar = true;
+        }
+        cv_render.notify_all();
+        cv_pronto.notify_all();
+        cv_livre.notify_all();
+        thread.join();
+    }
+
+    ProdutorFrames(const ProdutorFrames&) = delete;
+    ProdutorFrames& operator=(const ProdutorFrames&) = delete;
+
+    // --- Thread principal ---
+
+    // Alterações da cena que o contexto de render precisa saber (vão no próximo instantâneo).
+    // Toda alteração da cena deve passar por uma delas: sem marcação, o instantâneo não a copia.
+    void marcar_reconstrucao() { reconstruir_pendente = true; versao_cena++; }
+    void marcar_edicao(int idx) { editados_pendentes.push_back(idx); versao_cena++; }
+    void marcar_cena() { versao_cena++; } // Materiais, texturas ou luzes pontuais (objetos no lugar)
+    void marcar_entrada(Relogio::time_point t) {
+        if(!entrada_pendente) { entrada_pendente = true; t_entrada_pendente = t; }
+    }
+
+    // Copia o estado atual para a thread de render (a cena, só se mudou desde a cópia que está
+    // no instantâneo). Retorna o número do instantâneo.
+    uint64_t publicar(const Cena& cena, const ParametrosFrame& p) {
+        uint64_t numero;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            InstantaneoCena& s = proximo;
+            if(!novo) { s.reconstruir = false; s.editados.clear(); s.tem_entrada = false; }
+            if(s.versao_cena != versao_cena) {
+                s.cena = cena; // Atribuição: reaproveita a capacidade dos vetores do instantâneo
+                s.versao_cena = versao_cena;
+            }
+            s.p = p;
+            s.reconstruir = s.reconstruir || reconstruir_pendente;
+            s.editados.insert(s.editados.end(), editados_pendentes.begin(), editados_pendentes.end());
+            if(entrada_pendente && !s.tem_entrada) { s.tem_entrada = true; s.t_entrada = t_entrada_pendente; }
+            s.numero = numero = ++publicados;
+            novo = true;
+        }
+        reconstruir_pendente = false;
+        editados_pendentes.clear();
+        entrada_pendente = false;
+        cv_render.notify_one();
+        return numero;
+    }
+
+    // Frame pronto mais recente ainda não exibido, ou nullptr. Ele fica reservado (EXIBINDO)
+    // até liberar (ou até a próxima chamada), e o exibido antes dele volta a ficar livre.
+    const QuadroAnel* adquirir() {
+        std::lock_guard<std::mutex> lock(mtx);
+        QuadroAnel* pronto = nullptr;
+        for(QuadroAnel& q : anel) if(q.estado == QuadroAnel::PRONTO) pronto = &q;
+        if(!pronto) return nullptr;
+        for(QuadroAnel& q : anel) if(q.estado == QuadroAnel::EXIBINDO) q.estado = QuadroAnel::LIVRE;
+        pronto->estado = QuadroAnel::EXIBINDO;
+        cv_livre.notify_one();
+        return pronto;
+    }
+
+    // Devolve ao anel o frame adquirido assim que a imagem foi copiada (textura, memória
+    // compartilhada): a thread de render pode desenhar nele enquanto a apresentação continua.
+    // Depois disso o quadro não pode mais ser lido.
+    void liberar(const QuadroAnel* q) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(QuadroAnel& o : anel) if(&o == q && o.estado == QuadroAnel::EXIBINDO) o.estado = QuadroAnel::LIVRE;
+        }
+        cv_livre.notify_one();
+    }
+
+    // Bloqueia até o instantâneo 'numero' estar desenhado (modo sequencial, sem sobreposição)
+    void esperar(uint64_t numero) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_pronto.wait(lock, [&] { return encerrar || ultimo_pronto >= numero; });
+    }
+
+    // Evento de apresentação para o trace (a thread principal mede; a instrumentação é do contexto)
+    void registrar_apresentacao(int64_t inicio_ns, int64_t fim_ns) {
+        ctx.instr.evento(ETAPA_APRESENTAR, inicio_ns, fim_ns);
+    }
+
+    // Frames desenhados que foram substituídos antes de serem apresentados
+    uint64_t descartados() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return n_descartados;
+    }
+
+private:
+    QuadroAnel* livre() {
+        for(QuadroAnel& q : anel) if(q.estado == QuadroAnel::LIVRE) return &q;
+        return nullptr;
+    }
+
+    void loop_render() {
+        for(;;) {
+            QuadroAnel* q;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_render.wait(lock, [this] { return encerrar || novo; });
+                if(encerrar) return;
+                cv_livre.wait(lock, [this] { return encerrar || livre(); });
+                if(encerrar) return;
+                std::swap(atual, proximo);
+                novo = false;
+                q = livre();
+                q->estado = QuadroAnel::RENDERIZANDO;
+            }
+
+            auto inicio = Relogio::now();
+            if(atual.reconstruir) reconstruir_indice(ctx, atual.cena);
+            else for(int idx : atual.editados) atualizar_objeto(ctx, atual.cena, idx);
+            desenhar(*q);
+            q->render_ms = std::chrono::duration<double, std::milli>(Relogio::now() - inicio).count();
+            q->numero = atual.numero;
+            q->tem_entrada = atual.tem_entrada;
+            q->t_entrada = atual.t_entrada;
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                // O frame pronto anterior, se ninguém o pegou, ficou velho
+                for(QuadroAnel& o : anel)
+                    if(o.estado == QuadroAnel::PRONTO) { o.estado = QuadroAnel::LIVRE; n_descartados++; }
+                q->estado = QuadroAnel::PRONTO;
+                ultimo_pronto = q->numero;
+            }
+            cv_pronto.notify_all();
+        }
+    }
+
+    // Desenha o instantâneo atual e leva a imagem para a resolução de saída do quadro. Na resolução
+    // cheia com framebuffer linear, desenha direto no quadro.
+    void desenhar(QuadroAnel& q) {
+        const ParametrosFrame& p = atual.p;
+        ctx.instr.iniciar_frame(p.instrumentar, p.gravar_trace);
+        bool direto = p.largura == saida_w && p.altura == saida_h;
+        std::vector<uint32_t>& fb = direto ? q.imagem : fb_interno;
+        fb.resize((size_t)p.largura * p.altura);
+        zb.resize((size_t)p.largura * p.altura);
+        if(!usa_framebuffer_contexto(p)) {
+            MEDIR_ETAPA(ctx.instr, ETAPA_LIMPEZA);
+            limpar_buffers(fb, zb);
+        }
+        renderizar_cena(ctx, atual.cena, p, fb, zb, &q.stats);
+        if(usa_framebuffer_contexto(p)) resolver_framebuffer(ctx, p, fb.data(), p.largura);
+        if(!direto) {
+            MEDIR_ETAPA(ctx.instr, ETAPA_RESOLVER);
+            ampliador.ampliar(fb.data(), p.largura, p.altura, q.imagem.data(), saida_w, saida_h, saida_w, ctx.pool);
+        }
+        ctx.instr.fechar_frame(q.stats.ms_etapa);
+        q.largura = p.largura; q.altura = p.altura;
+    }
+
+    ContextoRender& ctx;             // Usado só pela thread de render enquanto o produtor existe
+    int saida_w, saida_h;
+    std::vector<QuadroAnel> anel;
+    std::vector<uint32_t> fb_interno; // Frame em resolução reduzida (resolução dinâmica)
+    std::vector<float> zb;
+    Ampliador ampliador;
+
+    InstantaneoCena proximo, atual;  // Publicado (protegido por mtx) e em uso pela thread de render
+    bool novo = false;
+    uint64_t publicados = 0, ultimo_pronto = 0, n_descartados = 0;
+    bool encerrar = false;
+    std::mutex mtx;
+    std::condition_variable cv_render, cv_pronto, cv_livre;
+    std::thread thread;
+
+    // Marcações da thread principal ainda não publicadas
+    uint64_t versao_cena = 1;        // Incrementada a cada alteração marcada (os instantâneos começam em 0)
+    bool reconstruir_pendente = false;
+    std::vector<int> editados_pendentes;
+    bool entrada_pendente = false;
+    Relogio::time_point t_entrada_pendente;
+};
+
+#endif
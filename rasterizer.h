@@ -1,193 +1,893 @@
 /**
  * RASTERIZER.H
- * Núcleo do renderizador: Iluminação, Recorte e Rasterização (Scanline).
+ * Núcleo do renderizador: Iluminação, Recorte e Rasterização (Scanline, Funções de Aresta e MSAA).
  */
 
 #ifndef RASTERIZER_H
 #define RASTERIZER_H
 
 #include "math_utils.h"
+#include "simd.h"
+#include "luzes.h"
+#include "sombras.h"
+#include "textura.h"
+#include "framebuffer.h"
+#include "instrumentacao.h"
 #include <vector>
 #include <algorithm>
+#include <cstring>
+
+// Núcleo de rasterização selecionável em tempo de execução (comparação A/B).
+enum ModoRaster { RASTER_SCANLINE, RASTER_EDGE };
+
+// Constantes de iluminação de um material: os produtos material x cor da luz não dependem
+// do pixel, então são calculados uma vez por frame e os laços internos recebem só isto.
+struct ConstantesLuz {
+    Vec3 ambiente;   // Ka * Ia
+    Vec3 difusa;     // Kd * Il
+    Vec3 especular;  // Ks * Il
+    Vec3 kd, ks;     // Coeficientes puros, para as luzes pontuais (cada uma tem sua cor)
+    float shininess;
+    const Textura* textura; // Albedo que multiplica ambiente e difusa (ou nullptr)
+};
+
+inline ConstantesLuz montar_constantes_luz(const Material& mat, const Vec3& lightColor, const Vec3& ambientColor) {
+    ConstantesLuz k;
+    k.ambiente = mat.ka * ambientColor;
+    k.difusa = mat.kd * lightColor;
+    k.especular = mat.ks * lightColor;
+    k.kd = mat.kd;
+    k.ks = mat.ks;
+    k.shininess = mat.shininess;
+    k.textura = nullptr; // Resolvida pelo pipeline (o índice é da tabela da cena)
+    return k;
+}
 
 // ==========================================
 //   PIXEL SHADER (ILUMINAÇÃO DE PHONG)
 // ==========================================
 // Calcula a cor final de um fragmento/pixel baseado na posição, normal e material.
 // Modelo utilizado: Blinn-Phong simplificado.
-inline uint32_t calc_luz_rgb(Vec4 pos, Vec4 norm, Cubo cubo, Vec4 lightPos, Vec4 camPos, Vec3 lightColor, Vec3 ambientColor) {
-    
-    Vec4 L = lightPos - pos; L.normalize(); // Vetor Luz (Ponto -> Luz)
-    Vec4 N = norm; N.normalize();           // Normal da superfície
-    Vec4 V = camPos - pos; V.normalize();   // Vetor Visão (Ponto -> Câmera)
-    
+//
+// Dividido em setup por triângulo (montar_setup_phong) e núcleo por pixel (sombrear_phong),
+// que processa SIMD_LARGURA pixels de uma vez. O expoente especular usa vf_pow01 (simd.h),
+// com erro absoluto < 2e-7 em relação a std::pow: abaixo da resolução de 1/255 de um canal.
+
+// Normais dos vértices de um triângulo (malhas com normais suaves). A normal de um ponto p do
+// triângulo é n1 + b2*d2 + b3*d3, com as baricêntricas b2 = (p - o).base2 e b3 = (p - o).base3
+// tiradas da própria posição no View Space: valem em todos os caminhos que têm p (Forward,
+// MSAA, Deferred), sem interpolar nada a mais na tela.
+struct NormaisSuaves {
+    float o[3];                 // Vértice 1
+    float base2[3], base3[3];   // Base dual das arestas v2 - v1 e v3 - v1
+    float n1[3], d2[3], d3[3];  // Normal do vértice 1 e diferenças para as dos vértices 2 e 3
+};
+
+// Setup do Pixel Shader de um triângulo: tudo que não varia entre seus pixels (normal já
+// normalizada, posições da luz e da câmera, constantes do material em escala 0..255), em lanes.
+struct SetupPhong {
+    vfloat nx, ny, nz;
+    vfloat lx, ly, lz;
+    vfloat cx, cy, cz;
+    vfloat amb[3], dif[3], esp[3];
+    vfloat kd[3], ks[3];
+    vfloat shininess;
+    const MapaSombras* sombras;     // Sombras da luz principal (ou nullptr)
+    const Textura* textura;         // Textura do material (ou nullptr)
+    PlanoTextura plano;             // Coordenadas de textura na tela (só com textura)
+    bool suave;                     // Normal interpolada dos vértices ('normais'); senão a da face
+    NormaisSuaves normais;
+};
+
+inline SetupPhong montar_setup_phong(Vec4 norm, const ConstantesLuz& k, const Vec4& lightPos, const Vec4& camPos,
+                                     const MapaSombras* sombras = nullptr) {
+    SetupPhong s;
+    norm.normalize(); // Normal da superfície (constante no triângulo)
+    s.nx = vf_set(norm.x); s.ny = vf_set(norm.y); s.nz = vf_set(norm.z);
+    s.lx = vf_set(lightPos.x); s.ly = vf_set(lightPos.y); s.lz = vf_set(lightPos.z);
+    s.cx = vf_set(camPos.x); s.cy = vf_set(camPos.y); s.cz = vf_set(camPos.z);
+    const Vec3* c[5] = { &k.ambiente, &k.difusa, &k.especular, &k.kd, &k.ks };
+    vfloat* d[5] = { s.amb, s.dif, s.esp, s.kd, s.ks };
+    for(int i = 0; i < 5; i++) {
+        d[i][0] = vf_set(c[i]->x * 255); d[i][1] = vf_set(c[i]->y * 255); d[i][2] = vf_set(c[i]->z * 255);
+    }
+    s.shininess = vf_set(k.shininess);
+    s.sombras = sombras;
+    s.textura = k.textura;
+    s.suave = false;
+    return s;
+}
+
+// Liga as normais suaves no setup: v[] são os vértices no View Space e n[] as normais deles.
+// Triângulos degenerados ficam com a normal da face.
+inline void montar_normais_suaves(SetupPhong& s, const Vec4 v[3], const Vec4 n[3]) {
+    Vec4 a = v[1] - v[0], b = v[2] - v[0];
+    float aa = a.dot(a), ab = a.dot(b), bb = b.dot(b);
+    float det = aa * bb - ab * ab;
+    if(!(det > 1e-20f)) return;
+    float inv = 1.0f / det;
+    Vec4 base2 = (a * bb - b * ab) * inv, base3 = (b * aa - a * ab) * inv;
+    Vec4 d2 = n[1] - n[0], d3 = n[2] - n[0];
+    NormaisSuaves& ns = s.normais;
+    const Vec4* orig[6] = { &v[0], &base2, &base3, &n[0], &d2, &d3 };
+    float* dest[6] = { ns.o, ns.base2, ns.base3, ns.n1, ns.d2, ns.d3 };
+    for(int i = 0; i < 6; i++) { dest[i][0] = orig[i]->x; dest[i][1] = orig[i]->y; dest[i][2] = orig[i]->z; }
+    s.suave = true;
+}
+
+// Normal suave (normalizada) de SIMD_LARGURA pontos do triângulo
+inline void normal_suave(const NormaisSuaves& ns, vfloat px, vfloat py, vfloat pz, vfloat& nx, vfloat& ny, vfloat& nz) {
+    vfloat dx = vf_sub(px, vf_set(ns.o[0])), dy = vf_sub(py, vf_set(ns.o[1])), dz = vf_sub(pz, vf_set(ns.o[2]));
+    vfloat b2 = vf_add(vf_add(vf_mul(dx, vf_set(ns.base2[0])), vf_mul(dy, vf_set(ns.base2[1]))), vf_mul(dz, vf_set(ns.base2[2])));
+    vfloat b3 = vf_add(vf_add(vf_mul(dx, vf_set(ns.base3[0])), vf_mul(dy, vf_set(ns.base3[1]))), vf_mul(dz, vf_set(ns.base3[2])));
+    vfloat n[3];
+    for(int i = 0; i < 3; i++)
+        n[i] = vf_add(vf_add(vf_set(ns.n1[i]), vf_mul(b2, vf_set(ns.d2[i]))), vf_mul(b3, vf_set(ns.d3[i])));
+    vfloat inv = vf_div(vf_set(1.0f), vf_sqrt(vf_max(vf_add(vf_add(vf_mul(n[0], n[0]), vf_mul(n[1], n[1])), vf_mul(n[2], n[2])), vf_set(1e-30f))));
+    nx = vf_mul(n[0], inv); ny = vf_mul(n[1], inv); nz = vf_mul(n[2], inv);
+}
+
+// Estado de um lote de pixels no Pixel Shader: posição, normal e vetor visão (no View Space), o
+// albedo da textura (ou nullptr) e a cor acumulada de cada canal, em escala 0..255 e ainda sem clamp.
+struct LotePhong {
+    vfloat px, py, pz;
+    vfloat nx, ny, nz;
+    vfloat vx, vy, vz;
+    const vfloat* albedo;
+    vfloat rgb[3];
+};
+
+// Luz principal (ambiente + difusa + especular, sem atenuação) de SIMD_LARGURA pixels de um
+// mesmo triângulo, com as sombras do setup. Inicia o lote; 'albedo' (0..1 por canal, opcional)
+// multiplica a ambiente e a difusa desta e das luzes pontuais.
+inline void iluminar_principal(const SetupPhong& s, vfloat px, vfloat py, vfloat pz, LotePhong& f,
+                               const vfloat* albedo = nullptr) {
+    const vfloat zero = vf_set(0.0f), minimo = vf_set(1e-30f);
+    f.px = px; f.py = py; f.pz = pz;
+    f.albedo = albedo;
+    f.nx = s.nx; f.ny = s.ny; f.nz = s.nz;
+    if(s.suave) normal_suave(s.normais, px, py, pz, f.nx, f.ny, f.nz);
+
+    // Vetor Luz (Ponto -> Luz) e Vetor Visão (Ponto -> Câmera), normalizados
+    vfloat lx = vf_sub(s.lx, px), ly = vf_sub(s.ly, py), lz = vf_sub(s.lz, pz);
+    vfloat inv = vf_div(vf_set(1.0f), vf_sqrt(vf_max(vf_add(vf_add(vf_mul(lx, lx), vf_mul(ly, ly)), vf_mul(lz, lz)), minimo)));
+    lx = vf_mul(lx, inv); ly = vf_mul(ly, inv); lz = vf_mul(lz, inv);
+    vfloat vx = vf_sub(s.cx, px), vy = vf_sub(s.cy, py), vz = vf_sub(s.cz, pz);
+    inv = vf_div(vf_set(1.0f), vf_sqrt(vf_max(vf_add(vf_add(vf_mul(vx, vx), vf_mul(vy, vy)), vf_mul(vz, vz)), minimo)));
+    f.vx = vf_mul(vx, inv); f.vy = vf_mul(vy, inv); f.vz = vf_mul(vz, inv);
+
     // 1. Componente Difusa (Lei de Lambert): Intensidade depende do ângulo entre Luz e Normal
-    float diff = std::max(0.0f, N.dot(L));
-    
-    // 2. Componente Especular (Reflexo): Depende do ângulo entre Reflexo e Visão
-    Vec4 R = (N * (2.0f * N.dot(L))) - L; R.normalize(); // Vetor Reflexo
-    float spec = (diff > 0) ? std::pow(std::max(0.0f, R.dot(V)), cubo.mat.shininess) : 0.0f;
-    
-    // Combinação Final: Ambiente + Difusa + Especular
-    // I = Ka*Ia + Kd*Il*(N.L) + Ks*Il*(R.V)^n
-    Vec3 ambient  = cubo.mat.ka * ambientColor;
-    Vec3 diffuse  = cubo.mat.kd * lightColor * diff;
-    Vec3 specular = cubo.mat.ks * lightColor * spec;
-    
-    Vec3 final = ambient + diffuse + specular;
-    
-    // Clamp e conversão para uint32 (ARGB) para o buffer de vídeo
-    return (255<<24) | (clamp(final.x*255)<<16) | (clamp(final.y*255)<<8) | clamp(final.z*255);
+    vfloat ndotl = vf_add(vf_add(vf_mul(f.nx, lx), vf_mul(f.ny, ly)), vf_mul(f.nz, lz));
+    vfloat diff = vf_max(ndotl, zero);
+
+    // 2. Componente Especular (Reflexo): R = 2(N.L)N - L já é unitário, pois N e L são
+    vfloat k2 = vf_add(ndotl, ndotl);
+    vfloat rx = vf_sub(vf_mul(k2, f.nx), lx), ry = vf_sub(vf_mul(k2, f.ny), ly), rz = vf_sub(vf_mul(k2, f.nz), lz);
+    vfloat rdotv = vf_max(vf_add(vf_add(vf_mul(rx, f.vx), vf_mul(ry, f.vy)), vf_mul(rz, f.vz)), zero);
+    vfloat spec = vf_and(vf_pow01(vf_min(rdotv, vf_set(1.0f)), s.shininess), vf_lt(zero, diff));
+
+    // 3. Sombra: nas lanes voltadas para a luz, um oclusor entre ela e o ponto deixa só a ambiente
+    if(s.sombras) {
+        if(vf_mask(vf_lt(zero, diff))) {
+            vfloat acesa = s.sombras->iluminado(vf_sub(px, s.lx), vf_sub(py, s.ly), vf_sub(pz, s.lz));
+            diff = vf_and(diff, acesa);
+            spec = vf_and(spec, acesa);
+        }
+    }
+
+    // Combinação: I = Ka*Ia + Kd*Il*(N.L) + Ks*Il*(R.V)^n (com textura, T*(Ka*Ia + Kd*Il*(N.L)) + ...)
+    if(albedo) {
+        for(int i = 0; i < 3; i++)
+            f.rgb[i] = vf_add(vf_mul(vf_add(s.amb[i], vf_mul(s.dif[i], diff)), albedo[i]), vf_mul(s.esp[i], spec));
+    } else {
+        for(int i = 0; i < 3; i++)
+            f.rgb[i] = vf_add(vf_add(s.amb[i], vf_mul(s.dif[i], diff)), vf_mul(s.esp[i], spec));
+    }
+}
+
+// Soma ao lote as luzes pontuais de uma lista (índices em g.luzes), com atenuação
+// (1 - d²/raio²)², que é exatamente zero fora do alcance. Se 'mascara' não for nula, só as lanes
+// marcadas recebem as luzes. Uma luz que não alcança nenhuma lane é pulada, então avaliar
+// uma luz sem efeito não altera a cor: o resultado depende só da lista de cada pixel.
+inline void iluminar_pontuais(const SetupPhong& s, const GradeLuzes& g, const std::vector<uint32_t>& lista,
+                              const vfloat* mascara, LotePhong& f) {
+    const vfloat zero = vf_set(0.0f), um = vf_set(1.0f), minimo = vf_set(1e-30f);
+    for(uint32_t i : lista) {
+        const LuzVisao& l = g.luzes[i];
+        vfloat lx = vf_sub(vf_set(l.x), f.px), ly = vf_sub(vf_set(l.y), f.py), lz = vf_sub(vf_set(l.z), f.pz);
+        vfloat d2 = vf_add(vf_add(vf_mul(lx, lx), vf_mul(ly, ly)), vf_mul(lz, lz));
+        vfloat att = vf_max(vf_sub(um, vf_mul(d2, vf_set(l.inv_raio2))), zero);
+        vfloat ativo = vf_lt(zero, att);
+        if(mascara) ativo = vf_and(ativo, *mascara);
+        if(!vf_mask(ativo)) continue;
+        att = vf_and(vf_mul(att, att), ativo);
+
+        vfloat inv = vf_div(um, vf_sqrt(vf_max(d2, minimo)));
+        lx = vf_mul(lx, inv); ly = vf_mul(ly, inv); lz = vf_mul(lz, inv);
+        vfloat ndotl = vf_add(vf_add(vf_mul(f.nx, lx), vf_mul(f.ny, ly)), vf_mul(f.nz, lz));
+        vfloat diff = vf_mul(vf_max(ndotl, zero), att);
+        vfloat k2 = vf_add(ndotl, ndotl);
+        vfloat rx = vf_sub(vf_mul(k2, f.nx), lx), ry = vf_sub(vf_mul(k2, f.ny), ly), rz = vf_sub(vf_mul(k2, f.nz), lz);
+        vfloat rdotv = vf_max(vf_add(vf_add(vf_mul(rx, f.vx), vf_mul(ry, f.vy)), vf_mul(rz, f.vz)), zero);
+        vfloat spec = vf_mul(vf_and(vf_pow01(vf_min(rdotv, um), s.shininess), vf_lt(zero, ndotl)), att);
+
+        for(int c = 0; c < 3; c++) {
+            vfloat cor = vf_set(l.cor[c]);
+            vfloat kd = f.albedo ? vf_mul(s.kd[c], f.albedo[c]) : s.kd[c];
+            f.rgb[c] = vf_add(f.rgb[c], vf_add(vf_mul(vf_mul(kd, cor), diff), vf_mul(vf_mul(s.ks[c], cor), spec)));
+        }
+    }
+}
+
+// Clamp em 0..255 e empacotamento ARGB de cada lane.
+inline vint empacotar_cor(const LotePhong& f) {
+    const vfloat zero = vf_set(0.0f), maximo = vf_set(255.0f);
+    vint canal[3];
+    for(int i = 0; i < 3; i++) canal[i] = vf_para_vi_trunc(vf_min(vf_max(f.rgb[i], zero), maximo));
+    return vi_or(vi_or(vi_set(0xFF000000u), vi_shl<16>(canal[0])), vi_or(vi_shl<8>(canal[1]), canal[2]));
+}
+
+// Pixel Shader em lote: SIMD_LARGURA pixels de um mesmo triângulo, com as posições no View Space
+// em SoA. 'lista' (opcional) são as luzes pontuais do tile dos pixels; 'albedo' (opcional), a cor
+// da textura em cada pixel. Retorna as cores ARGB.
+inline vint sombrear_phong(const SetupPhong& s, vfloat px, vfloat py, vfloat pz,
+                           const GradeLuzes* luzes = nullptr, const std::vector<uint32_t>* lista = nullptr,
+                           const vfloat* albedo = nullptr) {
+    LotePhong f;
+    iluminar_principal(s, px, py, pz, f, albedo);
+    if(luzes && lista) iluminar_pontuais(s, *luzes, *lista, nullptr, f);
+    return empacotar_cor(f);
+}
+
+// Versão de um pixel (Flat Shading e usos pontuais): mesmo núcleo, só a lane 0 é usada. Com
+// textura, o albedo é a cor média dela (o último nível de mipmap).
+inline uint32_t calc_luz_rgb(Vec4 pos, Vec4 norm, const ConstantesLuz& k, Vec4 lightPos, Vec4 camPos,
+                             const GradeLuzes* luzes = nullptr, const std::vector<uint32_t>* lista = nullptr) {
+    SetupPhong s = montar_setup_phong(norm, k, lightPos, camPos);
+    vfloat media[3];
+    if(k.textura) cor_media_textura(*k.textura, media);
+    uint32_t c[SIMD_LARGURA];
+    vi_store(c, sombrear_phong(s, vf_set(pos.x), vf_set(pos.y), vf_set(pos.z), luzes, lista, k.textura ? media : nullptr));
+    return c[0];
+}
+
+// Albedo da textura do setup em SIMD_LARGURA pixels de centros (px, py), ou nullptr sem textura.
+// 'lanes' (bits de vf_mask) são os pixels que serão gravados: só eles escolhem o nível de mipmap.
+inline const vfloat* albedo_textura(const SetupPhong& s, vfloat px, vfloat py, int lanes, vfloat albedo[3]) {
+    if(!s.textura) return nullptr;
+    amostrar_textura(*s.textura, s.plano, px, py, lanes, albedo);
+    return albedo;
 }
 
 // ==========================================
 //   RECORTE (CLIPPING) - SUTHERLAND-HODGMAN
 // ==========================================
-// Corta triângulos que atravessam o plano Near da câmera.
-// Essencial para evitar divisão por zero na projeção e artefatos visuais atrás da câmera.
-void clip_triangle_sutherland_hodgman(const Vec4& v1, const Vec4& v2, const Vec4& v3, std::vector<Vec4>& out_poly) {
-    const float Z_NEAR = -0.1f; // Plano de corte no Espaço da Câmera (View Space)
-    
-    Vec4 input_poly[3] = {v1, v2, v3};
-    std::vector<Vec4> output_poly; // O resultado pode ser 0, 3 ou 4 vértices
-    
-    Vec4 prev_vert = input_poly[2];
-    // No View Space (OpenGL style), a câmera olha para -Z. Então "dentro" é Z <= -0.1
-    bool prev_inside = (prev_vert.z <= Z_NEAR); 
-    
-    for(int i=0; i<3; i++) {
-        Vec4 curr_vert = input_poly[i];
-        bool curr_inside = (curr_vert.z <= Z_NEAR);
-        
-        if (curr_inside) {
-            if (!prev_inside) {
-                // Entrando na tela: Calcula ponto de intersecção na borda
-                float t = (Z_NEAR - prev_vert.z) / (curr_vert.z - prev_vert.z);
-                output_poly.push_back(lerp_vertex(prev_vert, curr_vert, t));
+// Recorta o triângulo contra os planos do frustum (View Space) indicados em mascara_planos.
+// Essencial para evitar divisão por zero na projeção e artefatos atrás da câmera, e para que
+// triângulos fora da tela nunca cheguem ao rasterizador.
+// Usa apenas buffers fixos na pilha: cada plano acrescenta no máximo 1 vértice ao polígono,
+// então 3 + 6 = 9 vértices bastam, e a triangulação em leque gera até 7 triângulos.
+const int CLIP_MAX_VERTS = 9;
+const int CLIP_MAX_SAIDA = (CLIP_MAX_VERTS - 2) * 3;
+
+// Retorna quantos vértices foram gravados em out_tris (sempre múltiplo de 3).
+inline int clip_triangle_sutherland_hodgman(const Vec4& v1, const Vec4& v2, const Vec4& v3,
+                                            const Plano* planos, int mascara_planos,
+                                            Vec4 out_tris[CLIP_MAX_SAIDA]) {
+    Vec4 buf_a[CLIP_MAX_VERTS], buf_b[CLIP_MAX_VERTS];
+    Vec4* entrada = buf_a;
+    Vec4* saida = buf_b;
+    entrada[0] = v1; entrada[1] = v2; entrada[2] = v3;
+    int n = 3;
+
+    for(int pl = 0; pl < 6 && n >= 3; pl++) {
+        if(!(mascara_planos & (1 << pl))) continue;
+        const Plano& plano = planos[pl];
+
+        int m = 0;
+        Vec4 prev_vert = entrada[n-1];
+        float prev_d = plano.dist(prev_vert);
+        bool prev_inside = (prev_d >= 0);
+
+        for(int i = 0; i < n; i++) {
+            Vec4 curr_vert = entrada[i];
+            float curr_d = plano.dist(curr_vert);
+            bool curr_inside = (curr_d >= 0);
+
+            if (curr_inside) {
+                if (!prev_inside) {
+                    // Entrando no volume: Calcula ponto de intersecção na borda
+                    float t = prev_d / (prev_d - curr_d);
+                    saida[m++] = lerp_vertex(prev_vert, curr_vert, t);
+                }
+                saida[m++] = curr_vert; // Vértice válido
+            } else if (prev_inside) {
+                // Saindo do volume: Calcula ponto de intersecção e descarta o resto
+                float t = prev_d / (prev_d - curr_d);
+                saida[m++] = lerp_vertex(prev_vert, curr_vert, t);
             }
-            output_poly.push_back(curr_vert); // Vértice válido
-        } else if (prev_inside) {
-            // Saindo da tela: Calcula ponto de intersecção e descarta o resto
-            float t = (Z_NEAR - prev_vert.z) / (curr_vert.z - prev_vert.z);
-            output_poly.push_back(lerp_vertex(prev_vert, curr_vert, t));
+
+            prev_vert = curr_vert;
+            prev_d = curr_d;
+            prev_inside = curr_inside;
         }
-        
-        prev_vert = curr_vert;
-        prev_inside = curr_inside;
+
+        std::swap(entrada, saida);
+        n = m;
     }
-    
-    // Triangulação: Se o recorte gerou um quadrado (4 pontos), dividimos em 2 triângulos
-    if (output_poly.size() < 3) return; 
-    
-    out_poly.push_back(output_poly[0]);
-    out_poly.push_back(output_poly[1]);
-    out_poly.push_back(output_poly[2]);
-    
-    if (output_poly.size() == 4) {
-        out_poly.push_back(output_poly[0]);
-        out_poly.push_back(output_poly[2]);
-        out_poly.push_back(output_poly[3]);
+
+    // Triangulação em leque: um polígono de n vértices vira n-2 triângulos
+    if (n < 3) return 0;
+    int k = 0;
+    for(int i = 1; i + 1 < n; i++) {
+        out_tris[k++] = entrada[0];
+        out_tris[k++] = entrada[i];
+        out_tris[k++] = entrada[i+1];
     }
+    return k;
 }
 
 // ==========================================
-//   RASTERIZAÇÃO (SCANLINE)
+//   NÚCLEOS ESPECIALIZADOS (TEMPLATES)
 // ==========================================
+// Os núcleos de rasterização são templates sobre o que fazem com cada fragmento (SaidaRaster),
+// sobre as luzes pontuais (LUZES), sobre o formato do framebuffer (F, ver framebuffer.h) e,
+// no scanline, sobre o recorte pelo viewport (RECORTE).
+// Cada combinação vira um laço interno próprio, sem testes de modo por pixel; o pipeline
+// escolhe a combinação uma vez por frame por uma tabela de ponteiros (ver pipeline.h).
+
+// O que o núcleo grava nos fragmentos aprovados no Z-Buffer
+enum SaidaRaster { SAIDA_FLAT, SAIDA_PHONG, SAIDA_VISIBILIDADE, SAIDA_PROFUNDIDADE };
+
+// Registro do Visibility Buffer (modo Deferred): a primeira passada grava apenas a profundidade
+// e, por pixel, o triângulo visível e a posição interpolada no View Space. A iluminação roda
+// depois, uma única vez por pixel visível, em vez de uma vez por fragmento aprovado.
+const uint32_t VIS_NENHUM = 0xFFFFFFFF;
+
+struct RegistroVisibilidade {
+    uint32_t tri;       // Índice do triângulo na lista do frame (dá objeto, material e normal da face)
+    float px, py, pz;   // Posição interpolada no View Space
+};
+
+// Vértice já projetado: pixel, profundidade (W) e posição no View Space (para a luz)
+struct VerticeRaster {
+    int x, y;
+    float z;
+    Vec4 w;
+};
+
+// Destino e constantes de um triângulo, comuns a todos os núcleos. Cada núcleo lê só o que
+// a sua SaidaRaster usa.
+struct EstadoRaster {
+    uint32_t* fb;
+    float* zb;
+    uint16_t* zb16;                 // Profundidade de 16 bits (formatos com PROF16)
+    int largura, altura;            // Dimensões do framebuffer (largura é o passo entre linhas)
+    int tiles_x;                    // Tiles por linha (formatos com TILES)
+    RegistroVisibilidade* vis;      // SAIDA_VISIBILIDADE
+    FramebufferMSAA* msaa;          // Destino de fill_edge_msaa (fb, zb e zb16 não são usados)
+    int thread;                     // Thread que rasteriza (vetor de expansão do MSAA)
+    int vpx, vpy, vpw, vph;         // Retângulo de recorte (viewport, ou viewport ∩ tile)
+    uint32_t cor;                   // SAIDA_FLAT
+    uint32_t tri;                   // SAIDA_VISIBILIDADE
+    const SetupPhong* setup;        // SAIDA_PHONG
+    const GradeLuzes* luzes;        // SAIDA_PHONG com LUZES
+    long long* testados;            // Instrumentação: fragmentos cobertos levados ao Z-Buffer (ou nullptr)
+    uint8_t* calor;                 // Instrumentação: fragmentos aprovados por pixel, mesmo índice de fb (ou nullptr)
+};
+
+// Conta um fragmento aprovado no mapa de calor (satura em 255)
+inline void contar_calor(const EstadoRaster& e, int idx) {
+    if (e.calor[idx] != 255) e.calor[idx]++;
+}
+
+// Teste de profundidade de um fragmento (Z-Buffer) no índice idx; grava Z se ele passar
+template<class F>
+inline bool testar_profundidade(const EstadoRaster& e, int idx, float z) {
+    if (F::PROF16) {
+        uint16_t q = prof16_codificar(z);
+        if (q >= e.zb16[idx]) return false;
+        e.zb16[idx] = q;
+    } else {
+        if (!(z < e.zb[idx])) return false;
+        e.zb[idx] = z;
+    }
+    return true;
+}
+
+// Acesso lane a lane à profundidade (em 16 bits, o valor inteiro vai em um float)
+template<class F>
+inline float ler_profundidade(const EstadoRaster& e, int idx) { return F::PROF16 ? (float)e.zb16[idx] : e.zb[idx]; }
+template<class F>
+inline void gravar_profundidade(const EstadoRaster& e, int idx, float z) {
+    if (F::PROF16) e.zb16[idx] = (uint16_t)z;
+    else e.zb[idx] = z;
+}
+
+// Pixel Shader de um bloco SIMD do rasterizador de arestas que começa no pixel (x, y); 'lanes' são
+// os pixels aprovados (escolhem o mipmap da textura). Com luzes pontuais, cada lane recebe só as
+// do seu tile; o bloco pode atravessar a borda entre dois tiles (ta à esquerda, tb à direita).
+template<bool LUZES>
+inline vint sombrear_bloco(const EstadoRaster& e, vfloat px, vfloat py, vfloat pz, int x, int y, int lanes) {
+    vfloat albedo[3];
+    const vfloat* a = albedo_textura(*e.setup, vf_add(vf_set(x + 0.5f), vf_rampa()), vf_set(y + 0.5f), lanes, albedo);
+    if (!LUZES) return sombrear_phong(*e.setup, px, py, pz, nullptr, nullptr, a);
+    const int W = SIMD_LARGURA;
+    LotePhong f;
+    iluminar_principal(*e.setup, px, py, pz, f, a);
+    int ta = e.luzes->tile_do_pixel(x, y);
+    int tb = e.luzes->tile_do_pixel(std::min(x + W - 1, e.largura - 1), y);
+    if (ta == tb) {
+        iluminar_pontuais(*e.setup, *e.luzes, e.luzes->listas[ta], nullptr, f);
+    } else {
+        vfloat rampa = vf_rampa(), borda = vf_set((float)(TILE_LUZ - x % TILE_LUZ));
+        vfloat em_a = vf_lt(rampa, borda), em_b = vf_ge(rampa, borda);
+        iluminar_pontuais(*e.setup, *e.luzes, e.luzes->listas[ta], &em_a, f);
+        iluminar_pontuais(*e.setup, *e.luzes, e.luzes->listas[tb], &em_b, f);
+    }
+    return empacotar_cor(f);
+}
 
-// Rasterizador PHONG: Interpola normais e posições para calcular a luz em CADA pixel.
-inline void fill_phong(int x1, int y1, float z1, Vec4 w1, 
-                       int x2, int y2, float z2, Vec4 w2, 
-                       int x3, int y3, float z3, Vec4 w3, 
-                       Vec4 n, Cubo cubo, Vec4 lightPos, Vec4 camPos, 
-                       std::vector<uint32_t>& fb, std::vector<float>& zb, 
-                       int vpw, int vph, int vpx, int vpy,
-                       Vec3 lightColor, Vec3 ambientColor) {
-    
+// ==========================================
+//   RASTERIZAÇÃO (SCANLINE)
+// ==========================================
+// Ordena os vértices por Y e varre o triângulo linha a linha: na metade superior as bordas são
+// v1->v3 e v1->v2, na inferior v1->v3 e v2->v3. Cada metade tem o seu laço, sem testar a
+// metade por linha. Com RECORTE, o intervalo de cada linha é limitado ao retângulo de recorte
+// antes do laço de pixels; sem RECORTE o chamador garante que o triângulo cabe nele.
+// Retorna os fragmentos que passaram no Z-Buffer.
+template<SaidaRaster SAIDA, bool LUZES, bool RECORTE, class F = FormatoLinear>
+inline int fill_scanline(VerticeRaster v1, VerticeRaster v2, VerticeRaster v3, const EstadoRaster& e) {
     // 1. Ordenação dos vértices por Y (Bubble sort simples) para varredura vertical
-    if (y1>y2) { swap_int(x1,x2); swap_int(y1,y2); swap_float(z1,z2); swap_vec4(w1,w2); }
-    if (y1>y3) { swap_int(x1,x3); swap_int(y1,y3); swap_float(z1,z3); swap_vec4(w1,w3); }
-    if (y2>y3) { swap_int(x2,x3); swap_int(y2,y3); swap_float(z2,z3); swap_vec4(w2,w3); }
-    
-    int h = y3 - y1; if (h == 0) return;
-
-    // 2. Loop de Scanline (Linha a linha)
-    for (int i = 0; i < h; i++) {
-        int y = y1 + i;
-        
-        // Verifica se estamos na metade superior ou inferior do triângulo
-        bool lower = i > (y2 - y1) || (y2 == y1);
-        int seg_h = lower ? (y3 - y2) : (y2 - y1);
-        
-        // Pesos de interpolação vertical
-        float alpha = (float)i / h;
-        float beta = (float)(i - (lower ? (y2 - y1) : 0)) / seg_h;
-        
-        // Interpolação das bordas (X, Z e Vetores World Space)
-        int ax = interp(x1, x3, alpha);
-        int bx = lower ? interp(x2, x3, beta) : interp(x1, x2, beta);
-        float az = interp(z1, z3, alpha);
-        float bz = lower ? interp(z2, z3, beta) : interp(z1, z2, beta);
-        Vec4 aw = interp_vec(w1, w3, alpha);
-        Vec4 bw = lower ? interp_vec(w2, w3, beta) : interp_vec(w1, w2, beta);
-        
-        // Garante scan da esquerda para direita
-        if (ax > bx) { swap_int(ax, bx); swap_float(az, bz); swap_vec4(aw, bw); }
-        
-        // 3. Loop Horizontal (Pixel a Pixel)
-        for (int x = ax; x <= bx; x++) {
-            // Scissor Test: Respeita a área do Viewport e da Janela
-            if (x < vpx || x >= vpx+vpw || y < vpy || y >= vpy+vph) continue;
-            if (x < 0 || x >= SCREEN_W || y < 0 || y >= SCREEN_H) continue;
-            
+    if (v1.y > v2.y) std::swap(v1, v2);
+    if (v1.y > v3.y) std::swap(v1, v3);
+    if (v2.y > v3.y) std::swap(v2, v3);
+
+    int h = v3.y - v1.y; if (h == 0) return 0;
+    int aprovados = 0;
+
+    // Retângulo de recorte: viewport (ou viewport ∩ tile) ∩ janela
+    const int rx0 = std::max(e.vpx, 0), rx1 = std::min(e.vpx + e.vpw, e.largura);
+    const int ry0 = std::max(e.vpy, 0), ry1 = std::min(e.vpy + e.vph, e.altura);
+
+    // Phong: pixels aprovados no Z-Buffer esperam em um lote e são sombreados SIMD_LARGURA por vez.
+    // Cada pixel do triângulo é visitado uma só vez, então adiar a escrita da cor não muda o resultado.
+    // Com luzes pontuais, um lote só contém pixels de um mesmo tile de luz.
+    const int W = SIMD_LARGURA;
+    float lote_x[W], lote_y[W], lote_z[W], lote_px[W], lote_py[W];
+    int lote_idx[W];
+    int pendentes = 0, tile_lote = 0;
+    auto esvaziar = [&]() {
+        // Lanes sobrando repetem o primeiro pixel (resultado descartado)
+        for (int k = pendentes; k < W; k++) {
+            lote_x[k] = lote_x[0]; lote_y[k] = lote_y[0]; lote_z[k] = lote_z[0];
+            lote_px[k] = lote_px[0]; lote_py[k] = lote_py[0];
+        }
+        vfloat albedo[3];
+        const vfloat* a = albedo_textura(*e.setup, vf_load(lote_px), vf_load(lote_py), (1 << pendentes) - 1, albedo);
+        uint32_t cores[W];
+        vi_store(cores, sombrear_phong(*e.setup, vf_load(lote_x), vf_load(lote_y), vf_load(lote_z),
+                                       LUZES ? e.luzes : nullptr, LUZES ? &e.luzes->listas[tile_lote] : nullptr, a));
+        for (int k = 0; k < pendentes; k++) e.fb[lote_idx[k]] = cores[k];
+        pendentes = 0;
+    };
+
+    // Um span: pixels de ax a bx na linha y, com Z e posição interpolados entre as bordas
+    auto span = [&](int y, int ax, int bx, float az, float bz, const Vec4& aw, const Vec4& bw) {
+        int xi = ax, xf = bx;
+        if (RECORTE) {
+            if (y < ry0 || y >= ry1) return;
+            xi = std::max(ax, rx0); xf = std::min(bx, rx1 - 1);
+        }
+#if INSTRUMENTACAO
+        if (e.testados && xf >= xi) *e.testados += xf - xi + 1;
+#endif
+        for (int x = xi; x <= xf; x++) {
             float phi = (bx == ax) ? 1.0f : (float)(x - ax) / (bx - ax);
             float z = interp(az, bz, phi);
-            
-            int idx = y * SCREEN_W + x;
-            
+            int idx = F::indice(x, y, e.largura, e.tiles_x);
+
             // Teste de Profundidade (Z-Buffer)
-            if (z < zb[idx]) {
-                zb[idx] = z;
-                // Interpolação da posição real no mundo para cálculo da luz
-                Vec4 p = interp_vec(aw, bw, phi);
-                fb[idx] = calc_luz_rgb(p, n, cubo, lightPos, camPos, lightColor, ambientColor);
+            if (testar_profundidade<F>(e, idx, z)) {
+                aprovados++;
+#if INSTRUMENTACAO
+                if (e.calor) contar_calor(e, idx);
+#endif
+                if (SAIDA == SAIDA_FLAT) {
+                    e.fb[idx] = e.cor;
+                } else if (SAIDA == SAIDA_PHONG || SAIDA == SAIDA_VISIBILIDADE) {
+                    // Interpolação da posição real no mundo para cálculo da luz
+                    Vec4 p = interp_vec(aw, bw, phi);
+                    if (SAIDA == SAIDA_VISIBILIDADE) {
+                        e.vis[idx] = { e.tri, p.x, p.y, p.z };
+                    } else {
+                        if (LUZES) {
+                            int tile = e.luzes->tile_do_pixel(x, y);
+                            if (pendentes && tile != tile_lote) esvaziar();
+                            tile_lote = tile;
+                        }
+                        lote_x[pendentes] = p.x; lote_y[pendentes] = p.y; lote_z[pendentes] = p.z;
+                        lote_px[pendentes] = x + 0.5f; lote_py[pendentes] = y + 0.5f;
+                        lote_idx[pendentes] = idx;
+                        if (++pendentes == W) esvaziar();
+                    }
+                }
+            }
+        }
+    };
+
+    // Bordas de uma linha: a é sempre v1->v3 (alpha), b é v1->v2 ou v2->v3 (beta).
+    // Garante scan da esquerda para direita.
+    const bool interpola_w = (SAIDA == SAIDA_PHONG || SAIDA == SAIDA_VISIBILIDADE);
+    auto linha = [&](int i, const VerticeRaster& b0, const VerticeRaster& b1, int inicio_seg, int seg_h) {
+        float alpha = (float)i / h;
+        float beta = (float)(i - inicio_seg) / seg_h;
+        int ax = interp(v1.x, v3.x, alpha);
+        int bx = interp(b0.x, b1.x, beta);
+        float az = interp(v1.z, v3.z, alpha);
+        float bz = interp(b0.z, b1.z, beta);
+        Vec4 aw, bw;
+        if (interpola_w) { aw = interp_vec(v1.w, v3.w, alpha); bw = interp_vec(b0.w, b1.w, beta); }
+        if (ax > bx) { std::swap(ax, bx); std::swap(az, bz); std::swap(aw, bw); }
+        span(v1.y + i, ax, bx, az, bz, aw, bw);
+    };
+
+    // 2. Loop de Scanline: metade superior (até a linha de v2, inclusive) e inferior
+    int meio = v2.y - v1.y;
+    int i = 0;
+    if (meio > 0) for (; i <= meio && i < h; i++) linha(i, v1, v2, 0, meio);
+    for (; i < h; i++) linha(i, v2, v3, meio, v3.y - v2.y);
+
+    if (SAIDA == SAIDA_PHONG && pendentes) esvaziar();
+    return aprovados;
+}
+
+// ==========================================
+//   RASTERIZAÇÃO (FUNÇÕES DE ARESTA + SIMD)
+// ==========================================
+// Alternativa ao scanline: cada aresta a->b define E(p) = (bx-ax)*(py-ay) - (by-ay)*(px-ax),
+// que é >= 0 para pontos dentro do triângulo. A caixa envolvente é recortada pelo viewport
+// uma única vez e, dentro dela, E e Z avançam por somas incrementais. SIMD_LARGURA pixels
+// (8 com AVX2, 4 com SSE2) são testados de uma vez com máscaras de cobertura e de Z-Buffer.
+// Amostragem no centro do pixel com a regra "top-left" para arestas compartilhadas.
+
+struct ArestaRaster {
+    float a, b, c;  // E(x, y) = a*x + b*y + c
+    float bias;     // 0 nas arestas top-left; -0.25 nas demais (E é múltiplo de 0.5 nos centros)
+};
+
+inline ArestaRaster montar_aresta(int ax, int ay, int bx, int by) {
+    ArestaRaster e;
+    e.a = (float)-(by - ay);
+    e.b = (float)(bx - ax);
+    e.c = -(e.a * ax + e.b * ay);
+    bool top_left = (by == ay && bx > ax) || (by < ay);
+    e.bias = top_left ? 0.0f : -0.25f;
+    return e;
+}
+
+template<SaidaRaster SAIDA, bool LUZES, class F = FormatoLinear>
+inline int fill_edge(VerticeRaster v1, VerticeRaster v2, VerticeRaster v3, const EstadoRaster& e) {
+    const int W = SIMD_LARGURA;
+
+    // 1. Orientação: garante área positiva trocando v2 <-> v3
+    float area = (float)(v2.x - v1.x) * (v3.y - v1.y) - (float)(v2.y - v1.y) * (v3.x - v1.x);
+    if (area == 0) return 0;
+    if (area < 0) { std::swap(v2, v3); area = -area; }
+    float inv_area = 1.0f / area;
+
+    // 2. Caixa envolvente recortada pelo viewport e pela janela (uma vez por triângulo)
+    int min_x = std::max(std::min(v1.x, std::min(v2.x, v3.x)), std::max(e.vpx, 0));
+    int max_x = std::min(std::max(v1.x, std::max(v2.x, v3.x)), std::min(e.vpx + e.vpw, e.largura) - 1);
+    int min_y = std::max(std::min(v1.y, std::min(v2.y, v3.y)), std::max(e.vpy, 0));
+    int max_y = std::min(std::max(v1.y, std::max(v2.y, v3.y)), std::min(e.vpy + e.vph, e.altura) - 1);
+    if (min_x > max_x || min_y > max_y) return 0;
+
+    // 3. Funções de aresta: e0 pondera v1, e1 pondera v2, e2 pondera v3 (coordenadas baricêntricas)
+    ArestaRaster e0 = montar_aresta(v2.x, v2.y, v3.x, v3.y);
+    ArestaRaster e1 = montar_aresta(v3.x, v3.y, v1.x, v1.y);
+    ArestaRaster e2 = montar_aresta(v1.x, v1.y, v2.x, v2.y);
+    const float z1 = v1.z, z2 = v2.z, z3 = v3.z;
+    const Vec4 &w1 = v1.w, &w2 = v2.w, &w3 = v3.w;
+
+    // Plano de profundidade: Z = (E0*z1 + E1*z2 + E2*z3) / área
+    float dzdx = (e0.a*z1 + e1.a*z2 + e2.a*z3) * inv_area;
+
+    const vfloat rampa = vf_rampa();
+    const vfloat zero = vf_set(0.0f);
+    const vfloat passo0 = vf_set(e0.a * W), passo1 = vf_set(e1.a * W), passo2 = vf_set(e2.a * W);
+    const vfloat passo_z = vf_set(dzdx * W);
+    const vint cor = vi_set(e.cor);
+    const vfloat vinv_area = vf_set(inv_area);
+    const vfloat bias0 = vf_set(e0.bias), bias1 = vf_set(e1.bias), bias2 = vf_set(e2.bias);
+    int escritos = 0;
+
+    // Blocos alinhados a múltiplos de W: no framebuffer em tiles um bloco nunca cruza a borda
+    // de um tile, e as lanes fora da caixa envolvente são só mascaradas
+    const int min_xb = min_x & ~(W - 1);
+
+    for (int y = min_y; y <= max_y; y++) {
+        float px = min_xb + 0.5f, py = y + 0.5f;
+        float l0 = e0.a*px + e0.b*py + e0.c;
+        float l1 = e1.a*px + e1.b*py + e1.c;
+        float l2 = e2.a*px + e2.b*py + e2.c;
+        float lz = (l0*z1 + l1*z2 + l2*z3) * inv_area;
+
+        vfloat ve0 = vf_add(vf_set(l0 + e0.bias), vf_mul(rampa, vf_set(e0.a)));
+        vfloat ve1 = vf_add(vf_set(l1 + e1.bias), vf_mul(rampa, vf_set(e1.a)));
+        vfloat ve2 = vf_add(vf_set(l2 + e2.bias), vf_mul(rampa, vf_set(e2.a)));
+        vfloat vz  = vf_add(vf_set(lz), vf_mul(rampa, vf_set(dzdx)));
+
+        for (int x = min_xb; x <= max_x; x += W) {
+            // 4. Máscara de cobertura (as três arestas) limitada à caixa envolvente
+            vfloat cob = vf_and(vf_and(vf_ge(ve0, zero), vf_ge(ve1, zero)), vf_ge(ve2, zero));
+            if (x < min_x) cob = vf_and(cob, vf_ge(rampa, vf_set((float)(min_x - x))));
+            int restantes = max_x - x + 1;
+            if (restantes < W) cob = vf_and(cob, vf_lt(rampa, vf_set((float)restantes)));
+
+            if (vf_mask(cob)) {
+#if INSTRUMENTACAO
+                if (e.testados) *e.testados += __builtin_popcount(vf_mask(cob));
+#endif
+                // 5. Teste de profundidade em bloco: o bloco inteiro é lido e regravado (as lanes
+                //    reprovadas mantêm o valor; elas são do mesmo tile, e portanto da mesma thread).
+                //    Só no framebuffer linear, um bloco que passa do fim da linha vai lane a lane
+                //    por buffers locais, para não tocar a linha seguinte.
+                int base = F::indice(x, y, e.largura, e.tiles_x);
+                bool contiguo = F::TILES || x + W <= e.largura;
+                int n = contiguo ? W : e.largura - x;
+
+                vfloat zfrag = F::PROF16 ? prof16_codificar(vz) : vz;
+                float tmp[W];
+                vfloat zatual;
+                if (contiguo) {
+                    zatual = F::PROF16 ? vf_load_u16(&e.zb16[base]) : vf_load(&e.zb[base]);
+                } else {
+                    for (int i = 0; i < W; i++) tmp[i] = (i < n) ? ler_profundidade<F>(e, base + i) : 0.0f;
+                    zatual = vf_load(tmp);
+                }
+                vfloat passa = vf_and(cob, vf_lt(zfrag, zatual));
+                int m = vf_mask(passa);
+
+                if (m) {
+                    vfloat znovo = vf_sel(passa, zfrag, zatual);
+                    if (contiguo) {
+                        if (F::PROF16) vf_store_u16(&e.zb16[base], znovo);
+                        else vf_store(&e.zb[base], znovo);
+                    } else {
+                        vf_store(tmp, znovo);
+                        for (int i = 0; i < n; i++) gravar_profundidade<F>(e, base + i, tmp[i]);
+                    }
+
+                    if (SAIDA == SAIDA_PHONG) {
+                        // Posição interpolada pelas baricêntricas e Pixel Shader no bloco inteiro;
+                        // só as lanes aprovadas são gravadas
+                        vfloat u = vf_mul(vf_sub(ve0, bias0), vinv_area);
+                        vfloat v = vf_mul(vf_sub(ve1, bias1), vinv_area);
+                        vfloat w = vf_mul(vf_sub(ve2, bias2), vinv_area);
+                        vfloat px = vf_add(vf_add(vf_mul(vf_set(w1.x), u), vf_mul(vf_set(w2.x), v)), vf_mul(vf_set(w3.x), w));
+                        vfloat py = vf_add(vf_add(vf_mul(vf_set(w1.y), u), vf_mul(vf_set(w2.y), v)), vf_mul(vf_set(w3.y), w));
+                        vfloat pz = vf_add(vf_add(vf_mul(vf_set(w1.z), u), vf_mul(vf_set(w2.z), v)), vf_mul(vf_set(w3.z), w));
+                        vint cores = sombrear_bloco<LUZES>(e, px, py, pz, x, y, m);
+                        if (contiguo) {
+                            uint32_t* cp = &e.fb[base];
+                            vi_store(cp, vi_sel(passa, cores, vi_load(cp)));
+                        } else {
+                            uint32_t tmp_cor[W];
+                            vi_store(tmp_cor, cores);
+                            for (int i = 0; i < n; i++) if (m & (1 << i)) e.fb[base + i] = tmp_cor[i];
+                        }
+                    } else if (SAIDA == SAIDA_VISIBILIDADE) {
+                        // Apenas nas lanes aprovadas: posição interpolada pelas baricêntricas
+                        // (mesma ordem de operações do caminho Phong) e registro de visibilidade
+                        float b0[W], b1[W], b2[W];
+                        vf_store(b0, ve0); vf_store(b1, ve1); vf_store(b2, ve2);
+                        for (int i = 0; i < W; i++) {
+                            if (!(m & (1 << i))) continue;
+                            float u = (b0[i] - e0.bias) * inv_area;
+                            float v = (b1[i] - e1.bias) * inv_area;
+                            float w = (b2[i] - e2.bias) * inv_area;
+                            Vec4 p = w1*u + w2*v + w3*w;
+                            e.vis[base + i] = { e.tri, p.x, p.y, p.z };
+                        }
+                    } else if (SAIDA == SAIDA_FLAT) {
+                        if (contiguo) {
+                            uint32_t* cp = &e.fb[base];
+                            vi_store(cp, vi_sel(passa, cor, vi_load(cp)));
+                        } else {
+                            for (int i = 0; i < n; i++) if (m & (1 << i)) e.fb[base + i] = e.cor;
+                        }
+                    }
+#if INSTRUMENTACAO
+                    if (e.calor) for (int i = 0; i < W; i++) if (m & (1 << i)) contar_calor(e, base + i);
+#endif
+                    escritos += __builtin_popcount(m);
+                }
             }
+
+            ve0 = vf_add(ve0, passo0); ve1 = vf_add(ve1, passo1); ve2 = vf_add(ve2, passo2);
+            vz = vf_add(vz, passo_z);
         }
     }
+    return escritos;
 }
 
-// Rasterizador FLAT: Cor constante calculada uma vez por triângulo (mais rápido).
-inline void fill_flat(int x1, int y1, float z1, int x2, int y2, float z2, int x3, int y3, float z3, 
-                      uint32_t c, std::vector<uint32_t>& fb, std::vector<float>& zb, int vpw, int vph, int vpx, int vpy) {
-    if (y1>y2) { swap_int(x1,x2); swap_int(y1,y2); swap_float(z1,z2); }
-    if (y1>y3) { swap_int(x1,x3); swap_int(y1,y3); swap_float(z1,z3); }
-    if (y2>y3) { swap_int(x2,x3); swap_int(y2,y3); swap_float(z2,z3); }
-    
-    int h = y3 - y1; if (h == 0) return;
+// ==========================================
+//   RASTERIZAÇÃO COM MSAA 4x (FUNÇÕES DE ARESTA + SIMD)
+// ==========================================
+// Mesmo percurso de fill_edge, mas a cobertura e a profundidade são testadas nas AMOSTRAS_MSAA
+// posições de cada pixel, direto nos blocos de FramebufferMSAA (um vetor de profundidades de
+// 16 bits por amostra). O Pixel Shader roda uma vez por pixel e triângulo, no centro do pixel, se
+// alguma amostra passou no Z-Buffer, e a cor vai só para as amostras aprovadas: o custo de
+// sombreamento é o mesmo sem MSAA. Nos pixels internos a cor é a que fill_edge gravaria no pixel.
+// Retorna os pixels sombreados (com ao menos uma amostra aprovada).
+template<SaidaRaster SAIDA, bool LUZES>
+inline int fill_edge_msaa(VerticeRaster v1, VerticeRaster v2, VerticeRaster v3, const EstadoRaster& e) {
+    const int W = SIMD_LARGURA, S = AMOSTRAS_MSAA;
+    FramebufferMSAA& q = *e.msaa;
 
-    for (int i = 0; i < h; i++) {
-        int y = y1 + i;
-        bool lower = i > (y2 - y1) || (y2 == y1);
-        int seg_h = lower ? (y3 - y2) : (y2 - y1);
-        float alpha = (float)i / h;
-        float beta = (float)(i - (lower ? (y2 - y1) : 0)) / seg_h;
-        
-        int ax = interp(x1, x3, alpha);
-        int bx = lower ? interp(x2, x3, beta) : interp(x1, x2, beta);
-        float az = interp(z1, z3, alpha);
-        float bz = lower ? interp(z2, z3, beta) : interp(z1, z2, beta);
-        
-        if (ax > bx) { swap_int(ax, bx); swap_float(az, bz); }
-        
-        for (int x = ax; x <= bx; x++) {
-            if (x < vpx || x >= vpx+vpw || y < vpy || y >= vpy+vph) continue;
-            if (x < 0 || x >= SCREEN_W || y < 0 || y >= SCREEN_H) continue;
-            float phi = (bx == ax) ? 1.0f : (float)(x - ax) / (bx - ax);
-            float z = interp(az, bz, phi);
-            
-            int idx = y * SCREEN_W + x;
-            if (z < zb[idx]) { zb[idx] = z; fb[idx] = c; }
+    float area = (float)(v2.x - v1.x) * (v3.y - v1.y) - (float)(v2.y - v1.y) * (v3.x - v1.x);
+    if (area == 0) return 0;
+    if (area < 0) { std::swap(v2, v3); area = -area; }
+    float inv_area = 1.0f / area;
+
+    // Os vértices são inteiros, então toda amostra coberta está em um pixel da caixa envolvente
+    int min_x = std::max(std::min(v1.x, std::min(v2.x, v3.x)), std::max(e.vpx, 0));
+    int max_x = std::min(std::max(v1.x, std::max(v2.x, v3.x)), std::min(e.vpx + e.vpw, e.largura) - 1);
+    int min_y = std::max(std::min(v1.y, std::min(v2.y, v3.y)), std::max(e.vpy, 0));
+    int max_y = std::min(std::max(v1.y, std::max(v2.y, v3.y)), std::min(e.vpy + e.vph, e.altura) - 1);
+    if (min_x > max_x || min_y > max_y) return 0;
+
+    ArestaRaster e0 = montar_aresta(v2.x, v2.y, v3.x, v3.y);
+    ArestaRaster e1 = montar_aresta(v3.x, v3.y, v1.x, v1.y);
+    ArestaRaster e2 = montar_aresta(v1.x, v1.y, v2.x, v2.y);
+    const float z1 = v1.z, z2 = v2.z, z3 = v3.z;
+    const Vec4 &w1 = v1.w, &w2 = v2.w, &w3 = v3.w;
+    float dzdx = (e0.a*z1 + e1.a*z2 + e2.a*z3) * inv_area;
+    float dzdy = (e0.b*z1 + e1.b*z2 + e2.b*z3) * inv_area;
+
+    // Deslocamento de cada amostra em relação ao centro do pixel, nas arestas e em Z. Nas amostras E
+    // é múltiplo de 1/8, então a regra top-left usa uma folga de 1/16 (a de fill_edge vale 1/4).
+    // A amostra s está coberta se E no centro >= -k[s] nas três arestas. Os extremos de k dão dois
+    // testes de bloco inteiro: nenhuma amostra coberta ou todas cobertas; só os blocos da borda do
+    // triângulo testam amostra por amostra.
+    vfloat lim0[S], lim1[S], lim2[S], kz[S];
+    float kmin[3] = { 1e30f, 1e30f, 1e30f }, kmax[3] = { -1e30f, -1e30f, -1e30f }, kz_min = 1e30f;
+    for (int s = 0; s < S; s++) {
+        float ox = POSICOES_MSAA[s][0] - 0.5f, oy = POSICOES_MSAA[s][1] - 0.5f;
+        float k[3] = { e0.a*ox + e0.b*oy + e0.bias * 0.25f, e1.a*ox + e1.b*oy + e1.bias * 0.25f,
+                       e2.a*ox + e2.b*oy + e2.bias * 0.25f };
+        for (int a = 0; a < 3; a++) { kmin[a] = std::min(kmin[a], k[a]); kmax[a] = std::max(kmax[a], k[a]); }
+        lim0[s] = vf_set(-k[0]); lim1[s] = vf_set(-k[1]); lim2[s] = vf_set(-k[2]);
+        kz_min = std::min(kz_min, dzdx*ox + dzdy*oy);
+        kz[s] = vf_set(dzdx*ox + dzdy*oy);
+    }
+    const vfloat algum0 = vf_set(-kmax[0]), algum1 = vf_set(-kmax[1]), algum2 = vf_set(-kmax[2]);
+    const vfloat todos0 = vf_set(-kmin[0]), todos1 = vf_set(-kmin[1]), todos2 = vf_set(-kmin[2]);
+    const vfloat vkz_min = vf_set(kz_min);
+
+    const vfloat rampa = vf_rampa();
+    const vfloat zero = vf_set(0.0f);
+    const vfloat todas = vf_ge(zero, zero);
+    const int mascara_bloco = vf_mask(todas);
+    const vfloat passo0 = vf_set(e0.a * W), passo1 = vf_set(e1.a * W), passo2 = vf_set(e2.a * W);
+    const vfloat passo_z = vf_set(dzdx * W);
+    const vint cor = vi_set(e.cor);
+    const vfloat vinv_area = vf_set(inv_area);
+    int escritos = 0;
+    const int min_xb = min_x & ~(W - 1);
+
+    for (int y = min_y; y <= max_y; y++) {
+        float px = min_xb + 0.5f, py = y + 0.5f;
+        float l0 = e0.a*px + e0.b*py + e0.c;
+        float l1 = e1.a*px + e1.b*py + e1.c;
+        float l2 = e2.a*px + e2.b*py + e2.c;
+        float lz = (l0*z1 + l1*z2 + l2*z3) * inv_area;
+
+        // Funções de aresta e Z no centro dos pixels (sem a folga top-left, que vai em k0..k2)
+        vfloat ve0 = vf_add(vf_set(l0), vf_mul(rampa, vf_set(e0.a)));
+        vfloat ve1 = vf_add(vf_set(l1), vf_mul(rampa, vf_set(e1.a)));
+        vfloat ve2 = vf_add(vf_set(l2), vf_mul(rampa, vf_set(e2.a)));
+        vfloat vz  = vf_add(vf_set(lz), vf_mul(rampa, vf_set(dzdx)));
+
+        for (int x = min_xb; x <= max_x; x += W) {
+            // 1. Cobertura de cada amostra, limitada à caixa envolvente
+            vfloat caixa = todas;
+            if (x < min_x) caixa = vf_ge(rampa, vf_set((float)(min_x - x)));
+            if (max_x - x + 1 < W) caixa = vf_and(caixa, vf_lt(rampa, vf_set((float)(max_x - x + 1))));
+            vfloat talvez = vf_and(vf_and(vf_ge(ve0, algum0), vf_ge(ve1, algum1)), vf_and(vf_ge(ve2, algum2), caixa));
+            vfloat cob[S], coberto = zero;
+            int alguma = 0;
+            if (vf_mask(talvez)) {
+                vfloat inteiro = vf_and(vf_and(vf_ge(ve0, todos0), vf_ge(ve1, todos1)), vf_ge(ve2, todos2));
+                if (vf_mask(inteiro) == mascara_bloco) {
+                    for (int s = 0; s < S; s++) cob[s] = caixa;
+                    coberto = caixa;
+                } else {
+                    for (int s = 0; s < S; s++) {
+                        cob[s] = vf_and(vf_and(vf_ge(ve0, lim0[s]), vf_ge(ve1, lim1[s])), vf_and(vf_ge(ve2, lim2[s]), caixa));
+                        coberto = vf_or(coberto, cob[s]);
+                    }
+                }
+                alguma = vf_mask(coberto);
+            }
+
+            // 2. Rejeição do bloco inteiro: se, em cada pixel coberto, a amostra mais próxima do
+            //    triângulo (vz + kz_min) não fica à frente da mais distante já gravada, nenhuma
+            //    amostra passa. A soma e a codificação em 16 bits são monótonas, então o teste
+            //    nunca rejeita uma que passaria.
+            int b = q.bloco(x, y);
+            if (alguma) {
+#if INSTRUMENTACAO
+                if (e.testados) *e.testados += __builtin_popcount(alguma);
+#endif
+                q.preparar_bloco(b);
+                alguma = vf_mask(vf_and(coberto, vf_lt(prof16_codificar(vf_add(vz, vkz_min)), vf_load_u16(q.prof_max_bloco(b)))));
+            }
+
+            if (alguma) {
+                // 3. Teste de profundidade por amostra; 'pixel' marca os pixels com alguma aprovada
+                uint16_t* zb = q.prof_bloco(b);
+                int passa[S];
+                int m = 0;
+                for (int s = 0; s < S; s++) {
+                    passa[s] = 0;
+                    if (!vf_mask(cob[s])) continue;
+                    vfloat zs = prof16_codificar(vf_add(vz, kz[s]));
+                    vfloat zatual = vf_load_u16(zb + s * W);
+                    vfloat aprovadas = vf_and(cob[s], vf_lt(zs, zatual));
+                    passa[s] = vf_mask(aprovadas);
+                    if (passa[s]) vf_store_u16(zb + s * W, vf_sel(aprovadas, zs, zatual));
+                    m |= passa[s];
+                }
+
+                if (m) {
+                    vfloat zmax = vf_load_u16(zb);
+                    for (int s = 1; s < S; s++) zmax = vf_max(zmax, vf_load_u16(zb + s * W));
+                    vf_store_u16(q.prof_max_bloco(b), zmax);
+
+                    // 4. Uma cor por pixel (Pixel Shader no centro), gravada nas amostras aprovadas.
+                    //    Pixels com as quatro aprovadas só trocam a cor e a máscara; os da borda
+                    //    passam por FramebufferMSAA::gravar.
+                    vint cores = cor;
+                    if (SAIDA == SAIDA_PHONG) {
+                        vfloat u = vf_mul(ve0, vinv_area), v = vf_mul(ve1, vinv_area), w = vf_mul(ve2, vinv_area);
+                        vfloat px = vf_add(vf_add(vf_mul(vf_set(w1.x), u), vf_mul(vf_set(w2.x), v)), vf_mul(vf_set(w3.x), w));
+                        vfloat py = vf_add(vf_add(vf_mul(vf_set(w1.y), u), vf_mul(vf_set(w2.y), v)), vf_mul(vf_set(w3.y), w));
+                        vfloat pz = vf_add(vf_add(vf_mul(vf_set(w1.z), u), vf_mul(vf_set(w2.z), v)), vf_mul(vf_set(w3.z), w));
+                        cores = sombrear_bloco<LUZES>(e, px, py, pz, x, y, m);
+                    }
+                    int inteiros = passa[0];
+                    for (int s = 1; s < S; s++) inteiros &= passa[s];
+                    uint32_t* cb = q.cor_bloco(b);
+                    uint8_t* mb = q.mascara_bloco(b);
+                    if (inteiros == mascara_bloco) {
+                        vi_store(cb, cores);
+                        std::memset(mb, AMOSTRAS_TODAS, W);
+                    } else {
+                        uint32_t c[W];
+                        vi_store(c, cores);
+                        size_t base = (size_t)b * W;
+                        for (int i = 0; i < W; i++) {
+                            if (!(m & (1 << i))) continue;
+                            unsigned amostras = 0;
+                            for (int s = 0; s < S; s++) amostras |= ((passa[s] >> i) & 1) << s;
+                            if (amostras == AMOSTRAS_TODAS) { cb[i] = c[i]; mb[i] = AMOSTRAS_TODAS; }
+                            else q.gravar(base + i, c[i], amostras, e.thread);
+                        }
+                    }
+#if INSTRUMENTACAO
+                    if (e.calor) for (int i = 0; i < W; i++) if (m & (1 << i)) contar_calor(e, y * e.largura + x + i);
+#endif
+                    escritos += __builtin_popcount(m);
+                }
+            }
+
+            ve0 = vf_add(ve0, passo0); ve1 = vf_add(ve1, passo1); ve2 = vf_add(ve2, passo2);
+            vz = vf_add(vz, passo_z);
         }
     }
+    return escritos;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,482 @@
+/**
+ * RENDER_OFFLINE.H
+ * Renderização offline de sequências (voltas em torno de objetos, sobrevoos) a partir de um roteiro
+ * de quadros-chave de câmera, luz e objetos, sem janela e sem limite de FPS.
+ * Cada worker (um por núcleo) tem seu próprio contexto de render, fb, zb e cópia da cena, e desenha
+ * quadros inteiros em paralelo com os demais. Os quadros prontos passam por um buffer de reordenação
+ * limitado e são escritos em ordem, em Y4M (vídeo YUV 4:2:0 sem compressão) ou em uma sequência de
+ * PPM, com escritas grandes.
+ */
+
+#ifndef RENDER_OFFLINE_H
+#define RENDER_OFFLINE_H
+
+#include "pipeline.h"
+#include "arquivo_cena.h"
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+// ==========================================
+//   ROTEIRO (QUADROS-CHAVE)
+// ==========================================
+
+const int CANAIS_MAX = 6;
+
+struct ChaveQuadro {
+    int quadro;
+    float v[CANAIS_MAX];
+};
+
+// Canais animados de um elemento. Entre duas chaves a interpolação é linear; antes da primeira e
+// depois da última, o valor fica parado.
+struct Trilha {
+    std::vector<ChaveQuadro> chaves; // Ordenadas por quadro
+
+    bool vazia() const { return chaves.empty(); }
+
+    void inserir(const ChaveQuadro& c) {
+        auto it = std::upper_bound(chaves.begin(), chaves.end(), c.quadro,
+                                   [](int q, const ChaveQuadro& k) { return q < k.quadro; });
+        chaves.insert(it, c);
+    }
+
+    void avaliar(int quadro, float* saida, int n) const {
+        size_t i = 0;
+        while(i < chaves.size() && chaves[i].quadro <= quadro) i++;
+        if(i == 0 || i == chaves.size()) {
+            const ChaveQuadro& c = chaves[i == 0 ? 0 : i - 1];
+            for(int k = 0; k < n; k++) saida[k] = c.v[k];
+            return;
+        }
+        const ChaveQuadro& a = chaves[i - 1];
+        const ChaveQuadro& b = chaves[i];
+        float t = (float)(quadro - a.quadro) / (b.quadro - a.quadro);
+        for(int k = 0; k < n; k++) saida[k] = a.v[k] + (b.v[k] - a.v[k]) * t;
+    }
+};
+
+struct TrilhaObjeto {
+    uint32_t idx;
+    Trilha trilha;   // px py pz rx ry escala
+};
+
+struct Roteiro {
+    int largura = SCREEN_W, altura = SCREEN_H;
+    int quadros = 60, fps = 30;
+    bool phong = true;
+    ModoRaster raster = RASTER_EDGE;
+    bool msaa = false;
+    bool sombras = false;
+    std::string arquivo_cena;      // Instantâneo de cena (vazio: cena inicial da aplicação)
+    Trilha camera;                 // x y z fov
+    Trilha luz;                    // x y z
+    std::vector<TrilhaObjeto> objetos;
+
+    Trilha& trilha_objeto(uint32_t idx) {
+        for(TrilhaObjeto& o : objetos) if(o.idx == idx) return o.trilha;
+        objetos.push_back({ idx, Trilha() });
+        return objetos.back().trilha;
+    }
+};
+
+// Lê um roteiro em texto, uma diretiva por linha ('#' começa um comentário):
+//   resolucao L A | quadros N | fps N | flat | scanline | msaa | sombras | cena arquivo.cena
+//   camera Q x y z [fov]
+//   luz Q x y z
+//   objeto I Q px py pz rx ry [escala]
+// Q é o quadro da chave (a partir de 0) e I o índice do objeto na cena.
+inline bool ler_roteiro(const char* caminho, Roteiro& r) {
+    FILE* f = std::fopen(caminho, "r");
+    if(!f) { std::printf("Nao foi possivel abrir o roteiro %s\n", caminho); return false; }
+    char linha[512];
+    int n_linha = 0;
+    bool ok = true;
+    while(ok && std::fgets(linha, sizeof(linha), f)) {
+        n_linha++;
+        if(char* c = std::strchr(linha, '#')) *c = 0;
+        char cmd[32], nome[400];
+        if(std::sscanf(linha, "%31s", cmd) != 1) continue;
+        ChaveQuadro k = {};
+        int lidos;
+        std::string s = cmd;
+        if(s == "resolucao") ok = std::sscanf(linha, "%*s %d %d", &r.largura, &r.altura) == 2 && r.largura > 0 && r.altura > 0;
+        else if(s == "quadros") ok = std::sscanf(linha, "%*s %d", &r.quadros) == 1 && r.quadros > 0;
+        else if(s == "fps") ok = std::sscanf(linha, "%*s %d", &r.fps) == 1 && r.fps > 0;
+        else if(s == "flat") r.phong = false;
+        else if(s == "scanline") r.raster = RASTER_SCANLINE;
+        else if(s == "msaa") r.msaa = true;
+        else if(s == "sombras") r.sombras = true;
+        else if(s == "cena") { ok = std::sscanf(linha, "%*s %399s", nome) == 1; if(ok) r.arquivo_cena = nome; }
+        else if(s == "camera") {
+            k.v[3] = 1.04f; // FOV padrão da aplicação
+            lidos = std::sscanf(linha, "%*s %d %f %f %f %f", &k.quadro, &k.v[0], &k.v[1], &k.v[2], &k.v[3]);
+            ok = lidos >= 4;
+            if(ok) r.camera.inserir(k);
+        }
+        else if(s == "luz") {
+            ok = std::sscanf(linha, "%*s %d %f %f %f", &k.quadro, &k.v[0], &k.v[1], &k.v[2]) == 4;
+            if(ok) r.luz.inserir(k);
+        }
+        else if(s == "objeto") {
+            unsigned idx;
+            k.v[5] = 1.0f;
+            lidos = std::sscanf(linha, "%*s %u %d %f %f %f %f %f %f", &idx, &k.quadro, &k.v[0], &k.v[1], &k.v[2], &k.v[3], &k.v[4], &k.v[5]);
+            ok = lidos >= 7;
+            if(ok) r.trilha_objeto(idx).inserir(k);
+        }
+        else ok = false;
+    }
+    std::fclose(f);
+    if(!ok) std::printf("Roteiro %s, linha %d: diretiva invalida\n", caminho, n_linha);
+    return ok;
+}
+
+// Cena inicial da aplicação (os dois cubos de main.cpp), usada quando o roteiro não indica outra
+inline Cena montar_cena_inicial() {
+    Cena cena;
+    Material m1;
+    m1.ka = Vec3(0.1,0.0,0.0); m1.kd = Vec3(0.8,0.0,0.0); m1.ks = Vec3(1.0,1.0,1.0); m1.shininess = 50;
+    Material m2;
+    m2.ka = Vec3(0.0,0.1,0.0); m2.kd = Vec3(0.0,0.8,0.0); m2.ks = Vec3(1.0,1.0,1.0); m2.shininess = 100;
+    cena.adicionar(Vec4(-1.2,0,-5), Vec4(0.5,0.6,0), 1, cena.registrar_material(m1));
+    cena.adicionar(Vec4(1.2,0,-5), Vec4(0,-0.3,0), 1, cena.registrar_material(m2));
+    return cena;
+}
+
+// Câmera, luz principal e viewport iniciais da aplicação
+inline CameraCena camera_inicial() {
+    CameraCena c;
+    c.cam_pos = Vec4(0,0,0); c.light_pos = Vec4(2,3,-5);
+    c.light_color = Vec3(1.0f, 1.0f, 1.0f); c.ambient_color = Vec3(0.2f, 0.2f, 0.2f);
+    c.fov = 1.04f;
+    c.vp_x = 0; c.vp_y = 0; c.vp_w = SCREEN_W; c.vp_h = SCREEN_H;
+    return c;
+}
+
+// Parâmetros do quadro e transformações dos objetos animados. 'base' é a câmera de quando não há
+// chaves (a do instantâneo, ou a inicial da aplicação). Retorna os objetos alterados em 'editados'.
+inline ParametrosFrame aplicar_roteiro(const Roteiro& r, int quadro, const CameraCena& base, Cena& cena,
+                                       std::vector<int>& editados) {
+    ParametrosFrame p;
+    float v[CANAIS_MAX];
+    p.cam_pos = base.cam_pos;
+    p.fov = base.fov;
+    if(!r.camera.vazia()) { r.camera.avaliar(quadro, v, 4); p.cam_pos = Vec4(v[0], v[1], v[2]); p.fov = v[3]; }
+    p.light_pos = base.light_pos;
+    if(!r.luz.vazia()) { r.luz.avaliar(quadro, v, 3); p.light_pos = Vec4(v[0], v[1], v[2]); }
+    p.light_color = base.light_color;
+    p.ambient_color = base.ambient_color;
+    p.use_phong = r.phong;
+    p.raster = r.raster;
+    p.use_msaa = r.msaa;
+    p.use_sombras = r.sombras;
+    p.use_hiz = true;
+    p.largura = r.largura; p.altura = r.altura;
+    p.vp_x = 0; p.vp_y = 0; p.vp_w = r.largura; p.vp_h = r.altura;
+
+    editados.clear();
+    for(const TrilhaObjeto& o : r.objetos) {
+        if(o.idx >= cena.size()) continue;
+        o.trilha.avaliar(quadro, v, 6);
+        cena.posicoes[o.idx] = Vec4(v[0], v[1], v[2]);
+        cena.rotacoes[o.idx] = Vec4(v[3], v[4], 0);
+        cena.escalas[o.idx] = v[5];
+        editados.push_back((int)o.idx);
+    }
+    return p;
+}
+
+// ==========================================
+//   SAÍDA (Y4M E PPM)
+// ==========================================
+
+enum FormatoSaida { SAIDA_Y4M, SAIDA_PPM };
+
+// Bytes de um quadro já codificado, incluindo o cabeçalho do quadro
+inline size_t bytes_quadro(FormatoSaida formato, int w, int h) {
+    if(formato == SAIDA_PPM) return std::snprintf(nullptr, 0, "P6\n%d %d\n255\n", w, h) + (size_t)w * h * 3;
+    size_t cw = (w + 1) / 2, ch = (h + 1) / 2;
+    return 6 + (size_t)w * h + 2 * cw * ch; // "FRAME\n" + Y + U + V
+}
+
+// ARGB -> YUV 4:2:0 (BT.601, faixa limitada), crominância pela média de cada bloco 2x2
+inline uint8_t* argb_para_yuv420(const uint32_t* fb, int w, int h, uint8_t* saida) {
+    uint8_t* py = saida;
+    for(int i = 0; i < w * h; i++) {
+        int r = (fb[i] >> 16) & 0xFF, g = (fb[i] >> 8) & 0xFF, b = fb[i] & 0xFF;
+        py[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    uint8_t* pu = py + (size_t)w * h;
+    uint8_t* pv = pu + (size_t)cw * ch;
+    for(int y = 0; y < ch; y++) {
+        for(int x = 0; x < cw; x++) {
+            int r = 0, g = 0, b = 0, n = 0;
+            for(int dy = 0; dy < 2; dy++) {
+                for(int dx = 0; dx < 2; dx++) {
+                    int sx = x * 2 + dx, sy = y * 2 + dy;
+                    if(sx >= w || sy >= h) continue;
+                    uint32_t c = fb[(size_t)sy * w + sx];
+                    r += (c >> 16) & 0xFF; g += (c >> 8) & 0xFF; b += c & 0xFF; n++;
+                }
+            }
+            r /= n; g /= n; b /= n;
+            pu[y * cw + x] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            pv[y * cw + x] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+    return pv + (size_t)cw * ch;
+}
+
+// Codifica o framebuffer como um quadro completo do formato (roda no worker, em paralelo)
+inline void codificar_quadro(FormatoSaida formato, const uint32_t* fb, int w, int h, uint8_t* saida) {
+    if(formato == SAIDA_Y4M) {
+        std::memcpy(saida, "FRAME\n", 6);
+        argb_para_yuv420(fb, w, h, saida + 6);
+        return;
+    }
+    saida += std::sprintf((char*)saida, "P6\n%d %d\n255\n", w, h);
+    for(int i = 0; i < w * h; i++) {
+        *saida++ = (uint8_t)(fb[i] >> 16); *saida++ = (uint8_t)(fb[i] >> 8); *saida++ = (uint8_t)fb[i];
+    }
+}
+
+// Escritor com buffer grande: quadros menores que o buffer são acumulados e enviados em um único
+// write(); quadros maiores vão direto. Y4M é um arquivo só; PPM, um arquivo por quadro com o
+// número no lugar de "%d" (ex.: "quadros/q%04d.ppm").
+
+// O padrão PPM vai para snprintf como formato: só é aceito com exatamente uma conversão inteira
+// (%d ou %i, com flags, largura e precisão numéricas, sem '*' nem modificador de tamanho) além de
+// "%%" literais. Qualquer outra conversão leria argumentos que não foram passados.
+inline bool padrao_ppm_valido(const std::string& padrao) {
+    int conversoes = 0;
+    for(size_t i = 0; i < padrao.size(); i++) {
+        if(padrao[i] != '%') continue;
+        i++;
+        if(i < padrao.size() && padrao[i] == '%') continue;
+        while(i < padrao.size() && std::strchr("-+ #0", padrao[i])) i++;
+        while(i < padrao.size() && padrao[i] >= '0' && padrao[i] <= '9') i++;
+        if(i < padrao.size() && padrao[i] == '.') {
+            i++;
+            while(i < padrao.size() && padrao[i] >= '0' && padrao[i] <= '9') i++;
+        }
+        if(i >= padrao.size() || (padrao[i] != 'd' && padrao[i] != 'i')) return false;
+        conversoes++;
+    }
+    return conversoes == 1;
+}
+
+struct EscritorVideo {
+    static const size_t TAMANHO_BUFFER = 8 << 20;
+
+    FormatoSaida formato;
+    std::string caminho;
+    int fd = -1;
+    std::vector<uint8_t> buffer;
+    size_t usado = 0;
+    uint64_t bytes_escritos = 0;
+    bool erro = false;
+
+    EscritorVideo(const std::string& saida, const Roteiro& r) : caminho(saida) {
+        formato = saida.find('%') != std::string::npos ? SAIDA_PPM : SAIDA_Y4M;
+        if(formato == SAIDA_PPM) return;
+        fd = open(saida.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) { erro = true; return; }
+        buffer.resize(TAMANHO_BUFFER);
+        // C420mpeg2 com XCOLORRANGE=LIMITED: o que argb_para_yuv420 gera
+        char cab[128];
+        int n = std::snprintf(cab, sizeof(cab), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420mpeg2 XCOLORRANGE=LIMITED\n",
+                              r.largura, r.altura, r.fps);
+        acrescentar((const uint8_t*)cab, n);
+    }
+
+    ~EscritorVideo() { fechar(); }
+
+    // Envia o que restou no buffer e fecha o arquivo
+    void fechar() {
+        descarregar();
+        if(fd >= 0 && close(fd) != 0) erro = true;
+        fd = -1;
+    }
+
+    EscritorVideo(const EscritorVideo&) = delete;
+    EscritorVideo& operator=(const EscritorVideo&) = delete;
+
+    void escrever_quadro(int quadro, const uint8_t* dados, size_t n) {
+        if(formato == SAIDA_Y4M) { acrescentar(dados, n); return; }
+        char nome[1024];
+        std::snprintf(nome, sizeof(nome), caminho.c_str(), quadro);
+        int f = open(nome, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(f < 0) { erro = true; return; }
+        escrever_tudo(f, dados, n);
+        close(f);
+    }
+
+private:
+    void acrescentar(const uint8_t* dados, size_t n) {
+        if(usado + n > buffer.size()) descarregar();
+        if(n >= buffer.size()) { escrever_tudo(fd, dados, n); return; }
+        std::memcpy(buffer.data() + usado, dados, n);
+        usado += n;
+    }
+
+    void descarregar() {
+        if(usado && fd >= 0) escrever_tudo(fd, buffer.data(), usado);
+        usado = 0;
+    }
+
+    void escrever_tudo(int f, const uint8_t* dados, size_t n) {
+        while(n > 0 && !erro) {
+            ssize_t w = write(f, dados, n);
+            if(w <= 0) { erro = true; break; }
+            dados += w; n -= (size_t)w; bytes_escritos += (uint64_t)w;
+        }
+    }
+};
+
+// ==========================================
+//   BUFFER DE REORDENAÇÃO
+// ==========================================
+// Os workers terminam quadros fora de ordem; a escrita precisa deles em ordem. O quadro q ocupa a
+// posição q % capacidade, e um worker só começa o quadro q quando q < próximo a escrever + capacidade:
+// a memória fica limitada e um worker rápido espera em vez de correr na frente da escrita.
+
+struct BufferReordenacao {
+    BufferReordenacao(int capacidade, size_t bytes) : posicoes(capacidade), pronto(capacidade, 0) {
+        for(std::vector<uint8_t>& p : posicoes) p.resize(bytes);
+    }
+
+    // Worker: bloqueia até a posição do quadro estar livre e a devolve para ser preenchida
+    uint8_t* reservar(int quadro) {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_livre.wait(lock, [&] { return quadro < proximo + (int)posicoes.size(); });
+        return posicoes[quadro % posicoes.size()].data();
+    }
+
+    void concluir(int quadro) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pronto[quadro % posicoes.size()] = 1;
+        }
+        cv_pronto.notify_one();
+    }
+
+    // Escritor: espera o próximo quadro em ordem
+    const std::vector<uint8_t>& esperar() {
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_pronto.wait(lock, [&] { return pronto[proximo % posicoes.size()] != 0; });
+        return posicoes[proximo % posicoes.size()];
+    }
+
+    // Escritor: o quadro esperado foi escrito; sua posição volta a ficar livre
+    void liberar() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pronto[proximo % posicoes.size()] = 0;
+            proximo++;
+        }
+        cv_livre.notify_all();
+    }
+
+    int capacidade() const { return (int)posicoes.size(); }
+
+private:
+    std::vector<std::vector<uint8_t>> posicoes;
+    std::vector<uint8_t> pronto;
+    int proximo = 0;              // Próximo quadro a escrever
+    std::mutex mtx;
+    std::condition_variable cv_livre, cv_pronto;
+};
+
+// ==========================================
+//   RENDERIZAÇÃO EM LOTE
+// ==========================================
+
+struct ResultadoOffline {
+    int quadros = 0, workers = 0;
+    double segundos = 0;
+    double render_ms = 0;         // Soma do tempo de render dos workers (sem codificação e espera)
+    double espera_escrita_ms = 0; // Tempo da thread de escrita esperando o próximo quadro
+    uint64_t bytes = 0;
+    bool ok = false;
+
+    double quadros_por_segundo() const { return segundos > 0 ? quadros / segundos : 0.0; }
+};
+
+// Renderiza todos os quadros do roteiro com 'workers' threads (0: uma por núcleo) e escreve em
+// 'saida' (.y4m, ou um padrão com "%d" para PPM). A thread chamadora é a de escrita.
+inline ResultadoOffline renderizar_offline(const Roteiro& r, const Cena& cena, const CameraCena& camera_base,
+                                           const std::string& saida, int workers = 0) {
+    ResultadoOffline res;
+    if(workers <= 0) workers = (int)std::thread::hardware_concurrency();
+    if(workers <= 0) workers = 1;
+    res.quadros = r.quadros;
+    res.workers = workers;
+
+    EscritorVideo escritor(saida, r);
+    if(escritor.formato == SAIDA_PPM && !padrao_ppm_valido(saida)) {
+        std::printf("Padrao PPM invalido: %s (use exatamente um %%d, ex.: q%%04d.ppm)\n", saida.c_str());
+        return res;
+    }
+    if(escritor.erro) return res;
+    const size_t bytes = bytes_quadro(escritor.formato, r.largura, r.altura);
+    BufferReordenacao reordenacao(2 * workers, bytes);
+    std::atomic<int> proximo_quadro(0);
+    std::vector<double> render_ms(workers, 0.0);
+
+    auto inicio = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int w = 0; w < workers; w++) {
+        threads.emplace_back([&, w] {
+            // Tudo do worker é só dele: contexto (com uma thread, sem pool), buffers e cena
+            ContextoRender ctx(1);
+            Cena local = cena;
+            reconstruir_indice(ctx, local);
+            std::vector<uint32_t> fb((size_t)r.largura * r.altura);
+            std::vector<float> zb((size_t)r.largura * r.altura);
+            std::vector<int> editados;
+            for(;;) {
+                int q = proximo_quadro++;
+                if(q >= r.quadros) break;
+                uint8_t* destino = reordenacao.reservar(q);
+                auto t0 = std::chrono::steady_clock::now();
+                ParametrosFrame p = aplicar_roteiro(r, q, camera_base, local, editados);
+                for(int idx : editados) atualizar_objeto(ctx, local, idx);
+                if(!usa_framebuffer_contexto(p)) limpar_buffers(fb, zb);
+                renderizar_cena(ctx, local, p, fb, zb);
+                if(usa_framebuffer_contexto(p)) resolver_framebuffer(ctx, p, fb.data(), r.largura);
+                render_ms[w] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                codificar_quadro(escritor.formato, fb.data(), r.largura, r.altura, destino);
+                reordenacao.concluir(q);
+            }
+        });
+    }
+
+    for(int q = 0; q < r.quadros; q++) {
+        auto t0 = std::chrono::steady_clock::now();
+        const std::vector<uint8_t>& quadro = reordenacao.esperar();
+        res.espera_escrita_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        escritor.escrever_quadro(q, quadro.data(), quadro.size());
+        reordenacao.liberar();
+    }
+    for(std::thread& t : threads) t.join();
+    escritor.fechar(); // O último write() entra no tempo medido
+
+    res.segundos = std::chrono::duration<double>(std::chrono::steady_clock::now() - inicio).count();
+    for(double ms : render_ms) res.render_ms += ms;
+    res.bytes = escritor.bytes_escritos;
+    res.ok = !escritor.erro;
+    return res;
+}
+
+#endif
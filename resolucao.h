@@ -0,0 +1,99 @@
+/**
+ * RESOLUCAO.H
+ * Resolução dinâmica: o framebuffer interno (fb/zb) não precisa ter o tamanho da janela.
+ * O controlador ajusta a escala da resolução interna pelos tempos de frame medidos, para
+ * manter o frame dentro de um orçamento, e a imagem é ampliada para o tamanho da janela
+ * ao ser enviada para a textura.
+ */
+
+#ifndef RESOLUCAO_H
+#define RESOLUCAO_H
+
+#include "thread_pool.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+
+// Controlador da escala da resolução interna (fração da resolução de saída em cada eixo).
+// O custo do raster cresce com o número de pixels, ~escala², então a correção usa a raiz
+// da razão orçamento/tempo. Desce logo que o frame estoura o orçamento, mas sobe em passos
+// pequenos e só com folga, para não oscilar em torno do limite.
+struct ControleResolucao {
+    int largura_saida, altura_saida;  // Resolução da janela (escala 1)
+    float orcamento_ms;               // Tempo de frame alvo
+    float escala = 1.0f;
+    float escala_min = 0.5f, escala_max = 1.0f;
+    float media_ms = 0.0f;            // Média móvel exponencial dos tempos de frame (0: sem medida)
+    int espera = 0;                   // Frames até o próximo ajuste
+    bool ativo = true;
+
+    static const int FRAMES_ESPERA = 8;   // Frames medidos na resolução nova antes de reavaliar
+
+    ControleResolucao(int largura, int altura, float orcamento)
+        : largura_saida(largura), altura_saida(altura), orcamento_ms(orcamento) {}
+
+    int largura() const { return ativo ? std::max(1, (int)std::lround(largura_saida * escala)) : largura_saida; }
+    int altura() const { return ativo ? std::max(1, (int)std::lround(altura_saida * escala)) : altura_saida; }
+
+    // Registra o tempo do último frame. Retorna true se a resolução interna mudou.
+    bool registrar(float ms) {
+        if(!ativo) return false;
+        media_ms = (media_ms == 0.0f) ? ms : media_ms + 0.25f * (ms - media_ms);
+        if(espera > 0) { espera--; return false; }
+
+        float alvo = escala;
+        if(media_ms > orcamento_ms * 1.05f)
+            alvo = escala * std::sqrt(orcamento_ms / media_ms);
+        else if(media_ms < orcamento_ms * 0.8f)
+            alvo = std::min(escala * std::sqrt(orcamento_ms * 0.9f / media_ms), escala + 0.05f);
+        alvo = std::min(std::max(alvo, escala_min), escala_max);
+        if(std::fabs(alvo - escala) < 0.02f) return false;
+
+        escala = alvo;
+        espera = FRAMES_ESPERA;
+        media_ms = 0.0f; // A média da resolução anterior não vale para a nova
+        return true;
+    }
+};
+
+// Ampliação por vizinho mais próximo do framebuffer interno para o de saída. A coluna de origem
+// de cada coluna de saída é tabelada uma vez por resolução, e as linhas de saída que repetem a
+// linha de origem da anterior são copiadas inteiras (memcpy). Faixas de linhas vão para o pool.
+struct Ampliador {
+    std::vector<int> mapa_x;
+    int largura_origem = 0;
+
+    static const int LINHAS_POR_FAIXA = 32;
+
+    // passo: distância entre linhas do destino, em pixels (pitch da textura / 4)
+    void ampliar(const uint32_t* origem, int w, int h, uint32_t* destino, int largura, int altura, int passo,
+                 PoolThreads& pool) {
+        if(w == largura && h == altura) {
+            for(int y = 0; y < altura; y++) std::memcpy(destino + (size_t)y * passo, origem + (size_t)y * w, w * 4);
+            return;
+        }
+        if(largura_origem != w || (int)mapa_x.size() != largura) {
+            largura_origem = w;
+            mapa_x.resize(largura);
+            for(int x = 0; x < largura; x++) mapa_x[x] = (int)(((long long)(2 * x + 1) * w) / (2 * largura));
+        }
+
+        int faixas = (altura + LINHAS_POR_FAIXA - 1) / LINHAS_POR_FAIXA;
+        pool.executar(faixas, [&](int f) {
+            int y0 = f * LINHAS_POR_FAIXA, y1 = std::min(y0 + LINHAS_POR_FAIXA, altura);
+            int anterior = -1;
+            for(int y = y0; y < y1; y++) {
+                int sy = (int)(((long long)(2 * y + 1) * h) / (2 * altura));
+                uint32_t* linha = destino + (size_t)y * passo;
+                if(sy == anterior) { std::memcpy(linha, linha - passo, largura * 4); continue; }
+                const uint32_t* src = origem + (size_t)sy * w;
+                for(int x = 0; x < largura; x++) linha[x] = src[mapa_x[x]];
+                anterior = sy;
+            }
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * SIMD.H
+ * Camada fina sobre os intrínsecos vetoriais da CPU.
+ * Um "vfloat" guarda SIMD_LARGURA floats: 8 com AVX2, 4 com SSE2 e 1 (escalar) nas demais.
+ * Máscaras são vfloat com todos os bits ligados nas lanes verdadeiras.
+ */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_LARGURA 8
+#define SIMD_NOME "AVX2"
+
+typedef __m256  vfloat;
+typedef __m256i vint;
+
+inline vfloat vf_set(float a)                { return _mm256_set1_ps(a); }
+inline vfloat vf_load(const float* p)        { return _mm256_loadu_ps(p); }
+inline void   vf_store(float* p, vfloat v)   { _mm256_storeu_ps(p, v); }
+inline vfloat vf_add(vfloat a, vfloat b)     { return _mm256_add_ps(a, b); }
+inline vfloat vf_sub(vfloat a, vfloat b)     { return _mm256_sub_ps(a, b); }
+inline vfloat vf_mul(vfloat a, vfloat b)     { return _mm256_mul_ps(a, b); }
+inline vfloat vf_div(vfloat a, vfloat b)     { return _mm256_div_ps(a, b); }
+inline vfloat vf_min(vfloat a, vfloat b)     { return _mm256_min_ps(a, b); }
+inline vfloat vf_max(vfloat a, vfloat b)     { return _mm256_max_ps(a, b); }
+inline vfloat vf_sqrt(vfloat a)              { return _mm256_sqrt_ps(a); }
+inline vfloat vf_lt(vfloat a, vfloat b)      { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline vfloat vf_ge(vfloat a, vfloat b)      { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline vfloat vf_and(vfloat a, vfloat b)     { return _mm256_and_ps(a, b); }
+inline vfloat vf_or(vfloat a, vfloat b)      { return _mm256_or_ps(a, b); }
+inline vfloat vf_sel(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); }
+inline int    vf_mask(vfloat m)              { return _mm256_movemask_ps(m); }
+inline vfloat vf_rampa()                     { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+
+inline vint vi_set(uint32_t a)               { return _mm256_set1_epi32((int)a); }
+inline vint vi_load(const uint32_t* p)       { return _mm256_loadu_si256((const __m256i*)p); }
+inline void vi_store(uint32_t* p, vint v)    { _mm256_storeu_si256((__m256i*)p, v); }
+inline vint vi_sel(vfloat m, vint a, vint b) { return _mm256_blendv_epi8(b, a, _mm256_castps_si256(m)); }
+inline vint vi_add(vint a, vint b)           { return _mm256_add_epi32(a, b); }
+inline vint vi_or(vint a, vint b)            { return _mm256_or_si256(a, b); }
+inline vint vi_and(vint a, vint b)           { return _mm256_and_si256(a, b); }
+template<int N> inline vint vi_shl(vint a)   { return _mm256_slli_epi32(a, N); }
+template<int N> inline vint vi_shr(vint a)   { return _mm256_srli_epi32(a, N); }
+
+// Conversões: valor (truncado ou arredondado) e reinterpretação dos bits
+inline vint   vf_para_vi_trunc(vfloat a)     { return _mm256_cvttps_epi32(a); }
+inline vint   vf_para_vi_arred(vfloat a)     { return _mm256_cvtps_epi32(a); }
+inline vfloat vi_para_vf(vint a)             { return _mm256_cvtepi32_ps(a); }
+inline vint   vf_bits(vfloat a)              { return _mm256_castps_si256(a); }
+inline vfloat vi_bits(vint a)                { return _mm256_castsi256_ps(a); }
+
+// Inteiros de 16 bits sem sinal <-> float (profundidade de 16 bits); o valor a guardar já é inteiro
+// Leitura indexada: lane i recebe base[idx[i]] (texels e tabelas de texturas)
+inline vint vi_gather(const uint32_t* base, vint idx) { return _mm256_i32gather_epi32((const int*)base, idx, 4); }
+
+inline vfloat vf_load_u16(const uint16_t* p) { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p))); }
+inline void vf_store_u16(uint16_t* p, vfloat v) {
+    __m256i i = _mm256_cvttps_epi32(v);
+    __m256i e = _mm256_permute4x64_epi64(_mm256_packus_epi32(i, i), 0x08); // Junta as duas metades
+    _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(e));
+}
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_LARGURA 4
+#define SIMD_NOME "SSE2"
+
+typedef __m128  vfloat;
+typedef __m128i vint;
+
+inline vfloat vf_set(float a)                { return _mm_set1_ps(a); }
+inline vfloat vf_load(const float* p)        { return _mm_loadu_ps(p); }
+inline void   vf_store(float* p, vfloat v)   { _mm_storeu_ps(p, v); }
+inline vfloat vf_add(vfloat a, vfloat b)     { return _mm_add_ps(a, b); }
+inline vfloat vf_sub(vfloat a, vfloat b)     { return _mm_sub_ps(a, b); }
+inline vfloat vf_mul(vfloat a, vfloat b)     { return _mm_mul_ps(a, b); }
+inline vfloat vf_div(vfloat a, vfloat b)     { return _mm_div_ps(a, b); }
+inline vfloat vf_min(vfloat a, vfloat b)     { return _mm_min_ps(a, b); }
+inline vfloat vf_max(vfloat a, vfloat b)     { return _mm_max_ps(a, b); }
+inline vfloat vf_sqrt(vfloat a)              { return _mm_sqrt_ps(a); }
+inline vfloat vf_lt(vfloat a, vfloat b)      { return _mm_cmplt_ps(a, b); }
+inline vfloat vf_ge(vfloat a, vfloat b)      { return _mm_cmpge_ps(a, b); }
+inline vfloat vf_and(vfloat a, vfloat b)     { return _mm_and_ps(a, b); }
+inline vfloat vf_or(vfloat a, vfloat b)      { return _mm_or_ps(a, b); }
+inline vfloat vf_sel(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline int    vf_mask(vfloat m)              { return _mm_movemask_ps(m); }
+inline vfloat vf_rampa()                     { return _mm_setr_ps(0, 1, 2, 3); }
+
+inline vint vi_set(uint32_t a)               { return _mm_set1_epi32((int)a); }
+inline vint vi_load(const uint32_t* p)       { return _mm_loadu_si128((const __m128i*)p); }
+inline void vi_store(uint32_t* p, vint v)    { _mm_storeu_si128((__m128i*)p, v); }
+inline vint vi_sel(vfloat m, vint a, vint b) {
+    __m128i mi = _mm_castps_si128(m);
+    return _mm_or_si128(_mm_and_si128(mi, a), _mm_andnot_si128(mi, b));
+}
+inline vint vi_add(vint a, vint b)           { return _mm_add_epi32(a, b); }
+inline vint vi_or(vint a, vint b)            { return _mm_or_si128(a, b); }
+inline vint vi_and(vint a, vint b)           { return _mm_and_si128(a, b); }
+template<int N> inline vint vi_shl(vint a)   { return _mm_slli_epi32(a, N); }
+template<int N> inline vint vi_shr(vint a)   { return _mm_srli_epi32(a, N); }
+
+// Conversões: valor (truncado ou arredondado) e reinterpretação dos bits
+inline vint   vf_para_vi_trunc(vfloat a)     { return _mm_cvttps_epi32(a); }
+inline vint   vf_para_vi_arred(vfloat a)     { return _mm_cvtps_epi32(a); }
+inline vfloat vi_para_vf(vint a)             { return _mm_cvtepi32_ps(a); }
+inline vint   vf_bits(vfloat a)              { return _mm_castps_si128(a); }
+inline vfloat vi_bits(vint a)                { return _mm_castsi128_ps(a); }
+
+// Leitura indexada: o SSE2 não tem gather, então cada lane é lida separadamente
+inline vint vi_gather(const uint32_t* base, vint idx) {
+    alignas(16) uint32_t i[4];
+    _mm_store_si128((__m128i*)i, idx);
+    return _mm_setr_epi32((int)base[i[0]], (int)base[i[1]], (int)base[i[2]], (int)base[i[3]]);
+}
+
+// Inteiros de 16 bits sem sinal <-> float (profundidade de 16 bits); o valor a guardar já é inteiro.
+// O SSE2 não tem packus_epi32: desloca para a faixa com sinal, empacota e desfaz o deslocamento.
+inline vfloat vf_load_u16(const uint16_t* p) {
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128()));
+}
+inline void vf_store_u16(uint16_t* p, vfloat v) {
+    __m128i i = _mm_sub_epi32(_mm_cvttps_epi32(v), _mm_set1_epi32(32768));
+    _mm_storel_epi64((__m128i*)p, _mm_xor_si128(_mm_packs_epi32(i, i), _mm_set1_epi16((short)0x8000)));
+}
+
+#else
+#include <cmath>
+#include <cstring>
+#define SIMD_LARGURA 1
+#define SIMD_NOME "escalar"
+
+// Sem SIMD: uma lane; máscaras são 1.0f (verdadeiro) ou 0.0f (falso).
+typedef float    vfloat;
+typedef uint32_t vint;
+
+inline vfloat vf_set(float a)                { return a; }
+inline vfloat vf_load(const float* p)        { return *p; }
+inline void   vf_store(float* p, vfloat v)   { *p = v; }
+inline vfloat vf_add(vfloat a, vfloat b)     { return a + b; }
+inline vfloat vf_sub(vfloat a, vfloat b)     { return a - b; }
+inline vfloat vf_mul(vfloat a, vfloat b)     { return a * b; }
+inline vfloat vf_div(vfloat a, vfloat b)     { return a / b; }
+inline vfloat vf_min(vfloat a, vfloat b)     { return a < b ? a : b; }
+inline vfloat vf_max(vfloat a, vfloat b)     { return a > b ? a : b; }
+inline vfloat vf_sqrt(vfloat a)              { return std::sqrt(a); }
+inline vfloat vf_lt(vfloat a, vfloat b)      { return a < b ? 1.0f : 0.0f; }
+inline vfloat vf_ge(vfloat a, vfloat b)      { return a >= b ? 1.0f : 0.0f; }
+inline vfloat vf_and(vfloat a, vfloat b)     { return a * b; }
+inline vfloat vf_or(vfloat a, vfloat b)      { return (a != 0.0f || b != 0.0f) ? 1.0f : 0.0f; }
+inline vfloat vf_sel(vfloat m, vfloat a, vfloat b) { return m != 0.0f ? a : b; }
+inline int    vf_mask(vfloat m)              { return m != 0.0f ? 1 : 0; }
+inline vfloat vf_rampa()                     { return 0.0f; }
+
+inline vint vi_set(uint32_t a)               { return a; }
+inline vint vi_load(const uint32_t* p)       { return *p; }
+inline void vi_store(uint32_t* p, vint v)    { *p = v; }
+inline vint vi_sel(vfloat m, vint a, vint b) { return m != 0.0f ? a : b; }
+inline vint vi_add(vint a, vint b)           { return a + b; }
+inline vint vi_or(vint a, vint b)            { return a | b; }
+inline vint vi_and(vint a, vint b)           { return a & b; }
+template<int N> inline vint vi_shl(vint a)   { return a << N; }
+template<int N> inline vint vi_shr(vint a)   { return a >> N; }
+
+// Conversões: valor (truncado ou arredondado) e reinterpretação dos bits
+inline vint   vf_para_vi_trunc(vfloat a)     { return (vint)(int32_t)a; }
+inline vint   vf_para_vi_arred(vfloat a)     { return (vint)(int32_t)std::nearbyint(a); }
+inline vfloat vi_para_vf(vint a)             { return (float)(int32_t)a; }
+inline vint   vf_bits(vfloat a)              { vint r; std::memcpy(&r, &a, 4); return r; }
+inline vfloat vi_bits(vint a)                { vfloat r; std::memcpy(&r, &a, 4); return r; }
+
+inline vint vi_gather(const uint32_t* base, vint idx) { return base[idx]; }
+
+inline vfloat vf_load_u16(const uint16_t* p) { return (float)*p; }
+inline void vf_store_u16(uint16_t* p, vfloat v) { *p = (uint16_t)v; }
+#endif
+
+// Leitura indexada de floats (a mesma vi_gather, reinterpretando os bits)
+inline vfloat vf_gather(const float* base, vint idx) { return vi_bits(vi_gather((const uint32_t*)base, idx)); }
+
+// Arredondamento para baixo (|a| < 2^31): o truncamento corrigido nas lanes negativas não inteiras
+inline vfloat vf_floor(vfloat a) {
+    vfloat t = vi_para_vf(vf_para_vi_trunc(a));
+    return vf_sub(t, vf_and(vf_lt(a, t), vf_set(1.0f)));
+}
+
+// ==========================================
+//   FUNÇÕES TRANSCENDENTAIS RÁPIDAS
+// ==========================================
+// Usadas no termo especular (x^shininess) no lugar de std::pow, que não vetoriza.
+// Erros medidos contra log2/exp2/pow em double (iguais nos três backends):
+//  - vf_log2 (x em (0, 8]): erro absoluto < 1e-6
+//  - vf_exp2 (y em [-126, 0]): erro relativo < 2e-7
+//  - vf_pow01 (x em [0, 1], expoente em [1, 1000]): erro absoluto < 2e-7,
+//    muito abaixo de um nível de cor de 8 bits (1/255)
+// ==========================================
+
+// log2(x) para x > 0 normal: x = m * 2^e com m em [sqrt(1/2), sqrt(2)), e
+// log2(m) = 2/ln(2) * atanh(t), t = (m-1)/(m+1), pela série de atanh até t^11 (|t| < 0.172).
+inline vfloat vf_log2(vfloat x) {
+    vint bits = vf_bits(x);
+    // Desloca a mantissa para que m fique em [sqrt(1/2), sqrt(2)) ajustando o expoente junto
+    vint ajuste = vi_add(bits, vi_set(0x3F800000u - 0x3F3504F3u));
+    vint e = vi_add(vi_shr<23>(ajuste), vi_set((uint32_t)-127));
+    vfloat m = vi_bits(vi_add(vi_and(ajuste, vi_set(0x007FFFFFu)), vi_set(0x3F3504F3u)));
+
+    vfloat t = vf_div(vf_sub(m, vf_set(1.0f)), vf_add(m, vf_set(1.0f)));
+    vfloat t2 = vf_mul(t, t);
+    vfloat serie = vf_set(1.0f / 11.0f);
+    serie = vf_add(vf_mul(serie, t2), vf_set(1.0f / 9.0f));
+    serie = vf_add(vf_mul(serie, t2), vf_set(1.0f / 7.0f));
+    serie = vf_add(vf_mul(serie, t2), vf_set(1.0f / 5.0f));
+    serie = vf_add(vf_mul(serie, t2), vf_set(1.0f / 3.0f));
+    serie = vf_add(vf_mul(serie, t2), vf_set(1.0f));
+    return vf_add(vi_para_vf(e), vf_mul(vf_mul(serie, t), vf_set(2.8853900817779268f))); // 2/ln(2)
+}
+
+// 2^y para y <= 0 (abaixo de -126 o resultado é 0): y = n + f com n inteiro e f em [-0.5, 0.5];
+// 2^f = e^(f ln 2) pelo polinômio de Taylor de grau 7; 2^n montado direto no expoente.
+inline vfloat vf_exp2(vfloat y) {
+    vfloat abaixo = vf_lt(y, vf_set(-126.0f));
+    y = vf_max(y, vf_set(-126.0f));
+    vint n = vf_para_vi_arred(y);
+    vfloat f = vf_mul(vf_sub(y, vi_para_vf(n)), vf_set(0.69314718055994531f));
+
+    vfloat p = vf_set(1.0f / 5040.0f);
+    p = vf_add(vf_mul(p, f), vf_set(1.0f / 720.0f));
+    p = vf_add(vf_mul(p, f), vf_set(1.0f / 120.0f));
+    p = vf_add(vf_mul(p, f), vf_set(1.0f / 24.0f));
+    p = vf_add(vf_mul(p, f), vf_set(1.0f / 6.0f));
+    p = vf_add(vf_mul(p, f), vf_set(0.5f));
+    p = vf_add(vf_mul(p, f), vf_set(1.0f));
+    p = vf_add(vf_mul(p, f), vf_set(1.0f));
+
+    vfloat escala = vi_bits(vi_shl<23>(vi_add(n, vi_set(127))));
+    return vf_sel(abaixo, vf_set(0.0f), vf_mul(p, escala));
+}
+
+// x^e para x em [0, 1] e e >= 1 (termo especular). x = 0 resulta em 0.
+inline vfloat vf_pow01(vfloat x, vfloat e) {
+    vfloat positivo = vf_lt(vf_set(0.0f), x);
+    vfloat r = vf_exp2(vf_mul(e, vf_log2(vf_max(x, vf_set(1e-30f)))));
+    return vf_and(r, positivo);
+}
+
+#endif
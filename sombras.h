@@ -0,0 +1,148 @@
+/**
+ * SOMBRAS.H
+ * Sombras da luz principal por Cube Shadow Map: seis mapas de profundidade de 90°, um por eixo,
+ * renderizados a partir da posição da luz pelo mesmo rasterizador de arestas (ver atualizar_sombras
+ * em pipeline.h). O Pixel Shader escolhe a face pelo eixo dominante do vetor luz -> ponto e compara
+ * a distância do ponto com a do oclusor guardado no texel.
+ *
+ * Os mapas dependem só da luz e dos objetos, não da câmera: ficam guardados entre frames e cada face
+ * é refeita apenas quando a luz se move ou quando um objeto que ela enxerga (antes ou depois da
+ * edição) é movido. Com a luz e a cena paradas, o custo das sombras é só a consulta por pixel.
+ */
+
+#ifndef SOMBRAS_H
+#define SOMBRAS_H
+
+#include "math_utils.h"
+#include "simd.h"
+#include "framebuffer.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+const int RESOLUCAO_SOMBRA = 512;   // Lado de cada face, em texels
+const int FACES_SOMBRA = 6;
+const float Z_NEAR_SOMBRA = 0.05f, Z_FAR_SOMBRA = 100.0f;
+
+// Tolerância da comparação: BIAS_SOMBRA na unidade da cena mais TEXELS_BIAS_SOMBRA texels à distância
+// do ponto. Só as faces de trás dos objetos (vistas da luz) entram no mapa, então a superfície
+// iluminada fica longe do oclusor do próprio objeto; a tolerância cobre o arredondamento dos vértices
+// para texels e as paredes de objetos encostados, que ficam na mesma distância da superfície.
+const float BIAS_SOMBRA = 0.05f;
+const float TEXELS_BIAS_SOMBRA = 2.0f;
+
+// Orientação de cada face: frente (eixo), cima e direita = frente x cima, como a câmera do pipeline
+// (olha para -Z no seu View Space). Ordem: +X, -X, +Y, -Y, +Z, -Z.
+struct FaceSombra {
+    Vec4 frente, cima, direita;
+};
+
+inline FaceSombra montar_face_sombra(int f) {
+    static const float eixos[FACES_SOMBRA][6] = {
+        { 1, 0, 0,  0, 1, 0 }, { -1, 0, 0,  0, 1, 0 },
+        { 0, 1, 0,  0, 0, -1 }, { 0, -1, 0,  0, 0, 1 },
+        { 0, 0, 1,  0, 1, 0 }, { 0, 0, -1,  0, 1, 0 },
+    };
+    const float* e = eixos[f];
+    FaceSombra s;
+    s.frente = Vec4(e[0], e[1], e[2], 0);
+    s.cima = Vec4(e[3], e[4], e[5], 0);
+    s.direita = s.frente.cross(s.cima);
+    return s;
+}
+
+struct MapaSombras {
+    std::vector<float> prof;        // FACES_SOMBRA x RESOLUCAO_SOMBRA², -1/W (afim na tela), Z_LIMPO = vazio
+    FaceSombra faces[FACES_SOMBRA];
+    Afim3x4 view[FACES_SOMBRA];     // Mundo -> espaço da face (luz na origem, olhando para -Z)
+    Mat4 proj;                      // Projeção de 90°, comum às seis faces
+    Plano planos[6];                // Frustum da face, no espaço da face
+    Vec4 luz;                       // Posição da luz com que os mapas foram feitos
+    uint8_t sujas = 0x3F;           // Faces a refazer no próximo frame com sombras (bit f = face f)
+    std::vector<uint8_t> faces_objeto; // Faces que a esfera envolvente de cada objeto toca (última renderização)
+    float eixos_uv[6][FACES_SOMBRA]; // direita.xyz e cima.xyz de cada face, na ordem das faces
+
+    MapaSombras() {
+        proj = perspective(3.14159265f * 0.5f, 1.0f, Z_NEAR_SOMBRA, Z_FAR_SOMBRA);
+        extrair_planos_frustum(proj, planos);
+        for(int f = 0; f < FACES_SOMBRA; f++) {
+            faces[f] = montar_face_sombra(f);
+            const Vec4 &d = faces[f].direita, &c = faces[f].cima;
+            float e[6] = { d.x, d.y, d.z, c.x, c.y, c.z };
+            for(int i = 0; i < 6; i++) eixos_uv[i][f] = e[i];
+        }
+    }
+
+    void invalidar() { sujas = (1 << FACES_SOMBRA) - 1; faces_objeto.clear(); }
+
+    // Nova posição da luz: todas as faces ficam obsoletas
+    void posicionar_luz(const Vec4& l) {
+        if(!prof.empty() && l.x == luz.x && l.y == luz.y && l.z == luz.z) return;
+        luz = l;
+        for(int f = 0; f < FACES_SOMBRA; f++) {
+            const Vec4 &d = faces[f].direita, &c = faces[f].cima, &fr = faces[f].frente;
+            float linhas[3][3] = { { d.x, d.y, d.z }, { c.x, c.y, c.z }, { -fr.x, -fr.y, -fr.z } };
+            for(int i = 0; i < 3; i++) {
+                for(int j = 0; j < 3; j++) view[f].m[i][j] = linhas[i][j];
+                view[f].m[i][3] = -(linhas[i][0] * l.x + linhas[i][1] * l.y + linhas[i][2] * l.z);
+            }
+        }
+        sujas = (1 << FACES_SOMBRA) - 1;
+    }
+
+    // Faces cujo frustum a esfera (no mundo) toca
+    uint8_t faces_esfera(const Vec4& centro, float raio) const {
+        uint8_t m = 0;
+        for(int f = 0; f < FACES_SOMBRA; f++) {
+            Vec4 c = view[f] * centro;
+            bool fora = false;
+            for(int pl = 0; pl < 6 && !fora; pl++) fora = planos[pl].dist(c) < -raio;
+            if(!fora) m |= 1 << f;
+        }
+        return m;
+    }
+
+    // Objeto editado: suja as faces em que ele estava e as em que ele está agora
+    void objeto_movido(const Vec4& centro, float raio, int idx) {
+        if(idx < 0 || (size_t)idx >= faces_objeto.size()) { invalidar(); return; }
+        sujas |= faces_objeto[idx] | faces_esfera(centro, raio);
+    }
+
+    float* prof_face(int f) { return prof.data() + (size_t)f * RESOLUCAO_SOMBRA * RESOLUCAO_SOMBRA; }
+
+    // Máscara das lanes iluminadas de SIMD_LARGURA pontos a (dx, dy, dz) da luz. Mesma projeção de
+    // projetar_vertice na face do eixo dominante; a profundidade da face é a distância ao longo
+    // desse eixo. A face de cada lane sai de comparações e seleções e o texel, de uma leitura
+    // indexada nas seis faces. O índice fica dentro do mapa em qualquer lane (mesmo com ponto em
+    // cima da luz), então as lanes que o chamador vai descartar não precisam ser isoladas.
+    vfloat iluminado(vfloat dx, vfloat dy, vfloat dz) const {
+        const int N = RESOLUCAO_SOMBRA;
+        const vfloat zero = vf_set(0.0f);
+        vfloat ax = vf_max(dx, vf_sub(zero, dx)), ay = vf_max(dy, vf_sub(zero, dy)), az = vf_max(dz, vf_sub(zero, dz));
+        vfloat eixo_x = vf_and(vf_ge(ax, ay), vf_ge(ax, az)), eixo_y = vf_ge(ay, az);
+        vfloat pos_x = vf_lt(zero, dx), pos_y = vf_lt(zero, dy), pos_z = vf_lt(zero, dz);
+        // Valor por lane de uma grandeza por face: v[f] da face f escolhida em cada lane
+        auto por_face = [&](const float v[FACES_SOMBRA]) {
+            return vf_sel(eixo_x, vf_sel(pos_x, vf_set(v[0]), vf_set(v[1])),
+                          vf_sel(eixo_y, vf_sel(pos_y, vf_set(v[2]), vf_set(v[3])), vf_sel(pos_z, vf_set(v[4]), vf_set(v[5]))));
+        };
+        static const float indice_face[FACES_SOMBRA] = { 0, 1, 2, 3, 4, 5 };
+        vfloat ma = vf_sel(eixo_x, ax, vf_sel(eixo_y, ay, az));
+        vfloat u = vf_div(vf_add(vf_add(vf_mul(por_face(eixos_uv[0]), dx), vf_mul(por_face(eixos_uv[1]), dy)),
+                                 vf_mul(por_face(eixos_uv[2]), dz)), ma);
+        vfloat v = vf_div(vf_add(vf_add(vf_mul(por_face(eixos_uv[3]), dx), vf_mul(por_face(eixos_uv[4]), dy)),
+                                 vf_mul(por_face(eixos_uv[5]), dz)), ma);
+
+        // Texel: limitado em float antes de truncar (u e v podem ser infinitos ou NaN perto da luz)
+        const vfloat um = vf_set(1.0f), meio = vf_set(0.5f), n = vf_set((float)N), ultimo = vf_set((float)(N - 1));
+        vfloat tx = vi_para_vf(vf_para_vi_trunc(vf_min(vf_max(vf_mul(vf_mul(vf_add(u, um), meio), n), zero), ultimo)));
+        vfloat ty = vi_para_vf(vf_para_vi_trunc(vf_min(vf_max(vf_mul(vf_mul(vf_sub(um, v), meio), n), zero), ultimo)));
+        vfloat indice = vf_add(vf_add(vf_mul(por_face(indice_face), vf_set((float)N * N)), vf_mul(ty, n)), tx); // < 2^24: exato
+        vfloat z = vf_gather(prof.data(), vf_para_vi_trunc(indice));
+
+        vfloat limiar = vf_add(vf_add(vf_div(vf_set(-1.0f), z), vf_set(BIAS_SOMBRA)), vf_mul(ma, vf_set(2.0f * TEXELS_BIAS_SOMBRA / N)));
+        return vf_or(vf_or(vf_ge(vf_set(Z_NEAR_SOMBRA), ma), vf_ge(z, vf_set(Z_LIMPO))), vf_ge(limiar, ma));
+    }
+};
+
+#endif
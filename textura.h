@@ -0,0 +1,305 @@
+/**
+ * TEXTURA.H
+ * Texturas dos materiais: cadeia de mipmaps pré-calculada e texels em ordem de Morton.
+ *
+ * Cada nível da cadeia tem metade da resolução do anterior (média de 2x2 texels), até 1x1. O
+ * rasterizador interpola s/W, t/W e 1/W, que variam linearmente na tela, e divide por 1/W em cada
+ * pixel (correção de perspectiva). As mesmas derivadas dão quantos texels um pixel cobre, e o
+ * nível é escolhido uma vez por bloco SIMD de pixels; dentro dele a amostragem é bilinear.
+ *
+ * Em ordem linear (linha a linha), pixels vizinhos em uma superfície girada na tela andam pelas
+ * colunas da textura, e cada passo cai em outra linha de cache. Em ordem de Morton (bits de x e y
+ * intercalados) os texels próximos em qualquer direção ficam próximos na memória. O layout é
+ * definido por duas tabelas por nível (deslocamento de cada coluna e de cada linha), então a
+ * amostragem é a mesma para os dois.
+ */
+
+#ifndef TEXTURA_H
+#define TEXTURA_H
+
+#include "math_utils.h"
+#include "simd.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+enum LayoutTextura { TEXTURA_LINEAR, TEXTURA_MORTON };
+
+const char* const TEXTURA_XADREZ = "xadrez"; // Nome da textura gerada (sem arquivo), ver carregar_textura
+const int TEXTURA_LADO_MAX = 4096;
+
+// Nível da cadeia de mipmaps. O texel (x, y) está em texels[desl_x[x] + desl_y[y]].
+struct NivelMip {
+    int largura, altura;            // Potências de 2
+    std::vector<uint32_t> texels;   // ARGB8888, na ordem do layout
+    std::vector<uint32_t> desl_x, desl_y;
+};
+
+struct Textura {
+    std::string nome;               // Arquivo PPM ou TEXTURA_XADREZ (gravado nos instantâneos da cena)
+    LayoutTextura layout;
+    std::vector<NivelMip> niveis;   // niveis[0] na resolução cheia; o último tem 1x1
+    bool mipmaps = true;            // false: amostra sempre o nível 0 (comparação no benchmark)
+};
+
+inline int log2_inteiro(int n) { int l = 0; while((1 << (l + 1)) <= n) l++; return l; }
+
+// Tabelas de deslocamento do layout. Em Morton, com lados diferentes, os bits que sobram do lado
+// maior vão acima dos intercalados.
+inline void montar_deslocamentos(NivelMip& n, LayoutTextura layout) {
+    int lx = log2_inteiro(n.largura), ly = log2_inteiro(n.altura);
+    n.desl_x.resize(n.largura);
+    n.desl_y.resize(n.altura);
+    for(int x = 0; x < n.largura; x++) {
+        uint32_t d = 0;
+        for(int i = 0; i < lx; i++) if(x & (1 << i)) d |= 1u << (i < ly ? 2 * i : ly + i);
+        n.desl_x[x] = layout == TEXTURA_MORTON ? d : (uint32_t)x;
+    }
+    for(int y = 0; y < n.altura; y++) {
+        uint32_t d = 0;
+        for(int i = 0; i < ly; i++) if(y & (1 << i)) d |= 1u << (i < lx ? 2 * i + 1 : lx + i);
+        n.desl_y[y] = layout == TEXTURA_MORTON ? d : (uint32_t)y * n.largura;
+    }
+}
+
+// Média de 2x2 texels por canal (um lado 1 usa só pares do outro)
+inline std::vector<uint32_t> reduzir_mip(const std::vector<uint32_t>& src, int w, int h, int nw, int nh) {
+    std::vector<uint32_t> dst((size_t)nw * nh);
+    for(int y = 0; y < nh; y++) {
+        for(int x = 0; x < nw; x++) {
+            int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+            int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+            uint32_t c[4] = { src[(size_t)y0 * w + x0], src[(size_t)y0 * w + x1], src[(size_t)y1 * w + x0], src[(size_t)y1 * w + x1] };
+            uint32_t rb = 0x00020002u, ag = 0x00020002u;
+            for(uint32_t k : c) { rb += k & 0x00FF00FFu; ag += (k >> 8) & 0x00FF00FFu; }
+            dst[(size_t)y * nw + x] = (((ag >> 2) & 0x00FF00FFu) << 8) | ((rb >> 2) & 0x00FF00FFu);
+        }
+    }
+    return dst;
+}
+
+// Textura a partir de pixels ARGB em ordem linear, com lados potências de 2
+inline std::shared_ptr<Textura> montar_textura(const std::string& nome, std::vector<uint32_t> pixels, int w, int h,
+                                               LayoutTextura layout = TEXTURA_MORTON) {
+    std::shared_ptr<Textura> t(new Textura());
+    t->nome = nome;
+    t->layout = layout;
+    while(true) {
+        NivelMip n;
+        n.largura = w; n.altura = h;
+        montar_deslocamentos(n, layout);
+        n.texels.resize(pixels.size());
+        for(int y = 0; y < h; y++)
+            for(int x = 0; x < w; x++) n.texels[n.desl_x[x] + n.desl_y[y]] = pixels[(size_t)y * w + x];
+        t->niveis.push_back(std::move(n));
+        if(w == 1 && h == 1) break;
+        int nw = std::max(w / 2, 1), nh = std::max(h / 2, 1);
+        pixels = reduzir_mip(pixels, w, h, nw, nh);
+        w = nw; h = nh;
+    }
+    return t;
+}
+
+// Mesma imagem em outro layout (comparação no benchmark)
+inline std::shared_ptr<Textura> reorganizar_textura(const Textura& t, LayoutTextura layout) {
+    const NivelMip& n = t.niveis[0];
+    std::vector<uint32_t> pixels((size_t)n.largura * n.altura);
+    for(int y = 0; y < n.altura; y++)
+        for(int x = 0; x < n.largura; x++) pixels[(size_t)y * n.largura + x] = n.texels[n.desl_x[x] + n.desl_y[y]];
+    return montar_textura(t.nome, std::move(pixels), n.largura, n.altura, layout);
+}
+
+// Tabuleiro de 8x8 casas em dois tons, com uma moldura fina em cada casa (detalhe que só os
+// níveis finos mostram)
+inline std::vector<uint32_t> gerar_xadrez(int lado) {
+    std::vector<uint32_t> p((size_t)lado * lado);
+    const int casa = lado / 8;
+    for(int y = 0; y < lado; y++) {
+        for(int x = 0; x < lado; x++) {
+            bool escura = ((x / casa) + (y / casa)) & 1;
+            bool borda = x % casa < casa / 32 + 1 || y % casa < casa / 32 + 1;
+            p[(size_t)y * lado + x] = borda ? 0xFF303030u : escura ? 0xFF4060A0u : 0xFFE8E0C8u;
+        }
+    }
+    return p;
+}
+
+// Lê um PPM binário (P6, 8 bits por canal) em ARGB linear
+inline bool ler_ppm(const char* caminho, std::vector<uint32_t>& pixels, int& w, int& h) {
+    FILE* f = std::fopen(caminho, "rb");
+    if(!f) return false;
+    // Cabeçalho: "P6", largura, altura e valor máximo, separados por espaços e comentários (#)
+    auto numero = [&](int& v) {
+        int c = std::fgetc(f);
+        while(c == '#' || c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            if(c == '#') while(c != '\n' && c != EOF) c = std::fgetc(f);
+            c = std::fgetc(f);
+        }
+        if(c < '0' || c > '9') return false;
+        v = 0;
+        while(c >= '0' && c <= '9') { v = v * 10 + (c - '0'); c = std::fgetc(f); }
+        return true; // O separador depois do último número já foi consumido
+    };
+    char magica[2];
+    int maximo = 0;
+    bool ok = std::fread(magica, 1, 2, f) == 2 && magica[0] == 'P' && magica[1] == '6' &&
+              numero(w) && numero(h) && numero(maximo) && maximo == 255 &&
+              w > 0 && h > 0 && w <= TEXTURA_LADO_MAX && h <= TEXTURA_LADO_MAX;
+    std::vector<uint8_t> rgb;
+    if(ok) {
+        rgb.resize((size_t)w * h * 3);
+        ok = std::fread(rgb.data(), 1, rgb.size(), f) == rgb.size();
+    }
+    std::fclose(f);
+    if(!ok) return false;
+    pixels.resize((size_t)w * h);
+    for(size_t i = 0; i < pixels.size(); i++)
+        pixels[i] = 0xFF000000u | (uint32_t)rgb[3 * i] << 16 | (uint32_t)rgb[3 * i + 1] << 8 | rgb[3 * i + 2];
+    return true;
+}
+
+// Carrega uma textura pelo nome: TEXTURA_XADREZ é gerada; o resto é um arquivo PPM. Lados que não
+// são potências de 2 são ampliados para a próxima (vizinho mais próximo). nullptr em caso de erro.
+inline std::shared_ptr<Textura> carregar_textura(const std::string& nome, LayoutTextura layout = TEXTURA_MORTON) {
+    if(nome == TEXTURA_XADREZ) return montar_textura(nome, gerar_xadrez(512), 512, 512, layout);
+    std::vector<uint32_t> pixels;
+    int w, h;
+    if(!ler_ppm(nome.c_str(), pixels, w, h)) return nullptr;
+    int pw = 1 << log2_inteiro(w), ph = 1 << log2_inteiro(h);
+    if(pw < w) pw *= 2;
+    if(ph < h) ph *= 2;
+    if(pw != w || ph != h) {
+        std::vector<uint32_t> pot((size_t)pw * ph);
+        for(int y = 0; y < ph; y++)
+            for(int x = 0; x < pw; x++) pot[(size_t)y * pw + x] = pixels[(size_t)(y * h / ph) * w + x * w / pw];
+        pixels.swap(pot);
+    }
+    return montar_textura(nome, std::move(pixels), pw, ph, layout);
+}
+
+// ==========================================
+//   AMOSTRAGEM
+// ==========================================
+
+// Planos de s/W, t/W e 1/W de um triângulo na tela: valor no vértice de origem (ox, oy) e derivadas
+// por pixel. s e t estão em texturas inteiras (1 = uma repetição).
+struct PlanoTextura {
+    float ox, oy;
+    float s0, sx, sy;
+    float t0, tx, ty;
+    float q0, qx, qy;
+};
+
+// Planos a partir dos vértices de tela (x, y), da profundidade W e das coordenadas de textura
+inline PlanoTextura montar_plano_textura(const float x[3], const float y[3], const float w[3],
+                                         const float s[3], const float t[3]) {
+    PlanoTextura p;
+    p.ox = x[0]; p.oy = y[0];
+    float x1 = x[1] - x[0], y1 = y[1] - y[0], x2 = x[2] - x[0], y2 = y[2] - y[0];
+    float area = x1 * y2 - x2 * y1;
+    float inv = area != 0.0f ? 1.0f / area : 0.0f;
+    float q[3] = { 1.0f / w[0], 1.0f / w[1], 1.0f / w[2] };
+    auto plano = [&](const float f[3], float& f0, float& fx, float& fy) {
+        float d1 = f[1] - f[0], d2 = f[2] - f[0];
+        f0 = f[0];
+        fx = (d1 * y2 - d2 * y1) * inv;
+        fy = (d2 * x1 - d1 * x2) * inv;
+    };
+    float sq[3] = { s[0] * q[0], s[1] * q[1], s[2] * q[2] };
+    float tq[3] = { t[0] * q[0], t[1] * q[1], t[2] * q[2] };
+    plano(sq, p.s0, p.sx, p.sy);
+    plano(tq, p.t0, p.tx, p.ty);
+    plano(q, p.q0, p.qx, p.qy);
+    return p;
+}
+
+// Canal (deslocado de DESL bits) de um vetor ARGB, em float 0..255
+template<int DESL>
+inline vfloat canal_textura(vint c) { return vi_para_vf(vi_and(vi_shr<DESL>(c), vi_set(0xFFu))); }
+
+// Albedo (0..1 por canal) de SIMD_LARGURA pixels de centros (px, py). O nível de mipmap vem da
+// maior pegada (texels por pixel) entre as lanes de 'lanes' (sem mipmaps, o nível 0); as demais lanes podem estar fora do
+// triângulo, e seus índices são mantidos dentro da textura pelas máscaras de repetição.
+inline void amostrar_textura(const Textura& tex, const PlanoTextura& pl, vfloat px, vfloat py, int lanes, vfloat albedo[3]) {
+    const int W = SIMD_LARGURA;
+    vfloat dx = vf_sub(px, vf_set(pl.ox)), dy = vf_sub(py, vf_set(pl.oy));
+    vfloat q = vf_add(vf_add(vf_set(pl.q0), vf_mul(vf_set(pl.qx), dx)), vf_mul(vf_set(pl.qy), dy));
+    vfloat sq = vf_add(vf_add(vf_set(pl.s0), vf_mul(vf_set(pl.sx), dx)), vf_mul(vf_set(pl.sy), dy));
+    vfloat tq = vf_add(vf_add(vf_set(pl.t0), vf_mul(vf_set(pl.tx), dx)), vf_mul(vf_set(pl.ty), dy));
+    vfloat inv = vf_div(vf_set(1.0f), q);
+    vfloat s = vf_mul(sq, inv), t = vf_mul(tq, inv);
+
+    // Derivadas de s = (s/W) / (1/W) na tela: ds/dx = (d(s/W)/dx - s * d(1/W)/dx) * W
+    const NivelMip& base = tex.niveis[0];
+    vfloat ws = vf_set((float)base.largura), ht = vf_set((float)base.altura);
+    vfloat dsdx = vf_mul(vf_mul(vf_sub(vf_set(pl.sx), vf_mul(s, vf_set(pl.qx))), inv), ws);
+    vfloat dtdx = vf_mul(vf_mul(vf_sub(vf_set(pl.tx), vf_mul(t, vf_set(pl.qx))), inv), ht);
+    vfloat dsdy = vf_mul(vf_mul(vf_sub(vf_set(pl.sy), vf_mul(s, vf_set(pl.qy))), inv), ws);
+    vfloat dtdy = vf_mul(vf_mul(vf_sub(vf_set(pl.ty), vf_mul(t, vf_set(pl.qy))), inv), ht);
+    vfloat pegada = vf_max(vf_add(vf_mul(dsdx, dsdx), vf_mul(dtdx, dtdx)), vf_add(vf_mul(dsdy, dsdy), vf_mul(dtdy, dtdy)));
+
+    // Nível: log2 da pegada (lado em texels), arredondado
+    float p[W], maior = 0.0f;
+    vf_store(p, pegada);
+    for(int i = 0; i < W; i++) if((lanes & (1 << i)) && p[i] > maior) maior = p[i];
+    int nivel = 0;
+    if(tex.mipmaps && maior > 1.0f) nivel = std::min((int)(0.5f * std::log2(std::min(maior, 1e30f)) + 0.5f), (int)tex.niveis.size() - 1);
+    const NivelMip& n = tex.niveis[nivel];
+
+    // Bilinear: os quatro texels em volta do ponto, com repetição da textura
+    vfloat u = vf_sub(vf_mul(s, vf_set((float)n.largura)), vf_set(0.5f));
+    vfloat v = vf_sub(vf_mul(t, vf_set((float)n.altura)), vf_set(0.5f));
+    vfloat u0 = vf_floor(u), v0 = vf_floor(v);
+    vfloat fu = vf_sub(u, u0), fv = vf_sub(v, v0);
+    const vint mx = vi_set(n.largura - 1), my = vi_set(n.altura - 1), um = vi_set(1);
+    vint x0 = vf_para_vi_trunc(u0), y0 = vf_para_vi_trunc(v0);
+    vint x1 = vi_and(vi_add(x0, um), mx), y1 = vi_and(vi_add(y0, um), my);
+    x0 = vi_and(x0, mx); y0 = vi_and(y0, my);
+    vint cx0 = vi_gather(n.desl_x.data(), x0), cx1 = vi_gather(n.desl_x.data(), x1);
+    vint ly0 = vi_gather(n.desl_y.data(), y0), ly1 = vi_gather(n.desl_y.data(), y1);
+    const uint32_t* texels = n.texels.data();
+    vint c00 = vi_gather(texels, vi_add(cx0, ly0)), c10 = vi_gather(texels, vi_add(cx1, ly0));
+    vint c01 = vi_gather(texels, vi_add(cx0, ly1)), c11 = vi_gather(texels, vi_add(cx1, ly1));
+
+    const vfloat escala = vf_set(1.0f / 255.0f);
+    auto filtrar = [&](vfloat a, vfloat b, vfloat c, vfloat d) {
+        vfloat cima = vf_add(a, vf_mul(vf_sub(b, a), fu));
+        vfloat baixo = vf_add(c, vf_mul(vf_sub(d, c), fu));
+        return vf_mul(vf_add(cima, vf_mul(vf_sub(baixo, cima), fv)), escala);
+    };
+    albedo[0] = filtrar(canal_textura<16>(c00), canal_textura<16>(c10), canal_textura<16>(c01), canal_textura<16>(c11));
+    albedo[1] = filtrar(canal_textura<8>(c00), canal_textura<8>(c10), canal_textura<8>(c01), canal_textura<8>(c11));
+    albedo[2] = filtrar(canal_textura<0>(c00), canal_textura<0>(c10), canal_textura<0>(c01), canal_textura<0>(c11));
+}
+
+// Cor média da textura (o nível 1x1), para o Flat Shading
+inline void cor_media_textura(const Textura& tex, vfloat albedo[3]) {
+    uint32_t c = tex.niveis.back().texels[0];
+    albedo[0] = vf_set(((c >> 16) & 0xFF) / 255.0f);
+    albedo[1] = vf_set(((c >> 8) & 0xFF) / 255.0f);
+    albedo[2] = vf_set((c & 0xFF) / 255.0f);
+}
+
+// Coordenadas de textura por projeção em caixa: a face é mapeada pelo eixo dominante da normal,
+// com os dois outros eixos da posição no objeto ([-1,1]) levados a [0,1]. No cubo, cada face
+// recebe a textura inteira; nas malhas (sem coordenadas próprias no .malha), a caixa envolvente.
+// 'o' são os cantos no espaço do objeto, na ordem do pipeline (normal para fora = (o2-o0) x (o1-o0)).
+inline void uv_caixa(const Vec4 o[3], float s[3], float t[3]) {
+    Vec4 n = (o[2] - o[0]).cross(o[1] - o[0]);
+    float ax = std::fabs(n.x), ay = std::fabs(n.y), az = std::fabs(n.z);
+    for(int i = 0; i < 3; i++) {
+        float u, v;
+        if(ax >= ay && ax >= az) { u = n.x > 0 ? -o[i].z : o[i].z; v = o[i].y; }
+        else if(ay >= az) { u = o[i].x; v = n.y > 0 ? -o[i].z : o[i].z; }
+        else { u = n.z > 0 ? o[i].x : -o[i].x; v = o[i].y; }
+        s[i] = (u + 1.0f) * 0.5f;
+        t[i] = (1.0f - v) * 0.5f; // Linha 0 da imagem em cima
+    }
+}
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * THREAD_POOL.H
+ * Pool de threads simples para paralelizar o pipeline.
+ * As threads são criadas uma única vez e reutilizadas a cada frame; o trabalho é
+ * distribuído como um "parallel for" sobre índices de tarefa (ex.: tiles da tela).
+ *
+ * Distribuição por roubo de trabalho (work stealing): cada thread recebe uma faixa contígua
+ * de índices e a consome pela frente; quando a sua acaba, rouba índices do fim da faixa das
+ * outras. Não há alocação por chamada: a tarefa é passada por ponteiro, sem std::function.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <cstdint>
+
+struct PoolThreads {
+    // n_threads inclui a thread chamadora (que também trabalha em executar()).
+    explicit PoolThreads(int n_threads = 0) {
+        if(n_threads <= 0) n_threads = (int)std::thread::hardware_concurrency();
+        if(n_threads <= 0) n_threads = 1;
+        faixas.reset(new Faixa[n_threads]);
+        for(int i = 1; i < n_threads; i++) workers.emplace_back([this, i] { loop_worker(i); });
+    }
+
+    ~PoolThreads() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            encerrar = true;
+        }
+        cv_inicio.notify_all();
+        for(auto& t : workers) t.join();
+    }
+
+    PoolThreads(const PoolThreads&) = delete;
+    PoolThreads& operator=(const PoolThreads&) = delete;
+
+    int num_threads() const { return (int)workers.size() + 1; }
+
+    // Executa tarefa(i) para i em [0, n) e bloqueia até todas terminarem.
+    template<class F>
+    void executar(int n, F&& tarefa) {
+        auto com_thread = [&](int i, int) { tarefa(i); };
+        executar_por_thread(n, com_thread);
+    }
+
+    // Como executar(), mas a tarefa também recebe o índice da thread que a roda, em
+    // [0, num_threads()): permite que cada thread escreva em um buffer só seu.
+    template<class F>
+    void executar_por_thread(int n, F&& tarefa) {
+        if(n <= 0) return;
+        if(workers.empty()) { for(int i = 0; i < n; i++) tarefa(i, 0); return; }
+
+        typedef typename std::remove_reference<F>::type Tipo;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            trampolim = [](void* f, int i, int t) { (*static_cast<Tipo*>(f))(i, t); };
+            contexto = (void*)&tarefa;
+            int nt = num_threads();
+            for(int t = 0; t < nt; t++)
+                faixas[t].definir((uint32_t)((long long)n * t / nt), (uint32_t)((long long)n * (t + 1) / nt));
+            ativos = (int)workers.size();
+            geracao++;
+        }
+        cv_inicio.notify_all();
+
+        consumir(0);
+
+        std::unique_lock<std::mutex> lock(mtx);
+        cv_fim.wait(lock, [this] { return ativos == 0; });
+        trampolim = nullptr;
+        contexto = nullptr;
+    }
+
+private:
+    // Faixa [inicio, fim) de uma thread, empacotada em 64 bits para ser alterada com um único CAS:
+    // a dona avança o início, os ladrões recuam o fim.
+    struct alignas(64) Faixa {
+        std::atomic<uint64_t> intervalo{0};
+
+        void definir(uint32_t inicio, uint32_t fim) { intervalo.store(((uint64_t)inicio << 32) | fim); }
+
+        bool pegar_inicio(int& i) {
+            uint64_t v = intervalo.load();
+            for(;;) {
+                uint32_t inicio = (uint32_t)(v >> 32), fim = (uint32_t)v;
+                if(inicio >= fim) return false;
+                if(intervalo.compare_exchange_weak(v, ((uint64_t)(inicio + 1) << 32) | fim)) { i = (int)inicio; return true; }
+            }
+        }
+
+        bool roubar_fim(int& i) {
+            uint64_t v = intervalo.load();
+            for(;;) {
+                uint32_t inicio = (uint32_t)(v >> 32), fim = (uint32_t)v;
+                if(inicio >= fim) return false;
+                if(intervalo.compare_exchange_weak(v, ((uint64_t)inicio << 32) | (fim - 1))) { i = (int)(fim - 1); return true; }
+            }
+        }
+    };
+
+    void consumir(int t) {
+        int i;
+        while(faixas[t].pegar_inicio(i)) trampolim(contexto, i, t);
+        int nt = num_threads();
+        for(int k = 1; k < nt; k++) {
+            Faixa& vitima = faixas[(t + k) % nt];
+            while(vitima.roubar_fim(i)) trampolim(contexto, i, t);
+        }
+    }
+
+    void loop_worker(int t) {
+        unsigned long long vista = 0;
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_inicio.wait(lock, [&] { return encerrar || geracao != vista; });
+                if(encerrar) return;
+                vista = geracao;
+            }
+            consumir(t);
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if(--ativos == 0) cv_fim.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Faixa[]> faixas; // Uma por thread (índice 0 = chamadora)
+    std::mutex mtx;
+    std::condition_variable cv_inicio, cv_fim;
+    void (*trampolim)(void*, int, int) = nullptr;
+    void* contexto = nullptr;
+    int ativos = 0;
+    unsigned long long geracao = 0;
+    bool encerrar = false;
+};
+
+#endif